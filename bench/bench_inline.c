@@ -0,0 +1,100 @@
+/**
+ * small field decoding benchmark.
+ *
+ * decodes a stream of fixed layout records field by field with
+ * sstm_read(), which is the access pattern of most binary parsers.
+ * build it twice to compare the out-of-line library with the
+ * static inline build:
+ *
+ *   cc -O2 -I.. bench_inline.c ../seekablestream.c -o bench_call
+ *   cc -O2 -I.. -DSSTM_IMPLEMENTATION bench_inline.c -o bench_inline
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "seekablestream.h"
+
+#define BENCH_CAP_SIZE          (64 * 1024)
+#define BENCH_ROUNDS            2000
+
+/* one record: u8 type, u16 flags, u32 length, u32 id, u64 stamp. */
+#define BENCH_REC_SIZE          19
+#define BENCH_REC_FIELDS        5
+
+static double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+int main(void) {
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_u8_t rec[BENCH_REC_SIZE];
+    sstm_u8_t type;
+    sstm_u16_t flags;
+    sstm_u32_t length;
+    sstm_u32_t id;
+    uint64_t stamp;
+    uint64_t sum;
+    sstm_size_t rec_num;
+    sstm_size_t i;
+    double begin;
+    double elapsed;
+    int round;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = BENCH_CAP_SIZE;
+    if (sstm_new(&ctx, &conf) != SSTM_OK) {
+        fprintf(stderr, "sstm_new failed\n");
+
+        return 1;
+    }
+
+    /* fill the stream once, every round seeks back to the start. */
+    rec_num = BENCH_CAP_SIZE / BENCH_REC_SIZE;
+    for (i = 0; i < BENCH_REC_SIZE; i++) {
+        rec[i] = (sstm_u8_t)(i * 13 + 1);
+    }
+    for (i = 0; i < rec_num; i++) {
+        sstm_write(ctx, rec, BENCH_REC_SIZE);
+    }
+
+    type = 0;
+    flags = 0;
+    length = 0;
+    id = 0;
+    stamp = 0;
+    sum = 0;
+    begin = bench_now();
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        sstm_seek(ctx, 0, SSTM_SEEK_SET);
+        for (i = 0; i < rec_num; i++) {
+            sstm_read(ctx, &type, sizeof(type), 0);
+            sstm_read(ctx, &flags, sizeof(flags), 0);
+            sstm_read(ctx, &length, sizeof(length), 0);
+            sstm_read(ctx, &id, sizeof(id), 0);
+            sstm_read(ctx, &stamp, sizeof(stamp), 0);
+            sum += type + flags + length + id + stamp;
+        }
+    }
+    elapsed = bench_now() - begin;
+
+    printf("%s: %.2f ns/field, %.1f MiB/s (checksum %llu)\n",
+#ifdef SSTM_IMPLEMENTATION
+           "inline",
+#else
+           "call",
+#endif
+           elapsed / ((double)BENCH_ROUNDS * rec_num * BENCH_REC_FIELDS),
+           (double)BENCH_ROUNDS * rec_num * BENCH_REC_SIZE / (elapsed / 1e9) / (1024 * 1024),
+           (unsigned long long)sum);
+
+    sstm_del(ctx);
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+/**
+ * large transfer cache pollution benchmark.
+ *
+ * streams transfers of -s bytes through a context (a write followed
+ * by a read with cleanup) and, between two transfers, chases -k
+ * random pointers (one pass by default) through a table of -t bytes,
+ * which stands for the cache-sensitive work that runs next to the
+ * stream. reports the transfer GB/s, the ns per table access and
+ * how many copies took the non-temporal path. build it twice to
+ * compare the two paths:
+ *
+ *   cc -O2 -I.. bench_nt.c ../seekablestream.c -o bench_copy
+ *   cc -O2 -I.. -DSSTM_USE_NT=1 bench_nt.c ../seekablestream.c -o bench_nt
+ *   ./bench_nt -s 4194304 -t 1048576
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "seekablestream.h"
+
+#define BENCH_ROUNDS            200
+
+/* the table is made of cache line sized slots. */
+#define BENCH_SLOT_SIZE         64
+
+typedef struct _bench_slot {
+    struct _bench_slot *next;
+    sstm_u8_t pad[BENCH_SLOT_SIZE - sizeof(void *)];
+} bench_slot_t;
+
+static double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* link the slots into one random cycle. */
+static bench_slot_t *bench_table_new(size_t table_size) {
+    bench_slot_t *table;
+    size_t *order;
+    size_t slot_num;
+    size_t i;
+
+    slot_num = table_size / BENCH_SLOT_SIZE;
+    table = aligned_alloc(BENCH_SLOT_SIZE, slot_num * BENCH_SLOT_SIZE);
+    order = malloc(slot_num * sizeof(*order));
+    if (table == NULL || order == NULL) {
+        free(table);
+        free(order);
+
+        return NULL;
+    }
+
+    for (i = 0; i < slot_num; i++) {
+        order[i] = i;
+    }
+    for (i = slot_num - 1; i > 0; i--) {
+        size_t j = (size_t)rand() % (i + 1);
+        size_t tmp = order[i];
+
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (i = 0; i < slot_num; i++) {
+        table[order[i]].next = &table[order[(i + 1) % slot_num]];
+    }
+    free(order);
+
+    return table;
+}
+
+static void bench_usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-s transfer size] [-t table size] [-k accesses]\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    sstm_conf_t conf;
+    sstm_stat_t stat;
+    sstm_ctx_t *ctx;
+    bench_slot_t *table;
+    bench_slot_t *slot;
+    sstm_u8_t *src;
+    sstm_u8_t *dst;
+    size_t xfer_size;
+    size_t table_size;
+    size_t access_num;
+    size_t i;
+    double begin;
+    double xfer_time;
+    double access_time;
+    int round;
+    int opt;
+
+    xfer_size = 4 << 20;
+    table_size = 1 << 20;
+    access_num = 0;
+    while ((opt = getopt(argc, argv, "s:t:k:h")) != -1) {
+        switch (opt) {
+            case 's':
+                xfer_size = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                table_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'k':
+                access_num = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                bench_usage(argv[0]);
+
+                return 1;
+        }
+    }
+    if (xfer_size == 0 || table_size < BENCH_SLOT_SIZE) {
+        bench_usage(argv[0]);
+
+        return 1;
+    }
+    if (access_num == 0) {
+        access_num = table_size / BENCH_SLOT_SIZE;
+    }
+
+    /* the transfers move around the ring, twice the
+       transfer size keeps one in four of them split. */
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = (sstm_size_t)(xfer_size * 2 + xfer_size / 4);
+    if (sstm_new(&ctx, &conf) != SSTM_OK) {
+        fprintf(stderr, "sstm_new failed\n");
+
+        return 1;
+    }
+
+    src = malloc(xfer_size);
+    dst = malloc(xfer_size);
+    table = bench_table_new(table_size);
+    if (src == NULL || dst == NULL || table == NULL) {
+        fprintf(stderr, "out of memory\n");
+
+        return 1;
+    }
+    memset(src, 0x5a, xfer_size);
+    memset(dst, 0, xfer_size);
+
+    /* warm the table up. */
+    slot = table;
+    for (i = 0; i < table_size / BENCH_SLOT_SIZE; i++) {
+        slot = slot->next;
+    }
+
+    xfer_time = 0;
+    access_time = 0;
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        begin = bench_now();
+        sstm_write(ctx, src, (sstm_size_t)xfer_size);
+        sstm_read(ctx, dst, (sstm_size_t)xfer_size, 1);
+        xfer_time += bench_now() - begin;
+
+        begin = bench_now();
+        for (i = 0; i < access_num; i++) {
+            slot = slot->next;
+        }
+        access_time += bench_now() - begin;
+    }
+
+    sstm_stat(ctx, &stat);
+    printf("%s: %.2f GB/s transfer, %.2f ns/access (%zu B table), "
+           "%llu nt writes, %llu nt reads (slot %p)\n",
+#if SSTM_USE_NT
+           "nt",
+#else
+           "copy",
+#endif
+           (double)BENCH_ROUNDS * xfer_size * 2 / xfer_time,
+           access_time / ((double)BENCH_ROUNDS * access_num),
+           table_size,
+#if SSTM_USE_NT
+           (unsigned long long)stat.nt_writes,
+           (unsigned long long)stat.nt_reads,
+#else
+           0ull,
+           0ull,
+#endif
+           (void *)slot);
+
+    free(table);
+    free(dst);
+    free(src);
+    sstm_del(ctx);
+
+    return 0;
+}
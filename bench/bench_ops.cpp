@@ -0,0 +1,202 @@
+/**
+ * google-benchmark suite of the stream operations.
+ *
+ * measures sstm_write, sstm_read (with and without cleanup),
+ * sstm_seek and sstm_clean for transfer sizes from 1 B to 1 MiB and
+ * capacities from SSTM_CAP_SIZE_MIN to 256 MiB, with the copies
+ * either inside the ring or split across its end. time is reported
+ * as ns/op, throughput as bytes_per_second.
+ *
+ * operations that consume their position (write, read with cleanup,
+ * clean) put the stream back with bench_pos_reset() inside the timed
+ * loop, which adds the same few ns to every variant.
+ *
+ *   cc -O2 -c -I.. ../seekablestream.c bench_pos.c
+ *   c++ -std=c++17 -O2 -I.. bench_ops.cpp seekablestream.o bench_pos.o -lbenchmark -lpthread -o bench_ops
+ *   ./bench_ops --benchmark_filter=BM_read
+*/
+
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "seekablestream.h"
+
+extern "C" void bench_pos_reset(sstm_ctx_t *ctx, sstm_size_t idx, sstm_size_t fill);
+
+namespace {
+
+enum bench_pos {
+
+    /* the copy never crosses the end of the ring. */
+    BENCH_NO_WRAP = 0,
+
+    /* the copy is split across the end of the ring. */
+    BENCH_WRAP,
+};
+
+const int64_t bench_caps[] = {
+    SSTM_CAP_SIZE_MIN,
+    4 << 10,
+    64 << 10,
+    1 << 20,
+    16 << 20,
+    256 << 20,
+};
+
+const int64_t bench_sizes[] = {
+    1,
+    8,
+    64,
+    512,
+    4 << 10,
+    32 << 10,
+    256 << 10,
+    1 << 20,
+};
+
+/* {capacity, size, position} for every size that fits the capacity. */
+void bench_args(benchmark::internal::Benchmark *bench) {
+    for (int64_t cap : bench_caps) {
+        for (int64_t size : bench_sizes) {
+            if (size > cap) {
+                continue;
+            }
+            bench->Args({cap, size, BENCH_NO_WRAP});
+            if (size > 1) {
+                bench->Args({cap, size, BENCH_WRAP});
+            }
+        }
+    }
+}
+
+/* {capacity} only. */
+void bench_cap_args(benchmark::internal::Benchmark *bench) {
+    for (int64_t cap : bench_caps) {
+        bench->Args({cap});
+    }
+}
+
+sstm_ctx_t *bench_new(sstm_size_t cap_size) {
+    sstm_conf_t conf{};
+    sstm_ctx_t *ctx = nullptr;
+
+    conf.cap_size = cap_size;
+    if (sstm_new(&ctx, &conf) != SSTM_OK) {
+        return nullptr;
+    }
+
+    return ctx;
+}
+
+/* the ring index at which a copy of the given size starts. */
+sstm_size_t bench_start_idx(sstm_size_t cap_size, sstm_size_t size, int64_t pos) {
+    if (pos == BENCH_WRAP) {
+
+        /* half of the copy before the end of the ring (cap + 1). */
+        return cap_size + 1 - size / 2;
+    }
+
+    return 0;
+}
+
+void BM_write(benchmark::State &state) {
+    sstm_size_t cap_size = static_cast<sstm_size_t>(state.range(0));
+    sstm_size_t size = static_cast<sstm_size_t>(state.range(1));
+    sstm_size_t start_idx = bench_start_idx(cap_size, size, state.range(2));
+    std::vector<sstm_u8_t> data(size, 0x5a);
+    sstm_ctx_t *ctx;
+
+    ctx = bench_new(cap_size);
+    for (auto _ : state) {
+        bench_pos_reset(ctx, start_idx, 0);
+        sstm_write(ctx, data.data(), size);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * size);
+
+    sstm_del(ctx);
+}
+BENCHMARK(BM_write)->Apply(bench_args);
+
+void BM_read(benchmark::State &state) {
+    sstm_size_t cap_size = static_cast<sstm_size_t>(state.range(0));
+    sstm_size_t size = static_cast<sstm_size_t>(state.range(1));
+    std::vector<sstm_u8_t> data(size);
+    sstm_ctx_t *ctx;
+
+    /* the data stays in place, every read seeks back to it. */
+    ctx = bench_new(cap_size);
+    bench_pos_reset(ctx, bench_start_idx(cap_size, size, state.range(2)), size);
+    for (auto _ : state) {
+        sstm_seek(ctx, 0, SSTM_SEEK_SET);
+        sstm_read(ctx, data.data(), size, 0);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * size);
+
+    sstm_del(ctx);
+}
+BENCHMARK(BM_read)->Apply(bench_args);
+
+void BM_read_cleanup(benchmark::State &state) {
+    sstm_size_t cap_size = static_cast<sstm_size_t>(state.range(0));
+    sstm_size_t size = static_cast<sstm_size_t>(state.range(1));
+    sstm_size_t start_idx = bench_start_idx(cap_size, size, state.range(2));
+    std::vector<sstm_u8_t> data(size);
+    sstm_ctx_t *ctx;
+
+    ctx = bench_new(cap_size);
+    for (auto _ : state) {
+        bench_pos_reset(ctx, start_idx, size);
+        sstm_read(ctx, data.data(), size, 1);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * size);
+
+    sstm_del(ctx);
+}
+BENCHMARK(BM_read_cleanup)->Apply(bench_args);
+
+void BM_seek(benchmark::State &state) {
+    sstm_size_t cap_size = static_cast<sstm_size_t>(state.range(0));
+    sstm_offs_t offs;
+    sstm_ctx_t *ctx;
+
+    /* alternate between forward and backward seeks over a full stream. */
+    ctx = bench_new(cap_size);
+    bench_pos_reset(ctx, 0, cap_size);
+    offs = 0;
+    for (auto _ : state) {
+        sstm_seek(ctx, offs, SSTM_SEEK_SET);
+        offs = static_cast<sstm_offs_t>(cap_size) - 1 - offs;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+
+    sstm_del(ctx);
+}
+BENCHMARK(BM_seek)->Apply(bench_cap_args);
+
+void BM_clean(benchmark::State &state) {
+    sstm_size_t cap_size = static_cast<sstm_size_t>(state.range(0));
+    sstm_size_t size = static_cast<sstm_size_t>(state.range(1));
+    sstm_size_t start_idx = bench_start_idx(cap_size, size, state.range(2));
+    sstm_ctx_t *ctx;
+
+    /* every clean drops size bytes of stale data. */
+    ctx = bench_new(cap_size);
+    for (auto _ : state) {
+        bench_pos_reset(ctx, start_idx, size);
+        sstm_seek(ctx, static_cast<sstm_offs_t>(size), SSTM_SEEK_SET);
+        sstm_clean(ctx);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * size);
+
+    sstm_del(ctx);
+}
+BENCHMARK(BM_clean)->Apply(bench_args);
+
+}
+
+BENCHMARK_MAIN();
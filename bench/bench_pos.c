@@ -0,0 +1,37 @@
+/**
+ * ring positioning for the benchmarks.
+ *
+ * the public API can only move a stream to a given ring index by
+ * writing through the ring, which is a full pass over large
+ * capacities. this file compiles the implementation as static
+ * functions (so nothing clashes with the library) and sets the
+ * indexes directly. build it with the same SSTM_USE_* options as
+ * the library.
+*/
+
+#define SSTM_IMPLEMENTATION
+#include "seekablestream.h"
+
+void bench_pos_reset(sstm_ctx_t *ctx, sstm_size_t idx, sstm_size_t fill);
+
+/**
+ * @brief empty the stream and put its head at a ring index.
+ *
+ * @param ctx context pointer.
+ * @param idx the ring index of the head.
+ * @param fill the size of fresh data after the head, left with
+ *             whatever the ring holds.
+*/
+void bench_pos_reset(sstm_ctx_t *ctx, sstm_size_t idx, sstm_size_t fill) {
+    /* every index is its position modulo the ring size,
+       sstm_pread() relies on it. */
+    ctx->head_idx = idx;
+    ctx->tail_idx = (idx + fill) % (ctx->conf.cap_size + 1);
+    ctx->head_pos = idx;
+    ctx->tail_pos = (sstm_u64_t)idx + fill;
+    ctx->seek_offs = 0;
+    ctx->cache.used_size = fill;
+    ctx->cache.stale_size = 0;
+    ctx->cache.fresh_size = fill;
+    ctx->cache.free_size = ctx->conf.cap_size - fill;
+}
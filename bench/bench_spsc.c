@@ -0,0 +1,382 @@
+/**
+ * cross-core producer/consumer benchmark.
+ *
+ * a producer and a consumer thread, pinned to the given cpus, stream
+ * fixed size messages through one context. every message starts with
+ * the timestamp counter value at which it was produced, so the
+ * consumer can record the one-way latency. reports sustained GB/s and
+ * the p50/p99/p999 latency for every message size and capacity.
+ *
+ * modes:
+ *   lock   every call is made under a mutex (any build).
+ *   spsc   lock-free, needs SSTM_USE_SPSC.
+ *   batch  lock-free, messages are written and read in batches of -b.
+ *
+ *   cc -O2 -pthread -I.. -DSSTM_USE_SPSC=1 bench_spsc.c ../seekablestream.c -o bench_spsc
+ *   ./bench_spsc -m spsc -p 0 -q 1 -s 64,1024 -c 65536,1048576
+*/
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "seekablestream.h"
+
+#define BENCH_MODE_LOCK         0
+#define BENCH_MODE_SPSC         1
+#define BENCH_MODE_BATCH        2
+
+#define BENCH_LIST_MAX          16
+
+/* the consumer keeps one latency sample in BENCH_SAMPLE_STEP messages. */
+#define BENCH_SAMPLE_STEP       16
+
+typedef struct _bench_conf {
+    int mode;
+    int prod_cpu;
+    int cons_cpu;
+    sstm_size_t batch;
+    sstm_size_t msg_num;
+    sstm_size_t msg_size;
+    sstm_size_t cap_size;
+} bench_conf_t;
+
+typedef struct _bench_run {
+    bench_conf_t conf;
+    sstm_ctx_t *ctx;
+    pthread_mutex_t lock;
+
+    /* latency samples in timestamp ticks. */
+    uint64_t *samples;
+    sstm_size_t sample_num;
+
+    double elapsed;
+} bench_run_t;
+
+static uint64_t bench_tsc(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* timestamp ticks per nanosecond. */
+static double bench_tsc_rate(void) {
+    double begin;
+    uint64_t tsc;
+
+    begin = bench_now();
+    tsc = bench_tsc();
+    while (bench_now() - begin < 0.1) {
+    }
+
+    return (double)(bench_tsc() - tsc) / ((bench_now() - begin) * 1e9);
+}
+
+static void bench_pin(int cpu) {
+    cpu_set_t set;
+
+    if (cpu < 0) {
+        return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* back off after a failed attempt, yield now and then so that both
+   threads still make progress when they share a cpu. */
+static void bench_relax(sstm_size_t *spins) {
+    *spins += 1;
+    if ((*spins & 0xff) == 0) {
+        sched_yield();
+    } else {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+    }
+}
+
+static sstm_res_t bench_write(bench_run_t *run, const void *data, sstm_size_t size) {
+    sstm_res_t res;
+
+    if (run->conf.mode != BENCH_MODE_LOCK) {
+        return sstm_write(run->ctx, data, size);
+    }
+    pthread_mutex_lock(&run->lock);
+    res = sstm_write(run->ctx, data, size);
+    pthread_mutex_unlock(&run->lock);
+
+    return res;
+}
+
+static sstm_res_t bench_read(bench_run_t *run, void *data, sstm_size_t size) {
+    sstm_res_t res;
+
+    if (run->conf.mode != BENCH_MODE_LOCK) {
+        return sstm_read(run->ctx, data, size, 1);
+    }
+    pthread_mutex_lock(&run->lock);
+    res = sstm_read(run->ctx, data, size, 1);
+    pthread_mutex_unlock(&run->lock);
+
+    return res;
+}
+
+static void *bench_producer(void *arg) {
+    bench_run_t *run = (bench_run_t *)arg;
+    sstm_size_t msg_size = run->conf.msg_size;
+    sstm_size_t batch = run->conf.mode == BENCH_MODE_BATCH ? run->conf.batch : 1;
+    sstm_size_t spins = 0;
+    sstm_size_t sent;
+    sstm_size_t num;
+    sstm_size_t i;
+    sstm_u8_t *buff;
+    uint64_t tsc;
+
+    bench_pin(run->conf.prod_cpu);
+
+    buff = (sstm_u8_t *)calloc(batch, msg_size);
+    for (sent = 0; sent < run->conf.msg_num; sent += num) {
+        num = run->conf.msg_num - sent < batch ? run->conf.msg_num - sent : batch;
+
+        /* all messages of a batch carry the same stamp, the
+           batching delay shows up as consumer side latency. */
+        tsc = bench_tsc();
+        for (i = 0; i < num; i++) {
+            memcpy(buff + i * msg_size, &tsc, sizeof(tsc));
+        }
+        while (bench_write(run, buff, num * msg_size) != SSTM_OK) {
+            bench_relax(&spins);
+        }
+    }
+    free(buff);
+
+    return NULL;
+}
+
+static void *bench_consumer(void *arg) {
+    bench_run_t *run = (bench_run_t *)arg;
+    sstm_size_t msg_size = run->conf.msg_size;
+    sstm_size_t batch = run->conf.mode == BENCH_MODE_BATCH ? run->conf.batch : 1;
+    sstm_size_t spins = 0;
+    sstm_size_t recv;
+    sstm_size_t num;
+    sstm_size_t i;
+    sstm_stat_t stat;
+    sstm_u8_t *buff;
+    uint64_t now;
+    uint64_t tsc;
+
+    bench_pin(run->conf.cons_cpu);
+
+    buff = (sstm_u8_t *)calloc(batch, msg_size);
+    for (recv = 0; recv < run->conf.msg_num; recv += num) {
+        num = 1;
+        if (batch > 1) {
+            sstm_stat(run->ctx, &stat);
+            num = stat.fresh_size / msg_size;
+            num = num > batch ? batch : (num == 0 ? 1 : num);
+        }
+        while (bench_read(run, buff, num * msg_size) != SSTM_OK) {
+            bench_relax(&spins);
+        }
+
+        now = bench_tsc();
+        for (i = 0; i < num; i++) {
+            if ((recv + i) % BENCH_SAMPLE_STEP == 0) {
+                memcpy(&tsc, buff + i * msg_size, sizeof(tsc));
+                run->samples[run->sample_num++] = now - tsc;
+            }
+        }
+    }
+    free(buff);
+
+    return NULL;
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    uint64_t lhs = *(const uint64_t *)a;
+    uint64_t rhs = *(const uint64_t *)b;
+
+    return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+static double bench_pct(bench_run_t *run, double pct, double tsc_rate) {
+    sstm_size_t idx = (sstm_size_t)(pct * (run->sample_num - 1));
+
+    return (double)run->samples[idx] / tsc_rate;
+}
+
+static int bench_run(bench_conf_t *conf, double tsc_rate) {
+    static const char *mode_names[] = { "lock", "spsc", "batch" };
+    pthread_t prod;
+    pthread_t cons;
+    bench_run_t run;
+    sstm_conf_t ctx_conf;
+    double begin;
+
+    memset(&run, 0, sizeof(run));
+    run.conf = *conf;
+    if (run.conf.mode == BENCH_MODE_BATCH &&
+        run.conf.batch * run.conf.msg_size > run.conf.cap_size) {
+        run.conf.batch = run.conf.cap_size / run.conf.msg_size;
+    }
+    if (run.conf.msg_size > run.conf.cap_size || run.conf.batch == 0) {
+        return 0;
+    }
+
+    memset(&ctx_conf, 0, sizeof(ctx_conf));
+    ctx_conf.cap_size = run.conf.cap_size;
+    if (sstm_new(&run.ctx, &ctx_conf) != SSTM_OK) {
+        fprintf(stderr, "sstm_new failed\n");
+
+        return -1;
+    }
+    pthread_mutex_init(&run.lock, NULL);
+    run.samples = (uint64_t *)malloc(sizeof(uint64_t) * (run.conf.msg_num / BENCH_SAMPLE_STEP + 1));
+
+    begin = bench_now();
+    pthread_create(&cons, NULL, bench_consumer, &run);
+    pthread_create(&prod, NULL, bench_producer, &run);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    run.elapsed = bench_now() - begin;
+
+    qsort(run.samples, run.sample_num, sizeof(uint64_t), bench_cmp);
+    printf("%-6s %8u %10u %8.3f GB/s %10.0f %10.0f %10.0f\n",
+           mode_names[run.conf.mode], run.conf.msg_size, run.conf.cap_size,
+           (double)run.conf.msg_num * run.conf.msg_size / run.elapsed / 1e9,
+           bench_pct(&run, 0.5, tsc_rate),
+           bench_pct(&run, 0.99, tsc_rate),
+           bench_pct(&run, 0.999, tsc_rate));
+
+    free(run.samples);
+    pthread_mutex_destroy(&run.lock);
+    sstm_del(run.ctx);
+
+    return 0;
+}
+
+/* parse a comma separated list of sizes. */
+static int bench_list(const char *str, sstm_size_t *list) {
+    int num = 0;
+
+    while (*str != '\0' && num < BENCH_LIST_MAX) {
+        char *end;
+
+        list[num++] = (sstm_size_t)strtoul(str, &end, 0);
+        str = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return -1;
+        }
+    }
+
+    return num;
+}
+
+static void bench_usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-m lock|spsc|batch] [-p cpu] [-q cpu] [-n messages]\n"
+            "          [-b batch] [-s size,...] [-c capacity,...]\n", name);
+}
+
+int main(int argc, char **argv) {
+    sstm_size_t sizes[BENCH_LIST_MAX] = { 16, 64, 256, 1024, 4096 };
+    sstm_size_t caps[BENCH_LIST_MAX] = { 4096, 65536, 1048576 };
+    int size_num = 5;
+    int cap_num = 3;
+    bench_conf_t conf;
+    double tsc_rate;
+    int opt;
+    int i;
+    int j;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.mode = BENCH_MODE_SPSC;
+    conf.prod_cpu = 0;
+    conf.cons_cpu = 1;
+    conf.batch = 32;
+    conf.msg_num = 1000000;
+
+    while ((opt = getopt(argc, argv, "m:p:q:n:b:s:c:h")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (strcmp(optarg, "lock") == 0) {
+                    conf.mode = BENCH_MODE_LOCK;
+                } else if (strcmp(optarg, "spsc") == 0) {
+                    conf.mode = BENCH_MODE_SPSC;
+                } else if (strcmp(optarg, "batch") == 0) {
+                    conf.mode = BENCH_MODE_BATCH;
+                } else {
+                    bench_usage(argv[0]);
+
+                    return 1;
+                }
+                break;
+            case 'p': conf.prod_cpu = atoi(optarg); break;
+            case 'q': conf.cons_cpu = atoi(optarg); break;
+            case 'n': conf.msg_num = (sstm_size_t)strtoul(optarg, NULL, 0); break;
+            case 'b': conf.batch = (sstm_size_t)strtoul(optarg, NULL, 0); break;
+            case 's': size_num = bench_list(optarg, sizes); break;
+            case 'c': cap_num = bench_list(optarg, caps); break;
+            default:
+                bench_usage(argv[0]);
+
+                return 1;
+        }
+    }
+    if (size_num <= 0 || cap_num <= 0) {
+        bench_usage(argv[0]);
+
+        return 1;
+    }
+
+#if !SSTM_USE_SPSC
+    if (conf.mode != BENCH_MODE_LOCK) {
+        fprintf(stderr, "lock-free modes need a build with SSTM_USE_SPSC=1\n");
+
+        return 1;
+    }
+#endif
+
+    tsc_rate = bench_tsc_rate();
+    printf("cpus %d -> %d, %u messages, latency in ns\n",
+           conf.prod_cpu, conf.cons_cpu, conf.msg_num);
+    printf("%-6s %8s %10s %13s %10s %10s %10s\n",
+           "mode", "msg", "cap", "throughput", "p50", "p99", "p999");
+    for (i = 0; i < cap_num; i++) {
+        for (j = 0; j < size_num; j++) {
+            conf.cap_size = caps[i];
+            conf.msg_size = sizes[j] < sizeof(uint64_t) ? sizeof(uint64_t) : sizes[j];
+            if (bench_run(&conf, tsc_rate) != 0) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -35,12 +35,221 @@
  * └────────────────────── allocated size ──────────────────────┘
 */
 
+#define __SSTM_C__
+
 #include <stdlib.h>
 #include <string.h>
 
 #include "seekablestream.h"
 
+#if SSTM_USE_WAIT
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#if SSTM_USE_EVENTFD
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+#if SSTM_USE_HIST || SSTM_USE_TIME
+#include <time.h>
+#endif
+
+#if SSTM_USE_USDT
+#include <sys/sdt.h>
+#endif
+
+#if SSTM_USE_MMAP
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if SSTM_USE_NT
+#include <immintrin.h>
+#endif
+
+#if SSTM_USE_SHM
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if SSTM_USE_XFORM && defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#if SSTM_USE_DUP
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+#endif
+
+#if SSTM_USE_SOURCE
+#include <pthread.h>
+#endif
+
+#if SSTM_USE_FILE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+ * in SPSC mode the producer owns tail_idx and the consumer owns
+ * head_idx, seek_offs and stale_size. the remaining cache fields are
+ * only ever changed by adding or subtracting, so both sides can update
+ * them with atomic read-modify-write operations in any order.
+*/
+#if SSTM_USE_SPSC
+#define SSTM_LOAD(var)          __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define SSTM_ADD(var, val)      __atomic_add_fetch(&(var), (val), __ATOMIC_SEQ_CST)
+#define SSTM_SUB(var, val)      __atomic_sub_fetch(&(var), (val), __ATOMIC_SEQ_CST)
+#define SSTM_STORE(var, val)    __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+#else
+#define SSTM_LOAD(var)          (var)
+#define SSTM_ADD(var, val)      ((var) += (val))
+#define SSTM_SUB(var, val)      ((var) -= (val))
+#define SSTM_STORE(var, val)    ((var) = (val))
+#endif
+
+/**
+ * a shared context is mapped at a different address in every
+ * process, so SHM builds find the ring buffer by its offset from
+ * the context, for private contexts as well.
+*/
+#if SSTM_USE_SHM
+#define SSTM_RING(ctx)              ((sstm_u8_t *)((intptr_t)(ctx) + (ctx)->ring_offs))
+#define SSTM_RING_SET(ctx, ring)    ((ctx)->ring_offs = (intptr_t)(ring) - (intptr_t)(ctx))
+#else
+#define SSTM_RING(ctx)              ((ctx)->ring_buff)
+#define SSTM_RING_SET(ctx, ring)    ((ctx)->ring_buff = (ring))
+#endif
+
+/**
+ * the cumulative counters are plain fields, each one is only changed
+ * by the side that owns it in SPSC mode.
+*/
+#if SSTM_USE_STATS
+#define SSTM_COUNT(ctx, field, val)     ((ctx)->stat.field += (val))
+#else
+#define SSTM_COUNT(ctx, field, val)
+#endif
+
+#if SSTM_USE_HIST
+#define SSTM_HIST_BEGIN(begin)          ((begin) = sstm_cycles())
+#define SSTM_HIST_END(ctx, op, begin)   sstm_hist_add(&(ctx)->hist[op], (begin))
+#else
+#define SSTM_HIST_BEGIN(begin)          ((begin) = 0)
+#define SSTM_HIST_END(ctx, op, begin)   ((void)(begin))
+#endif
+
+/**
+ * the probes of provider "sstm" are <func>_entry(ctx, size) and
+ * <func>_exit(ctx, size, res, used_size), where size is the size,
+ * offset or watermark argument of the function. e.g.
+ * 
+ *   bpftrace -e 'usdt:./app:sstm:write_exit /arg2 != 0/ { @[arg3] = count(); }'
+ * 
+ * an unattached probe is a single nop. used_size is passed as a
+ * memory operand, which the tracer only reads when the probe fires,
+ * so it is a plain field access even in SPSC mode.
+*/
+#if SSTM_USE_USDT
+#define SSTM_PROBE_ENTRY(func, ctx, size) \
+    DTRACE_PROBE2(sstm, func##_entry, (ctx), (size))
+#define SSTM_PROBE_EXIT(func, ctx, size, res, used) \
+    DTRACE_PROBE4(sstm, func##_exit, (ctx), (size), (res), (used))
+#else
+#define SSTM_PROBE_ENTRY(func, ctx, size)
+#define SSTM_PROBE_EXIT(func, ctx, size, res, used)
+#endif
+
+#if SSTM_USE_RECORD || SSTM_USE_TIME || SSTM_USE_HOLE
+
+/* a position in the stream and a value attached to it. */
+typedef struct _sstm_mark {
+
+    /* the absolute position, counted from
+       the first byte ever written. */
+    sstm_u64_t pos;
+
+    sstm_u64_t val;
+} sstm_mark_t;
+
+/**
+ * a ring of marks in position order. the producer pushes at tail,
+ * the consumer drops from head once the marked data is cleaned. both
+ * counters only grow, the slot of mark n is n & mask.
+*/
+typedef struct _sstm_marks {
+    sstm_mark_t *ring;
+    sstm_u64_t mask;
+    sstm_u64_t head;
+    sstm_u64_t tail;
+} sstm_marks_t;
+
+#endif
+
+#if SSTM_USE_REF
+
+/* a buffer linked into the stream by sstm_write_ref(). */
+typedef struct _sstm_ref {
+
+    /* the absolute position of the buffer. */
+    sstm_u64_t pos;
+
+    const sstm_u8_t *data;
+    sstm_size_t size;
+    sstm_release_func_t release;
+    void *arg;
+} sstm_ref_t;
+
+#endif
+
+#if SSTM_USE_DUP
+
+/* a file holding the ring buffer of a stream and its
+   clones, freed with the last context that maps it. */
+typedef struct _sstm_dup_file {
+    int fd;
+    sstm_u32_t refs;
+} sstm_dup_file_t;
+
+#endif
+
 struct _sstm_ctx {
+#if SSTM_USE_SHM
+
+    /* first, so it is found whatever the
+       options of the other process. */
+    struct _sstm_ctx_shm {
+
+        /* SSTM_SHM_MAGIC once a shared context
+           is set up, 0 for a private one. */
+        sstm_u32_t magic;
+
+        /* sizeof(sstm_ctx_t) of the creator. */
+        sstm_u32_t layout;
+
+        /* the length of the shared mapping. */
+        sstm_u64_t map_size;
+
+        /* the pid of the process in each
+           role, 0 when it is free. */
+        sstm_s32_t pid[2];
+    } shm;
+#endif
+
     struct _sstm_ctx_conf {
 
         /* the actual usable memory size
@@ -72,269 +281,5175 @@ struct _sstm_ctx {
     } cache;
 
     /* ring buffer. */
+#if SSTM_USE_SHM
+    intptr_t ring_offs;
+#else
     sstm_u8_t *ring_buff;
+#endif
+
+#if SSTM_USE_MMAP
+    struct _sstm_ctx_mem {
+
+        /* one of SSTM_MEM_KIND_*. */
+        sstm_u32_t kind;
+
+        /* conf.mem_flags. */
+        sstm_u32_t flags;
+
+        /* the length of the mapping, which is
+           rounded up to the page size. */
+        size_t map_size;
+
+        /* the size of the pages of the mapping. */
+        size_t page_size;
+
+        /* the mapping is accessible below it,
+           owned by the producer. */
+        size_t commit_size;
+
+        /* the number of cleans in a row that left
+           the stream nearly empty, and tail_pos at
+           the last release. */
+        sstm_size_t idle_cleans;
+        sstm_u64_t release_pos;
+    } mem;
+#endif
+
+#if SSTM_USE_DUP
+    struct _sstm_ctx_dup {
+
+        /* the file the ring buffer is mapped from,
+           NULL if it is on the heap. */
+        sstm_dup_file_t *file;
+
+        /* the length of the mapping, which is
+           rounded up to the page size. */
+        size_t map_size;
+
+        /* whether the mapping is shared, i.e. the
+           file holds the data, or private and the
+           file holds the data up to base_pos. */
+        sstm_bool_t shared;
+        sstm_u64_t base_pos;
+    } dup;
+#endif
 
     sstm_size_t head_idx;
     sstm_size_t tail_idx;
 
     /* current seeking offset. */
     sstm_size_t seek_offs;
+
+    /* the absolute positions of head_idx, owned by the
+       consumer, and tail_idx, owned by the producer. */
+    sstm_u64_t head_pos;
+    sstm_u64_t tail_pos;
+
+#if SSTM_USE_RECORD
+    struct _sstm_ctx_rec {
+
+        /* the position and size of every record. */
+        sstm_marks_t marks;
+
+        /* the mark number of the record at the
+           seeking offset, owned by the consumer. */
+        sstm_u64_t seek;
+    } rec;
+#endif
+
+#if SSTM_USE_TIME
+    struct _sstm_ctx_time {
+
+        /* the timestamps of the writes, in
+           CLOCK_MONOTONIC nanoseconds. */
+        sstm_marks_t marks;
+
+        sstm_size_t gap;
+
+        /* no timestamp is taken for writes
+           before it, owned by the producer. */
+        sstm_u64_t next_pos;
+    } time;
+#endif
+
+#if SSTM_USE_HOLE
+    struct _sstm_ctx_hole {
+
+        /* the position and size of every hole,
+           holes never overlap. */
+        sstm_marks_t marks;
+    } hole;
+#endif
+
+#if SSTM_USE_REF
+    struct _sstm_ctx_ref {
+
+        /* the refs in position order, in a ring
+           that works like sstm_marks_t. */
+        sstm_ref_t *ring;
+        sstm_u64_t mask;
+        sstm_u64_t head;
+        sstm_u64_t tail;
+#if SSTM_USE_SPSC
+
+        /* the refs before retired have passed the
+           head of the stream, they are released once
+           the sstm_pread() calls that started before
+           gen was last bumped are over. readers counts
+           the calls of even and odd generations. */
+        sstm_u64_t retired;
+        sstm_u64_t gen;
+        sstm_u64_t readers[2];
+#endif
+    } ref;
+#endif
+
+#if SSTM_USE_FILE
+    struct _sstm_ctx_file {
+
+        /* whether the ring buffer is a mapping of
+           a file, see sstm_open_mmap(). */
+        sstm_bool_t mapped;
+
+        /* whether the mapping is advised as read
+           sequentially or at random. */
+        sstm_bool_t seq;
+
+        /* the length of the mapping, and the size
+           of its pages. */
+        size_t map_size;
+        size_t page_size;
+
+        /* the pages are asked for below ahead_pos and
+           dropped below drop_pos, reads have gone on
+           without a seek since run_pos. */
+        sstm_u64_t ahead_pos;
+        sstm_u64_t drop_pos;
+        sstm_u64_t run_pos;
+    } file;
+#endif
+
+#if SSTM_USE_SOURCE
+    struct _sstm_ctx_src {
+
+        /* NULL for a stream without a source, see
+           sstm_source_new(). */
+        sstm_source_func_t func;
+        void *arg;
+        sstm_u64_t size;
+        sstm_size_t block;
+        sstm_size_t ahead;
+
+        /* the fetching thread only changes the stream
+           with the lock held, and waits on fetch_cond
+           while idle. the consumer waits on data_cond. */
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t fetch_cond;
+        pthread_cond_t data_cond;
+
+        /* bumped by every refill, the fetches started
+           before it are dropped. */
+        sstm_u64_t gen;
+
+        /* the position the consumer needs data from,
+           the fetches go up to src.ahead blocks past
+           it. */
+        sstm_u64_t need_pos;
+
+        sstm_bool_t idle;
+        sstm_bool_t stop;
+
+        /* the result of the failed fetch, SSTM_OK until
+           one fails, reset by a refill. */
+        sstm_res_t err;
+    } src;
+#endif
+
+#if SSTM_USE_STATS
+    struct _sstm_ctx_stat {
+
+        /* owned by the producer. */
+        sstm_size_t used_peak;
+        sstm_u64_t write_bytes;
+        sstm_u64_t write_splits;
+        sstm_u64_t no_space_errs;
+#if SSTM_USE_NT
+        sstm_u64_t nt_writes;
+#endif
+#if SSTM_USE_HOLE
+        sstm_u64_t hole_bytes;
+#endif
+#if SSTM_USE_REF
+        sstm_u64_t ref_bytes;
+#endif
+#if SSTM_USE_SOURCE
+        sstm_u64_t src_fetches;
+#endif
+
+        /* owned by the consumer. */
+        sstm_u64_t read_bytes;
+        sstm_u64_t clean_bytes;
+        sstm_u64_t read_splits;
+        sstm_u64_t no_data_errs;
+        sstm_u64_t seek_backs;
+        sstm_u64_t seek_fwds;
+#if SSTM_USE_NT
+        sstm_u64_t nt_reads;
+#endif
+#if SSTM_USE_SOURCE
+        sstm_u64_t src_refills;
+#endif
+    } stat;
+#endif
+
+#if SSTM_USE_WAIT
+    struct _sstm_ctx_wait {
+
+        /* the fresh size the consumer is
+           waiting for, 0 if not waiting. */
+        sstm_size_t read_want;
+
+        /* the free size the producer is
+           waiting for, 0 if not waiting. */
+        sstm_size_t write_want;
+
+        /* futex words, bumped on every wakeup. */
+        sstm_u32_t read_seq;
+        sstm_u32_t write_seq;
+    } wait;
+#endif
+
+#if SSTM_USE_EVENTFD
+    struct _sstm_ctx_evfd {
+
+        /* readable while fresh size >= read_lowat,
+           -1 if not opened. */
+        int read_fd;
+
+        /* readable while free size >= write_hiwat,
+           -1 if not opened. */
+        int write_fd;
+
+        sstm_size_t read_lowat;
+        sstm_size_t write_hiwat;
+
+        /* the readiness currently signalled on
+           each eventfd. */
+        sstm_u8_t read_ready;
+        sstm_u8_t write_ready;
+
+        /* taken while an eventfd is being toggled. */
+        sstm_u8_t read_lock;
+        sstm_u8_t write_lock;
+    } evfd;
+#endif
+
+#if SSTM_USE_HIST
+
+    /* one histogram per operation, each one
+       owned by the side doing the operation. */
+    sstm_hist_t hist[SSTM_OP_NUM];
+#endif
 };
 
+#if SSTM_USE_WAIT
+
+/* a shared stream is waited on from other processes. */
+#if SSTM_USE_SHM
+#define SSTM_FUTEX_WAKE         FUTEX_WAKE
+#define SSTM_FUTEX_WAIT         FUTEX_WAIT
+#else
+#define SSTM_FUTEX_WAKE         FUTEX_WAKE_PRIVATE
+#define SSTM_FUTEX_WAIT         FUTEX_WAIT_PRIVATE
+#endif
+
 /**
- * @brief create a new seekable stream.
+ * @brief wake the waiter of one side if the available size has
+ *        reached what it is waiting for.
  * 
- * @param ctx the pointer pointing to a context pointer.
- * @param conf configuration pointer.
+ * @param want the size the waiter is waiting for.
+ * @param seq the futex word of the waiter.
+ * @param avail the available size after the operation.
 */
-sstm_res_t sstm_new(sstm_ctx_t **ctx, sstm_conf_t *conf) {
-    sstm_size_t cap_size;
-    sstm_size_t alloc_size;
-    sstm_u8_t *ring_buff;
-    sstm_ctx_t *new_ctx;
+static void sstm_wake(sstm_size_t *want, sstm_u32_t *seq, sstm_size_t avail) {
+    sstm_size_t want_size;
 
-    SSTM_ASSERT(ctx != NULL);
+    /* only the operation that crosses the threshold
+       pays for the wakeup, the others see 0 here or
+       lose the exchange below. */
+    want_size = __atomic_load_n(want, __ATOMIC_SEQ_CST);
+    if (want_size == 0 || avail < want_size) {
+        return;
+    }
+    if (__atomic_exchange_n(want, 0, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
 
-    /* determine the capacity size. */
-    if (conf == NULL) {
-        cap_size = SSTM_CAP_SIZE_DEF;
-    } else {
-        if (conf->cap_size < SSTM_CAP_SIZE_MIN) {
-            cap_size = SSTM_CAP_SIZE_DEF;
-        } else {
-            cap_size = conf->cap_size;
-        }
+    __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, seq, SSTM_FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/**
+ * @brief sleep until the available size reaches the given size.
+ * 
+ * @param avail the available size to watch.
+ * @param want the size the waiter is waiting for.
+ * @param seq the futex word of the waiter.
+ * @param size the size to wait for.
+ * @param timeout timeout in milliseconds, negative for infinite.
+*/
+static sstm_res_t sstm_wait(sstm_size_t *avail, sstm_size_t *want, sstm_u32_t *seq,
+                            sstm_size_t size, sstm_s32_t timeout) {
+    struct timespec deadline;
+    struct timespec now;
+    struct timespec rel;
+    sstm_u32_t seq_val;
+
+    if (__atomic_load_n(avail, __ATOMIC_ACQUIRE) >= size) {
+        return SSTM_OK;
     }
 
-    /* in the ring buffer, the memory size we will use
-       is actually cap_size + 1, so we have to make sure
-       the allocated memory size is enough. */
-    alloc_size = ((cap_size >> 3) + 1) << 3;
-    ring_buff = (sstm_u8_t *)malloc(alloc_size);
-    if (ring_buff == NULL) {
-        return SSTM_ERR_NO_MEM;
+    if (timeout >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
     }
 
-    /* allocate context and initialize it. */
-    new_ctx = (sstm_ctx_t *)malloc(sizeof(sstm_ctx_t));
-    if (ring_buff == NULL) {
-        free(ring_buff);
+    while (1) {
 
-        return SSTM_ERR_NO_MEM;
-    }
-    new_ctx->conf.cap_size = cap_size;
-    new_ctx->cache.alloc_size = alloc_size;
-    new_ctx->cache.used_size = 0;
-    new_ctx->cache.stale_size = 0;
-    new_ctx->cache.fresh_size = 0;
-    new_ctx->cache.free_size = cap_size;
-    new_ctx->ring_buff = ring_buff;
-    new_ctx->head_idx = 0;
-    new_ctx->tail_idx = 0;
-    new_ctx->seek_offs = 0;
+        /* publish the threshold first, then check again,
+           so a concurrent update either sees the threshold
+           or is seen by the check. */
+        seq_val = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+        __atomic_store_n(want, size, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(avail, __ATOMIC_SEQ_CST) >= size) {
+            __atomic_store_n(want, 0, __ATOMIC_SEQ_CST);
 
-    *ctx = new_ctx;
+            return SSTM_OK;
+        }
 
-    return SSTM_OK;
+        if (timeout >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            rel.tv_sec = deadline.tv_sec - now.tv_sec;
+            rel.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (rel.tv_nsec < 0) {
+                rel.tv_sec -= 1;
+                rel.tv_nsec += 1000000000;
+            }
+            if (rel.tv_sec < 0) {
+                __atomic_store_n(want, 0, __ATOMIC_SEQ_CST);
+
+                return SSTM_ERR_TIMEOUT;
+            }
+        }
+
+        syscall(SYS_futex, seq, SSTM_FUTEX_WAIT, seq_val,
+                timeout >= 0 ? &rel : NULL, NULL, 0);
+    }
 }
 
+#endif
+
+#if SSTM_USE_EVENTFD
+
 /**
- * @brief delete a seekable stream.
+ * @brief bring the readiness of an eventfd in line with the
+ *        available size it tracks.
  * 
- * @param ctx context pointer.
+ * @param fd the eventfd.
+ * @param lock the toggle lock of the eventfd.
+ * @param ready the readiness currently signalled.
+ * @param avail the available size to watch.
+ * @param mark the watermark of the available size.
 */
-sstm_res_t sstm_del(sstm_ctx_t *ctx) {
-    SSTM_ASSERT(ctx != NULL);
+static void sstm_evfd_sync(int fd, sstm_u8_t *lock, sstm_u8_t *ready,
+                           sstm_size_t *avail, sstm_size_t mark) {
+    sstm_u8_t new_ready;
+    eventfd_t val;
 
-    free(ctx->ring_buff);
-    free(ctx);
+    /* the eventfd is only touched when the watermark
+       is crossed, otherwise this is two loads. */
+    while ((__atomic_load_n(avail, __ATOMIC_SEQ_CST) >= mark) !=
+           __atomic_load_n(ready, __ATOMIC_SEQ_CST)) {
 
-    return SSTM_OK;
+        /* the other side is toggling, it checks again
+           after releasing the lock. */
+        if (__atomic_exchange_n(lock, 1, __ATOMIC_SEQ_CST) != 0) {
+            return;
+        }
+
+        new_ready = __atomic_load_n(avail, __ATOMIC_SEQ_CST) >= mark;
+        if (new_ready != *ready) {
+            if (new_ready) {
+                eventfd_write(fd, 1);
+            } else {
+                eventfd_read(fd, &val);
+            }
+            __atomic_store_n(ready, new_ready, __ATOMIC_SEQ_CST);
+        }
+
+        __atomic_store_n(lock, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void sstm_evfd_sync_read(sstm_ctx_t *ctx) {
+    if (ctx->evfd.read_fd >= 0) {
+        sstm_evfd_sync(ctx->evfd.read_fd, &ctx->evfd.read_lock, &ctx->evfd.read_ready,
+                       &ctx->cache.fresh_size, ctx->evfd.read_lowat);
+    }
 }
 
+static void sstm_evfd_sync_write(sstm_ctx_t *ctx) {
+    if (ctx->evfd.write_fd >= 0) {
+        sstm_evfd_sync(ctx->evfd.write_fd, &ctx->evfd.write_lock, &ctx->evfd.write_ready,
+                       &ctx->cache.free_size, ctx->evfd.write_hiwat);
+    }
+}
+
+#endif
+
+#if SSTM_USE_HIST
+
 /**
- * @brief get the status of the seekable stream.
- * 
- * @param ctx context pointer.
- * @param stat status pointer.
+ * @brief read the cycle counter.
 */
-sstm_res_t sstm_stat(sstm_ctx_t *ctx, sstm_stat_t *stat) {
-    SSTM_ASSERT(ctx != NULL);
-    SSTM_ASSERT(stat != NULL);
+static sstm_u64_t sstm_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    sstm_u64_t val;
 
-    stat->cap_size = ctx->conf.cap_size;
-    stat->used_size = ctx->cache.used_size;
-    stat->stale_size = ctx->cache.stale_size;
-    stat->fresh_size = ctx->cache.fresh_size;
-    stat->free_size = ctx->cache.free_size;
-    stat->seek_offs = ctx->seek_offs;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(val));
 
-    return SSTM_OK;
+    return val;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (sstm_u64_t)ts.tv_sec * 1000000000 + (sstm_u64_t)ts.tv_nsec;
+#endif
 }
 
 /**
- * @brief clean the stale section of the seekable stream.
- * 
- * @param ctx context pointer.
+ * @brief get the histogram bucket of a value.
 */
-sstm_res_t sstm_clean(sstm_ctx_t *ctx) {
-    sstm_size_t stale_size;
+static sstm_size_t sstm_hist_idx(sstm_u64_t val) {
+    sstm_size_t mag;
+    sstm_size_t idx;
 
-    SSTM_ASSERT(ctx != NULL);
+    if (val < (1u << SSTM_HIST_SUB_BITS)) {
+        return (sstm_size_t)val;
+    }
 
-    stale_size = ctx->cache.stale_size;
-    if (stale_size == 0) {
-        return SSTM_OK;
+    /* the magnitude picks the power of two, the bits
+       right below the top bit pick the linear bucket. */
+    mag = 63 - (sstm_size_t)__builtin_clzll(val);
+    idx = ((mag - SSTM_HIST_SUB_BITS + 1) << SSTM_HIST_SUB_BITS) +
+          (sstm_size_t)((val >> (mag - SSTM_HIST_SUB_BITS)) & ((1u << SSTM_HIST_SUB_BITS) - 1));
+    if (idx >= SSTM_HIST_BUCKETS) {
+        idx = SSTM_HIST_BUCKETS - 1;
     }
 
-    ctx->head_idx = (ctx->head_idx + stale_size) % (ctx->conf.cap_size + 1);
+    return idx;
+}
 
-    /* update cache. */
-    ctx->cache.used_size -= stale_size;
-    ctx->cache.stale_size = 0;
-    ctx->cache.free_size += stale_size;
-    ctx->seek_offs = 0;
+/**
+ * @brief get the lowest value of a histogram bucket.
+*/
+static sstm_u64_t sstm_hist_low(sstm_size_t idx) {
+    sstm_size_t mag;
+    sstm_u64_t sub;
 
-    return SSTM_OK;
+    if (idx < (1u << SSTM_HIST_SUB_BITS)) {
+        return idx;
+    }
+
+    mag = (idx >> SSTM_HIST_SUB_BITS) + SSTM_HIST_SUB_BITS - 1;
+    sub = idx & ((1u << SSTM_HIST_SUB_BITS) - 1);
+
+    return (((sstm_u64_t)1 << SSTM_HIST_SUB_BITS) + sub) << (mag - SSTM_HIST_SUB_BITS);
 }
 
 /**
- * @brief read data from the stream.
+ * @brief record the cycles elapsed since the beginning of an operation.
  * 
- * @param ctx context pointer.
- * @param data data pointer, when NULL, no data will be copied.
- * @param size data size.
- * @param cleanup whether to clean the stale section after read.
+ * @param hist the histogram of the operation.
+ * @param begin the cycle counter at the beginning of the operation.
 */
-sstm_res_t sstm_read(sstm_ctx_t *ctx, void *data, sstm_size_t size, sstm_bool_t cleanup) {
-    sstm_u8_t *first_copy_ptr;
-    sstm_size_t new_head_idx;
+static void sstm_hist_add(sstm_hist_t *hist, sstm_u64_t begin) {
+    sstm_u64_t val = sstm_cycles() - begin;
 
-    SSTM_ASSERT(ctx != NULL);
-
-    if (size == 0) {
-        return SSTM_OK;
+    hist->buckets[sstm_hist_idx(val)] += 1;
+    hist->count += 1;
+    hist->sum += val;
+    if (val < hist->min) {
+        hist->min = val;
     }
-
-    if (ctx->cache.fresh_size < size) {
-        return SSTM_ERR_NO_DATA;
+    if (val > hist->max) {
+        hist->max = val;
     }
+}
 
-    /* copy data. */
-    new_head_idx = (ctx->head_idx + ctx->seek_offs) % (ctx->conf.cap_size + 1);
-    first_copy_ptr = ctx->ring_buff + new_head_idx;
-    if (data != NULL) {
-        if (ctx->conf.cap_size + 1 - new_head_idx >= size) {
-            memcpy(data, first_copy_ptr, size);
-        } else {
-            sstm_size_t first_copy_size = ctx->conf.cap_size + 1 - new_head_idx;
-            sstm_size_t second_copy_size = size - first_copy_size;
+static void sstm_hist_init(sstm_hist_t *hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
 
-            memcpy(data, first_copy_ptr, first_copy_size);
-            memcpy((sstm_u8_t *)data + first_copy_size, ctx->ring_buff, second_copy_size);
-        }
-    }
-    ctx->seek_offs += size;
+#endif
 
-    /* update cache. */
-    ctx->cache.stale_size += size;
-    ctx->cache.fresh_size -= size;
+#if SSTM_USE_MMAP
 
-    if (cleanup) {
-        sstm_clean(ctx);
-    }
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT          26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB            (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB            (30 << MAP_HUGE_SHIFT)
+#endif
 
-    return SSTM_OK;
-}
+#define SSTM_HUGE_2M            ((size_t)1 << 21)
+#define SSTM_HUGE_1G            ((size_t)1 << 30)
+
+/* from linux/mempolicy.h, mbind() is called
+   directly so that libnuma is not needed. */
+#define SSTM_MPOL_BIND          2
+#define SSTM_MPOL_MF_STRICT     (1 << 0)
+#define SSTM_NUMA_NODE_MAX      1024
+
+/* the granularity of lazy commits. */
+#define SSTM_COMMIT_CHUNK       SSTM_HUGE_2M
 
 /**
- * @brief write data to the seekable stream.
+ * @brief map anonymous memory aligned to its page size.
  * 
- * @param ctx seekable stream context.
- * @param data data pointer, when NULL, 0x00 will be written.
- * @param size data size.
+ * @param size the length, a multiple of align.
+ * @param align the alignment, a power of 2.
+ * @param prot the protection of the mapping.
+ * @param flags extra mmap() flags.
+ * @return the mapping, MAP_FAILED on failure.
 */
-sstm_res_t sstm_write(sstm_ctx_t *ctx, const void *data, sstm_size_t size) {
-    sstm_u8_t *first_copy_ptr;
-
-    SSTM_ASSERT(ctx != NULL);
+static void *sstm_mmap(size_t size, size_t align, int prot, int flags) {
+    sstm_u8_t *raw;
+    sstm_u8_t *ptr;
+    size_t page_size;
 
-    if (size == 0) {
-        return SSTM_OK;
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+    if (align <= page_size || (flags & MAP_HUGETLB)) {
+        return mmap(NULL, size, prot, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
     }
 
-    if (ctx->cache.free_size < size) {
-        return SSTM_ERR_NO_SPACE;
+    /* over-map and trim, transparent huge pages are only
+       used for the aligned parts of a mapping. */
+    raw = (sstm_u8_t *)mmap(NULL, size + align, prot,
+                            MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if (raw == MAP_FAILED) {
+        return MAP_FAILED;
     }
+    ptr = (sstm_u8_t *)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+    if (ptr != raw) {
+        munmap(raw, (size_t)(ptr - raw));
+    }
+    munmap(ptr + size, (size_t)(raw + align - ptr));
 
-    /* copy data. */
-    first_copy_ptr = ctx->ring_buff + ctx->tail_idx;
-    if (ctx->conf.cap_size + 1 - ctx->tail_idx >= size) {
-        if (data != NULL) {
-            memcpy(first_copy_ptr, data, size);
-        } else {
-            memset(first_copy_ptr, 0, size);
-        }
-        ctx->tail_idx = (ctx->tail_idx + size) % (ctx->conf.cap_size + 1);
-    } else {
-        sstm_size_t first_copy_size = ctx->conf.cap_size + 1 - ctx->tail_idx;
-        sstm_size_t second_copy_size = size - first_copy_size;
+    return ptr;
+}
 
-        if (data != NULL) {
-            memcpy(first_copy_ptr, data, first_copy_size);
-            memcpy(ctx->ring_buff, (sstm_u8_t *)data + first_copy_size, second_copy_size);
-        } else {
-            memset(first_copy_ptr, 0, first_copy_size);
-            memset(ctx->ring_buff, 0, second_copy_size);
+/**
+ * @brief fault in and lock a part of the mapping, as set by
+ *        SSTM_MEM_PREFAULT and SSTM_MEM_LOCK.
+ * 
+ * @param ctx context pointer.
+ * @param offs the offset of the part, page aligned.
+ * @param size the size of the part, page aligned.
+*/
+static sstm_res_t sstm_ring_fault(sstm_ctx_t *ctx, size_t offs, size_t size) {
+    size_t i;
+
+    if (ctx->mem.flags & SSTM_MEM_PREFAULT) {
+        for (i = 0; i < size; i += ctx->mem.page_size) {
+            ((volatile sstm_u8_t *)SSTM_RING(ctx))[offs + i] = 0;
         }
-        ctx->tail_idx = second_copy_size;
     }
 
-    /* update cache. */
-    ctx->cache.used_size += size;
-    ctx->cache.fresh_size += size;
-    ctx->cache.free_size -= size;
+    if (ctx->mem.flags & SSTM_MEM_LOCK) {
+        if (mlock(SSTM_RING(ctx) + offs, size) != 0) {
+            return SSTM_ERR;
+        }
+    }
 
     return SSTM_OK;
 }
 
 /**
- * @brief seek the seekable stream.
+ * @brief allocate the ring buffer as set by conf.mem_flags.
  * 
- * @param ctx seekable stream context.
- * @param offset offset.
- * @param whence whence.
+ * hugetlb pages are tried from the largest requested size down,
+ * then normal pages with transparent huge pages. the NUMA binding
+ * is set before any page is faulted in, so every page lands on the
+ * node.
+ * 
+ * @param ctx context pointer.
+ * @param alloc_size the minimum size.
+ * @param conf configuration pointer, can be NULL.
+*/
+static sstm_res_t sstm_ring_alloc(sstm_ctx_t *ctx, sstm_size_t alloc_size, sstm_conf_t *conf) {
+    sstm_u32_t flags = conf == NULL ? 0 : conf->mem_flags;
+    size_t page_size;
+    size_t map_size;
+    sstm_u8_t *ptr;
+    int prot;
+    int lazy;
+
+    ctx->mem.flags = flags;
+    ctx->mem.idle_cleans = 0;
+    ctx->mem.release_pos = 0;
+    if (flags == 0) {
+        SSTM_RING_SET(ctx, (sstm_u8_t *)malloc(alloc_size));
+        ctx->mem.kind = SSTM_MEM_KIND_HEAP;
+        ctx->mem.map_size = 0;
+        ctx->mem.commit_size = alloc_size;
+
+        return SSTM_RING(ctx) == NULL ? SSTM_ERR_NO_MEM : SSTM_OK;
+    }
+
+    /* a lazy mapping is not charged against the
+       commit limit until it is made accessible. */
+    prot = flags & SSTM_MEM_LAZY ? PROT_NONE : PROT_READ | PROT_WRITE;
+    lazy = flags & SSTM_MEM_LAZY ? MAP_NORESERVE : 0;
+
+    ptr = (sstm_u8_t *)MAP_FAILED;
+    map_size = 0;
+    page_size = 0;
+    if (flags & SSTM_MEM_HUGE_1G) {
+        map_size = ((size_t)alloc_size + SSTM_HUGE_1G - 1) & ~(SSTM_HUGE_1G - 1);
+        ptr = (sstm_u8_t *)sstm_mmap(map_size, SSTM_HUGE_1G, prot, MAP_HUGETLB | MAP_HUGE_1GB | lazy);
+        page_size = SSTM_HUGE_1G;
+        ctx->mem.kind = SSTM_MEM_KIND_HUGE_1G;
+    }
+    if (ptr == MAP_FAILED && (flags & (SSTM_MEM_HUGE_1G | SSTM_MEM_HUGE_2M))) {
+        map_size = ((size_t)alloc_size + SSTM_HUGE_2M - 1) & ~(SSTM_HUGE_2M - 1);
+        ptr = (sstm_u8_t *)sstm_mmap(map_size, SSTM_HUGE_2M, prot, MAP_HUGETLB | MAP_HUGE_2MB | lazy);
+        page_size = SSTM_HUGE_2M;
+        ctx->mem.kind = SSTM_MEM_KIND_HUGE_2M;
+    }
+    if (ptr == MAP_FAILED) {
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+        if ((flags & (SSTM_MEM_HUGE_1G | SSTM_MEM_HUGE_2M | SSTM_MEM_THP)) &&
+            alloc_size >= SSTM_HUGE_2M) {
+            map_size = ((size_t)alloc_size + SSTM_HUGE_2M - 1) & ~(SSTM_HUGE_2M - 1);
+            ptr = (sstm_u8_t *)sstm_mmap(map_size, SSTM_HUGE_2M, prot, lazy);
+            if (ptr != MAP_FAILED) {
+                madvise(ptr, map_size, MADV_HUGEPAGE);
+            }
+        } else {
+            map_size = ((size_t)alloc_size + page_size - 1) & ~(page_size - 1);
+            ptr = (sstm_u8_t *)sstm_mmap(map_size, page_size, prot, lazy);
+        }
+        ctx->mem.kind = SSTM_MEM_KIND_PAGE;
+    }
+    if (ptr == MAP_FAILED) {
+        return SSTM_ERR_NO_MEM;
+    }
+    SSTM_RING_SET(ctx, ptr);
+    ctx->mem.map_size = map_size;
+    ctx->mem.page_size = page_size;
+    ctx->mem.commit_size = flags & SSTM_MEM_LAZY ? 0 : map_size;
+
+    if (flags & SSTM_MEM_NUMA) {
+        unsigned long node_mask[SSTM_NUMA_NODE_MAX / (8 * sizeof(unsigned long))];
+
+        if (conf->numa_node < 0 || conf->numa_node >= SSTM_NUMA_NODE_MAX) {
+            munmap(ptr, map_size);
+
+            return SSTM_ERR;
+        }
+        memset(node_mask, 0, sizeof(node_mask));
+        node_mask[conf->numa_node / (8 * sizeof(unsigned long))] |=
+            1ul << (conf->numa_node % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_mbind, ptr, map_size, SSTM_MPOL_BIND, node_mask,
+                    SSTM_NUMA_NODE_MAX + 1, SSTM_MPOL_MF_STRICT) != 0) {
+            munmap(ptr, map_size);
+
+            return SSTM_ERR;
+        }
+    }
+
+    if (ctx->mem.commit_size != 0 && sstm_ring_fault(ctx, 0, map_size) != SSTM_OK) {
+        munmap(ptr, map_size);
+
+        return SSTM_ERR;
+    }
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief make sure the ring buffer is committed where the next write
+ *        of a size goes.
+ * 
+ * the tail reaches the ring from its start upwards, so the committed
+ * part only ever grows from the start. the holes and refs it passes
+ * on the way are only committed along with a write beyond them.
+ * 
+ * @param ctx context pointer.
+ * @param size the write size.
+*/
+static sstm_res_t sstm_ring_commit(sstm_ctx_t *ctx, sstm_size_t size) {
+    size_t end;
+    size_t chunk;
+    size_t commit_size;
+
+    /* a wrapping write continues at the start, which
+       is already committed. */
+    end = (size_t)ctx->tail_idx + size;
+    if (end > (size_t)ctx->conf.cap_size + 1) {
+        end = (size_t)ctx->conf.cap_size + 1;
+    }
+    if (end <= ctx->mem.commit_size) {
+        return SSTM_OK;
+    }
+
+    chunk = ctx->mem.page_size > SSTM_COMMIT_CHUNK ? ctx->mem.page_size : SSTM_COMMIT_CHUNK;
+    commit_size = (end + chunk - 1) & ~(chunk - 1);
+    if (commit_size > ctx->mem.map_size) {
+        commit_size = ctx->mem.map_size;
+    }
+    if (mprotect(SSTM_RING(ctx) + ctx->mem.commit_size, commit_size - ctx->mem.commit_size,
+                 PROT_READ | PROT_WRITE) != 0) {
+        return SSTM_ERR_NO_MEM;
+    }
+    if (sstm_ring_fault(ctx, ctx->mem.commit_size, commit_size - ctx->mem.commit_size) != SSTM_OK) {
+        return SSTM_ERR_NO_MEM;
+    }
+    ctx->mem.commit_size = commit_size;
+
+    return SSTM_OK;
+}
+
+#if !SSTM_USE_SPSC
+
+/**
+ * @brief give a part of the ring buffer back to the system.
+*/
+static void sstm_ring_drop(sstm_ctx_t *ctx, size_t begin, size_t end) {
+    size_t mask = ctx->mem.page_size - 1;
+
+    if (end > ctx->mem.commit_size) {
+        end = ctx->mem.commit_size;
+    }
+
+    /* only the pages entirely inside the part. */
+    begin = (begin + mask) & ~mask;
+    end &= ~mask;
+    if (begin < end) {
+        madvise(SSTM_RING(ctx) + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+/**
+ * @brief release the free pages of a stream that has been nearly
+ *        empty for a while, called after every clean.
+ * 
+ * the producer may write into the free section at any time, so this
+ * is only done when both sides are the same thread.
+*/
+static void sstm_ring_idle(sstm_ctx_t *ctx) {
+    if (ctx->cache.used_size > ctx->conf.cap_size >> SSTM_MEM_IDLE_SHIFT) {
+        ctx->mem.idle_cleans = 0;
+
+        return;
+    }
+    if (++ctx->mem.idle_cleans < SSTM_MEM_IDLE_CLEANS) {
+        return;
+    }
+    ctx->mem.idle_cleans = 0;
+
+    /* nothing has been written since the last release. */
+    if (ctx->tail_pos - ctx->mem.release_pos < ctx->mem.page_size) {
+        return;
+    }
+    ctx->mem.release_pos = ctx->tail_pos;
+
+    /* the free section runs from the tail to the head. */
+    if (ctx->tail_idx < ctx->head_idx) {
+        sstm_ring_drop(ctx, ctx->tail_idx, ctx->head_idx);
+    } else {
+        sstm_ring_drop(ctx, ctx->tail_idx, ctx->conf.cap_size + 1);
+        sstm_ring_drop(ctx, 0, ctx->head_idx);
+    }
+}
+
+#endif
+
+/**
+ * @brief free the ring buffer allocated by sstm_ring_alloc().
+*/
+static void sstm_ring_free(sstm_ctx_t *ctx) {
+    if (ctx->mem.kind == SSTM_MEM_KIND_HEAP) {
+        free(SSTM_RING(ctx));
+    } else {
+        munmap(SSTM_RING(ctx), ctx->mem.map_size);
+    }
+}
+
+#elif SSTM_USE_DUP
+
+/**
+ * @brief create an empty ring buffer file.
+ * 
+ * @param size file size.
+ * @return the file with one reference, NULL on failure.
+*/
+static sstm_dup_file_t *sstm_dup_file_new(size_t size) {
+    sstm_dup_file_t *file;
+    int fd;
+
+    fd = (int)syscall(SYS_memfd_create, "sstm", MFD_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+
+        return NULL;
+    }
+
+    file = (sstm_dup_file_t *)malloc(sizeof(sstm_dup_file_t));
+    if (file == NULL) {
+        close(fd);
+
+        return NULL;
+    }
+    file->fd = fd;
+    file->refs = 1;
+
+    return file;
+}
+
+/**
+ * @brief drop a reference to a ring buffer file.
+*/
+static void sstm_dup_file_put(sstm_dup_file_t *file) {
+
+    /* the clones of a stream can be deleted from
+       different threads. */
+    if (__atomic_sub_fetch(&file->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        close(file->fd);
+        free(file);
+    }
+}
+
+/**
+ * @brief allocate the ring buffer, in a shared mapping of a memfd so
+ *        that sstm_dup() can map it again copy-on-write.
+*/
+static sstm_res_t sstm_ring_alloc(sstm_ctx_t *ctx, sstm_size_t alloc_size, sstm_conf_t *conf) {
+    sstm_dup_file_t *file;
+    size_t page_size;
+    size_t map_size;
+    sstm_u8_t *ring;
+
+    (void)conf;
+
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+    map_size = ((size_t)alloc_size + page_size - 1) & ~(page_size - 1);
+
+    ctx->dup.shared = 0;
+    ctx->dup.base_pos = 0;
+
+    file = sstm_dup_file_new(map_size);
+    if (file != NULL) {
+        ring = (sstm_u8_t *)mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, file->fd, 0);
+        if (ring != (sstm_u8_t *)MAP_FAILED) {
+            SSTM_RING_SET(ctx, ring);
+            ctx->dup.file = file;
+            ctx->dup.map_size = map_size;
+            ctx->dup.shared = 1;
+
+            return SSTM_OK;
+        }
+        sstm_dup_file_put(file);
+    }
+
+    /* without memfd sstm_dup() copies the ring buffer. */
+    ring = (sstm_u8_t *)malloc(alloc_size);
+    if (ring == NULL) {
+        return SSTM_ERR_NO_MEM;
+    }
+    SSTM_RING_SET(ctx, ring);
+    ctx->dup.file = NULL;
+    ctx->dup.map_size = 0;
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief free the ring buffer allocated by sstm_ring_alloc().
+*/
+static void sstm_ring_free(sstm_ctx_t *ctx) {
+    if (ctx->dup.file == NULL) {
+        free(SSTM_RING(ctx));
+    } else {
+        munmap(SSTM_RING(ctx), ctx->dup.map_size);
+        sstm_dup_file_put(ctx->dup.file);
+    }
+}
+
+#else
+
+static sstm_res_t sstm_ring_alloc(sstm_ctx_t *ctx, sstm_size_t alloc_size, sstm_conf_t *conf) {
+    sstm_u8_t *ring;
+
+    (void)conf;
+
+    ring = (sstm_u8_t *)malloc(alloc_size);
+    if (ring == NULL) {
+        return SSTM_ERR_NO_MEM;
+    }
+    SSTM_RING_SET(ctx, ring);
+
+    return SSTM_OK;
+}
+
+static void sstm_ring_free(sstm_ctx_t *ctx) {
+    free(SSTM_RING(ctx));
+}
+
+#endif
+
+#if SSTM_USE_RECORD || SSTM_USE_TIME || SSTM_USE_HOLE
+
+/**
+ * @brief allocate a ring of marks.
+ * 
+ * @param marks marks pointer.
+ * @param num the minimum number of marks, rounded up to a power of 2.
+*/
+static sstm_res_t sstm_marks_init(sstm_marks_t *marks, sstm_size_t num) {
+    sstm_u64_t size;
+
+    size = 1;
+    while (size < num) {
+        size <<= 1;
+    }
+
+    marks->ring = (sstm_mark_t *)calloc((size_t)size, sizeof(sstm_mark_t));
+    if (marks->ring == NULL) {
+        return SSTM_ERR_NO_MEM;
+    }
+    marks->mask = size - 1;
+    marks->head = 0;
+    marks->tail = 0;
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief check whether the producer can push a mark.
+*/
+static sstm_bool_t sstm_marks_full(sstm_marks_t *marks) {
+    return marks->tail - SSTM_LOAD(marks->head) > marks->mask;
+}
+
+/**
+ * @brief push a mark, the caller checks sstm_marks_full() first.
+ * 
+ * it is published after the data it marks has been committed, so
+ * a visible mark always refers to fresh or stale data.
+*/
+static void sstm_marks_push(sstm_marks_t *marks, sstm_u64_t pos, sstm_u64_t val) {
+    sstm_mark_t *mark = &marks->ring[marks->tail & marks->mask];
+
+    mark->pos = pos;
+    mark->val = val;
+    SSTM_STORE(marks->tail, marks->tail + 1);
+}
+
+#if SSTM_USE_RECORD || SSTM_USE_TIME
+
+/**
+ * @brief drop the marks before a position, which hand their slots
+ *        back to the producer.
+ * 
+ * @param marks marks pointer.
+ * @param pos the new head position of the stream.
+*/
+static void sstm_marks_trim(sstm_marks_t *marks, sstm_u64_t pos) {
+    sstm_u64_t head = marks->head;
+    sstm_u64_t tail = SSTM_LOAD(marks->tail);
+
+    while (head != tail && marks->ring[head & marks->mask].pos < pos) {
+        head++;
+    }
+    SSTM_STORE(marks->head, head);
+}
+
+#endif
+
+#if SSTM_USE_HOLE
+
+/**
+ * @brief drop the holes that end before a position, the counterpart
+ *        of sstm_marks_trim() for marks that span data.
+ * 
+ * @param marks marks pointer.
+ * @param pos the new head position of the stream.
+*/
+static void sstm_hole_trim(sstm_marks_t *marks, sstm_u64_t pos) {
+    sstm_u64_t head = marks->head;
+    sstm_u64_t tail = SSTM_LOAD(marks->tail);
+    sstm_mark_t *mark;
+
+    while (head != tail) {
+        mark = &marks->ring[head & marks->mask];
+        if (mark->pos + mark->val > pos) {
+            break;
+        }
+        head++;
+    }
+    SSTM_STORE(marks->head, head);
+}
+
+/**
+ * @brief find the next hole that overlaps a range of the stream.
+ * 
+ * @param marks marks pointer.
+ * @param n the mark number to search from, moved past the hole found.
+ * @param tail the mark number to search to.
+ * @param pos the position of the range.
+ * @param end the end position of the range.
+ * @param hole_pos the position of the part of the hole in the range.
+ * @param hole_end the end position of that part.
+ * @return whether a hole was found.
+*/
+static sstm_bool_t sstm_hole_next(const sstm_marks_t *marks, sstm_u64_t *n, sstm_u64_t tail,
+                                  sstm_u64_t pos, sstm_u64_t end,
+                                  sstm_u64_t *hole_pos, sstm_u64_t *hole_end) {
+    const sstm_mark_t *mark;
+
+    for (; *n != tail; (*n)++) {
+        mark = &marks->ring[*n & marks->mask];
+        if (mark->pos >= end) {
+            return 0;
+        }
+        if (mark->pos + mark->val > pos) {
+            *hole_pos = mark->pos > pos ? mark->pos : pos;
+            *hole_end = mark->pos + mark->val < end ? mark->pos + mark->val : end;
+            (*n)++;
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+#endif
+
+#if SSTM_USE_DUP
+
+/**
+ * @brief copy a ring of marks.
+*/
+static sstm_res_t sstm_marks_dup(sstm_marks_t *dst, const sstm_marks_t *src) {
+    dst->ring = (sstm_mark_t *)malloc((size_t)(src->mask + 1) * sizeof(sstm_mark_t));
+    if (dst->ring == NULL) {
+        return SSTM_ERR_NO_MEM;
+    }
+    memcpy(dst->ring, src->ring, (size_t)(src->mask + 1) * sizeof(sstm_mark_t));
+    dst->mask = src->mask;
+    dst->head = src->head;
+    dst->tail = src->tail;
+
+    return SSTM_OK;
+}
+
+#endif
+
+#endif
+
+#if SSTM_USE_REF
+
+/**
+ * @brief allocate the ring of refs.
+ * 
+ * @param ctx context pointer.
+ * @param num the minimum number of refs, rounded up to a power of 2.
+*/
+static sstm_res_t sstm_ref_init(sstm_ctx_t *ctx, sstm_size_t num) {
+    sstm_u64_t size;
+
+    size = 1;
+    while (size < num) {
+        size <<= 1;
+    }
+
+    ctx->ref.ring = (sstm_ref_t *)calloc((size_t)size, sizeof(sstm_ref_t));
+    if (ctx->ref.ring == NULL) {
+        return SSTM_ERR_NO_MEM;
+    }
+    ctx->ref.mask = size - 1;
+    ctx->ref.head = 0;
+    ctx->ref.tail = 0;
+#if SSTM_USE_SPSC
+    ctx->ref.retired = 0;
+    ctx->ref.gen = 0;
+    ctx->ref.readers[0] = 0;
+    ctx->ref.readers[1] = 0;
+#endif
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief release the refs before an index and hand their slots
+ *        back to the producer.
+ * 
+ * @param ctx context pointer.
+ * @param end the index of the first ref to keep.
+*/
+static void sstm_ref_release(sstm_ctx_t *ctx, sstm_u64_t end) {
+    sstm_u64_t head;
+    sstm_ref_t *ref;
+
+    for (head = ctx->ref.head; head != end; head++) {
+        ref = &ctx->ref.ring[head & ctx->ref.mask];
+        if (ref->release != NULL) {
+            ref->release(ref->arg, ref->data, ref->size);
+        }
+    }
+
+    /* the slots are only handed back after the release. */
+    SSTM_STORE(ctx->ref.head, end);
+}
+
+/**
+ * @brief release the refs that end before a position.
+ * 
+ * in SPSC mode an sstm_pread() that loaded the old head of the
+ * stream can still be copying from them. they are retired and
+ * gen is bumped instead, and they are released by this or a later
+ * clean once no call of the generation before is left, which new
+ * calls never join.
+ * 
+ * @param ctx context pointer.
+ * @param pos the new head position of the stream.
+*/
+static void sstm_ref_trim(sstm_ctx_t *ctx, sstm_u64_t pos) {
+    sstm_u64_t end = ctx->ref.head;
+    sstm_u64_t tail = SSTM_LOAD(ctx->ref.tail);
+    sstm_ref_t *ref;
+
+#if SSTM_USE_SPSC
+    if (ctx->ref.retired != ctx->ref.head) {
+        if (SSTM_LOAD(ctx->ref.readers[(ctx->ref.gen - 1) & 1]) != 0) {
+            return;
+        }
+        sstm_ref_release(ctx, ctx->ref.retired);
+    }
+    end = ctx->ref.head;
+#endif
+
+    while (end != tail) {
+        ref = &ctx->ref.ring[end & ctx->ref.mask];
+        if (ref->pos + ref->size > pos) {
+            break;
+        }
+        end++;
+    }
+    if (end == ctx->ref.head) {
+        return;
+    }
+
+#if SSTM_USE_SPSC
+
+    /* pairs with the fence in sstm_ref_enter(). */
+    ctx->ref.retired = end;
+    SSTM_STORE(ctx->ref.gen, ctx->ref.gen + 1);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (SSTM_LOAD(ctx->ref.readers[(ctx->ref.gen - 1) & 1]) != 0) {
+        return;
+    }
+#endif
+    sstm_ref_release(ctx, end);
+}
+
+#if SSTM_USE_SPSC
+
+/**
+ * @brief count an sstm_pread() in the current generation, so that
+ *        the refs it can see are not released under it.
+ * 
+ * @param ctx context pointer.
+ * @return the generation, to pass to sstm_ref_exit().
+*/
+static sstm_u64_t sstm_ref_enter(sstm_ctx_t *ctx) {
+    sstm_u64_t gen;
+
+    for (;;) {
+        gen = SSTM_LOAD(ctx->ref.gen);
+        SSTM_ADD(ctx->ref.readers[gen & 1], 1);
+
+        /* either the clean that bumps gen sees the count,
+           or the call sees the bump, and the head stored
+           before it, and counts itself again. */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (SSTM_LOAD(ctx->ref.gen) == gen) {
+            return gen;
+        }
+        SSTM_SUB(ctx->ref.readers[gen & 1], 1);
+    }
+}
+
+/**
+ * @brief end an sstm_pread() counted by sstm_ref_enter().
+*/
+static inline void sstm_ref_exit(sstm_ctx_t *ctx, sstm_u64_t gen) {
+    SSTM_SUB(ctx->ref.readers[gen & 1], 1);
+}
+
+#endif
+
+#endif
+
+/**
+ * @brief get the capacity size of a configuration.
+*/
+static sstm_size_t sstm_conf_cap_size(const sstm_conf_t *conf) {
+    if (conf == NULL || conf->cap_size < SSTM_CAP_SIZE_MIN) {
+        return SSTM_CAP_SIZE_DEF;
+    }
+
+    return conf->cap_size;
+}
+
+/**
+ * @brief get the ring buffer size for a capacity size.
+*/
+static sstm_size_t sstm_alloc_size(sstm_size_t cap_size) {
+
+    /* in the ring buffer, the memory size we will use
+       is actually cap_size + 1, so we have to make sure
+       the allocated memory size is enough. */
+    return ((cap_size >> 3) + 1) << 3;
+}
+
+/**
+ * @brief initialize the fields of a context that do not depend on
+ *        how it is allocated.
+*/
+static void sstm_ctx_init(sstm_ctx_t *ctx, sstm_size_t cap_size, sstm_size_t alloc_size) {
+#if SSTM_USE_SHM
+    ctx->shm.magic = 0;
+    ctx->shm.layout = 0;
+    ctx->shm.map_size = 0;
+    ctx->shm.pid[SSTM_SHM_PRODUCER] = 0;
+    ctx->shm.pid[SSTM_SHM_CONSUMER] = 0;
+#endif
+    ctx->conf.cap_size = cap_size;
+    ctx->cache.alloc_size = alloc_size;
+    ctx->cache.used_size = 0;
+    ctx->cache.stale_size = 0;
+    ctx->cache.fresh_size = 0;
+    ctx->cache.free_size = cap_size;
+    ctx->head_idx = 0;
+    ctx->tail_idx = 0;
+    ctx->seek_offs = 0;
+    ctx->head_pos = 0;
+    ctx->tail_pos = 0;
+#if SSTM_USE_STATS
+    memset(&ctx->stat, 0, sizeof(ctx->stat));
+#endif
+#if SSTM_USE_WAIT
+    ctx->wait.read_want = 0;
+    ctx->wait.write_want = 0;
+    ctx->wait.read_seq = 0;
+    ctx->wait.write_seq = 0;
+#endif
+#if SSTM_USE_EVENTFD
+    ctx->evfd.read_fd = -1;
+    ctx->evfd.write_fd = -1;
+    ctx->evfd.read_lowat = 1;
+    ctx->evfd.write_hiwat = 1;
+    ctx->evfd.read_ready = 0;
+    ctx->evfd.write_ready = 0;
+    ctx->evfd.read_lock = 0;
+    ctx->evfd.write_lock = 0;
+#endif
+#if SSTM_USE_HIST
+    sstm_hist_clear(ctx);
+#endif
+#if SSTM_USE_FILE
+    ctx->file.mapped = 0;
+#endif
+#if SSTM_USE_SOURCE
+    ctx->src.func = NULL;
+    ctx->src.size = 0;
+#endif
+}
+
+/**
+ * @brief allocate the marks and refs of a context as set by conf,
+ *        nothing is left allocated on failure.
+ * 
+ * @param ctx context pointer.
+ * @param cap_size the capacity size the defaults are taken from.
+ * @param conf configuration pointer, can be NULL.
+*/
+static sstm_res_t sstm_ctx_index(sstm_ctx_t *ctx, sstm_size_t cap_size, sstm_conf_t *conf) {
+#if SSTM_USE_RECORD
+    sstm_size_t rec_num;
+#endif
+#if SSTM_USE_TIME
+    sstm_size_t time_num;
+#endif
+#if SSTM_USE_HOLE
+    sstm_size_t hole_num;
+#endif
+#if SSTM_USE_REF
+    sstm_size_t ref_num;
+#endif
+
+    (void)ctx;
+    (void)cap_size;
+    (void)conf;
+
+#if SSTM_USE_RECORD
+    rec_num = conf == NULL || conf->rec_num == 0 ? cap_size / 64 : conf->rec_num;
+    if (sstm_marks_init(&ctx->rec.marks, rec_num) != SSTM_OK) {
+        return SSTM_ERR_NO_MEM;
+    }
+    ctx->rec.seek = 0;
+#endif
+#if SSTM_USE_TIME
+    time_num = conf == NULL || conf->time_num == 0 ? cap_size / 64 : conf->time_num;
+    if (sstm_marks_init(&ctx->time.marks, time_num) != SSTM_OK) {
+#if SSTM_USE_RECORD
+        free(ctx->rec.marks.ring);
+#endif
+
+        return SSTM_ERR_NO_MEM;
+    }
+    ctx->time.gap = conf == NULL ? 0 : conf->time_gap;
+    ctx->time.next_pos = 0;
+#endif
+#if SSTM_USE_HOLE
+    hole_num = conf == NULL || conf->hole_num == 0 ? cap_size / SSTM_HOLE_MIN_SIZE : conf->hole_num;
+    if (sstm_marks_init(&ctx->hole.marks, hole_num) != SSTM_OK) {
+#if SSTM_USE_RECORD
+        free(ctx->rec.marks.ring);
+#endif
+#if SSTM_USE_TIME
+        free(ctx->time.marks.ring);
+#endif
+
+        return SSTM_ERR_NO_MEM;
+    }
+#endif
+#if SSTM_USE_REF
+    ref_num = conf == NULL || conf->ref_num == 0 ? SSTM_REF_NUM_DEF : conf->ref_num;
+    if (sstm_ref_init(ctx, ref_num) != SSTM_OK) {
+#if SSTM_USE_RECORD
+        free(ctx->rec.marks.ring);
+#endif
+#if SSTM_USE_TIME
+        free(ctx->time.marks.ring);
+#endif
+#if SSTM_USE_HOLE
+        free(ctx->hole.marks.ring);
+#endif
+
+        return SSTM_ERR_NO_MEM;
+    }
+#endif
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief the body of sstm_new(), without instrumentation.
+*/
+static sstm_res_t sstm_do_new(sstm_ctx_t **ctx, sstm_conf_t *conf) {
+    sstm_size_t cap_size;
+    sstm_size_t alloc_size;
+    sstm_ctx_t *new_ctx;
+    sstm_res_t res;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    cap_size = sstm_conf_cap_size(conf);
+
+    /* allocate context. */
+    new_ctx = (sstm_ctx_t *)malloc(sizeof(sstm_ctx_t));
+    if (new_ctx == NULL) {
+        return SSTM_ERR_NO_MEM;
+    }
+
+    alloc_size = sstm_alloc_size(cap_size);
+    res = sstm_ring_alloc(new_ctx, alloc_size, conf);
+    if (res != SSTM_OK) {
+        free(new_ctx);
+
+        return res;
+    }
+
+    /* initialize context. */
+    sstm_ctx_init(new_ctx, cap_size, alloc_size);
+    res = sstm_ctx_index(new_ctx, cap_size, conf);
+    if (res != SSTM_OK) {
+        sstm_ring_free(new_ctx);
+        free(new_ctx);
+
+        return res;
+    }
+
+    *ctx = new_ctx;
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief create a new seekable stream.
+ * 
+ * @param ctx the pointer pointing to a context pointer.
+ * @param conf configuration pointer.
+*/
+SSTM_API sstm_res_t sstm_new(sstm_ctx_t **ctx, sstm_conf_t *conf) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(new, NULL, conf == NULL ? 0 : conf->cap_size);
+    res = sstm_do_new(ctx, conf);
+    SSTM_PROBE_EXIT(new, res == SSTM_OK ? *ctx : NULL,
+                    res == SSTM_OK ? (*ctx)->conf.cap_size : 0, res, 0);
+
+    return res;
+}
+
+#if SSTM_USE_FILE
+
+/* the ring buffer of a view of an empty file. */
+static sstm_u8_t sstm_file_empty[1];
+
+/**
+ * @brief give advice about a part of a file view, widened to whole
+ *        pages and clipped to the mapping.
+*/
+static void sstm_file_advise(sstm_ctx_t *ctx, sstm_u64_t begin, sstm_u64_t end, int advice) {
+    sstm_u64_t mask = ctx->file.page_size - 1;
+
+    begin &= ~mask;
+    end = (end + mask) & ~mask;
+    if (end > ctx->file.map_size) {
+        end = ctx->file.map_size;
+    }
+    if (begin < end) {
+        madvise(SSTM_RING(ctx) + begin, (size_t)(end - begin), advice);
+    }
+}
+
+/**
+ * @brief follow a read of a file view, once the seeking offset has
+ *        moved past it.
+ * 
+ * while the view is sequential, the next SSTM_FILE_AHEAD_SIZE bytes
+ * are asked for whenever the reads are half way through the ones
+ * asked for before. a random view turns sequential again once that
+ * much has been read without a seek.
+*/
+static void sstm_file_read(sstm_ctx_t *ctx) {
+    sstm_u64_t pos = ctx->head_pos + ctx->seek_offs;
+
+    if (!ctx->file.seq) {
+        if (pos - ctx->file.run_pos < SSTM_FILE_AHEAD_SIZE) {
+            return;
+        }
+        sstm_file_advise(ctx, 0, ctx->file.map_size, MADV_SEQUENTIAL);
+        ctx->file.seq = 1;
+        ctx->file.ahead_pos = pos;
+    }
+
+    if (ctx->file.ahead_pos >= ctx->conf.cap_size ||
+        pos + SSTM_FILE_AHEAD_SIZE / 2 < ctx->file.ahead_pos) {
+        return;
+    }
+    sstm_file_advise(ctx, ctx->file.ahead_pos > pos ? ctx->file.ahead_pos : pos,
+                     pos + SSTM_FILE_AHEAD_SIZE, MADV_WILLNEED);
+    ctx->file.ahead_pos = pos + SSTM_FILE_AHEAD_SIZE;
+}
+
+/**
+ * @brief follow a seek of a file view, before the seeking offset is
+ *        moved to offs.
+ * 
+ * skipping forward into the pages asked for, or back by less than
+ * SSTM_FILE_AHEAD_SIZE, keeps the view sequential. any other seek
+ * turns it random, so that the kernel stops reading ahead of it.
+*/
+static void sstm_file_seek(sstm_ctx_t *ctx, sstm_size_t offs) {
+    sstm_u64_t from = ctx->head_pos + ctx->seek_offs;
+    sstm_u64_t pos = ctx->head_pos + offs;
+
+    ctx->file.run_pos = pos;
+    if (!ctx->file.seq ||
+        (pos + SSTM_FILE_AHEAD_SIZE >= from && pos <= ctx->file.ahead_pos)) {
+        return;
+    }
+    sstm_file_advise(ctx, 0, ctx->file.map_size, MADV_RANDOM);
+    ctx->file.seq = 0;
+}
+
+/**
+ * @brief drop the pages of a file view that a clean has passed.
+ * 
+ * they stay in the page cache, this only keeps a view that is read
+ * with cleanup from holding the whole file in its resident set.
+*/
+static void sstm_file_drop(sstm_ctx_t *ctx) {
+    sstm_u64_t end = ctx->head_pos & ~(sstm_u64_t)(ctx->file.page_size - 1);
+
+    if (end - ctx->file.drop_pos < SSTM_FILE_AHEAD_SIZE) {
+        return;
+    }
+    madvise(SSTM_RING(ctx) + ctx->file.drop_pos, (size_t)(end - ctx->file.drop_pos), MADV_DONTNEED);
+    ctx->file.drop_pos = end;
+}
+
+/**
+ * @brief the body of sstm_open_mmap(), without instrumentation.
+*/
+static sstm_res_t sstm_do_open_mmap(sstm_ctx_t **ctx, const char *path) {
+    sstm_size_t cap_size;
+    sstm_ctx_t *new_ctx;
+    struct stat st;
+    sstm_u8_t *ring;
+    size_t page_size;
+    size_t map_size;
+    sstm_res_t res;
+    int fd;
+
+    SSTM_ASSERT(ctx != NULL);
+    SSTM_ASSERT(path != NULL);
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return SSTM_ERR;
+    }
+
+    /* the ring buffer is one byte longer than the
+       capacity, its size must fit in sstm_size_t. */
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (sstm_u64_t)st.st_size >= UINT32_MAX) {
+        close(fd);
+
+        return SSTM_ERR;
+    }
+    cap_size = (sstm_size_t)st.st_size;
+
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+    map_size = ((size_t)cap_size + page_size - 1) & ~(page_size - 1);
+    ring = sstm_file_empty;
+    if (map_size != 0) {
+        ring = (sstm_u8_t *)mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    /* the mapping keeps the file open. */
+    close(fd);
+    if (ring == (sstm_u8_t *)MAP_FAILED) {
+        return SSTM_ERR_NO_MEM;
+    }
+
+    new_ctx = (sstm_ctx_t *)malloc(sizeof(sstm_ctx_t));
+    if (new_ctx == NULL) {
+        res = SSTM_ERR_NO_MEM;
+        goto fail;
+    }
+
+    /* the byte after the file is never read, as the
+       stream can never be written. */
+    SSTM_RING_SET(new_ctx, ring);
+    sstm_ctx_init(new_ctx, cap_size, cap_size);
+
+    /* the marks and refs stay empty. */
+    res = sstm_ctx_index(new_ctx, SSTM_CAP_SIZE_MIN, NULL);
+    if (res != SSTM_OK) {
+        free(new_ctx);
+        goto fail;
+    }
+
+    /* all of the file is fresh data. */
+    new_ctx->cache.used_size = cap_size;
+    new_ctx->cache.fresh_size = cap_size;
+    new_ctx->cache.free_size = 0;
+    new_ctx->tail_idx = cap_size;
+    new_ctx->tail_pos = cap_size;
+#if SSTM_USE_STATS
+    new_ctx->stat.used_peak = cap_size;
+#endif
+#if SSTM_USE_MMAP
+    new_ctx->mem.kind = SSTM_MEM_KIND_FILE;
+    new_ctx->mem.flags = 0;
+    new_ctx->mem.map_size = map_size;
+    new_ctx->mem.page_size = page_size;
+    new_ctx->mem.commit_size = map_size;
+    new_ctx->mem.idle_cleans = 0;
+    new_ctx->mem.release_pos = 0;
+#endif
+
+    new_ctx->file.mapped = 1;
+    new_ctx->file.seq = 1;
+    new_ctx->file.map_size = map_size;
+    new_ctx->file.page_size = page_size;
+    new_ctx->file.ahead_pos = 0;
+    new_ctx->file.drop_pos = 0;
+    new_ctx->file.run_pos = 0;
+    sstm_file_advise(new_ctx, 0, map_size, MADV_SEQUENTIAL);
+    sstm_file_read(new_ctx);
+
+    *ctx = new_ctx;
+
+    return SSTM_OK;
+
+fail:
+    if (map_size != 0) {
+        munmap(ring, map_size);
+    }
+
+    return res;
+}
+
+/**
+ * @brief open a file as a read only stream, without copying it.
+ * 
+ * the ring buffer is a private mapping of the whole file, cap_size is
+ * the file size and all of it is fresh data, nothing can be written.
+ * reads, seeks and sstm_pread() work as on any stream, a clean drops
+ * the pages it passes instead of freeing space. the mapping is
+ * advised as sequential and its pages are asked for
+ * SSTM_FILE_AHEAD_SIZE ahead of the reads, a seek away from the
+ * seeking offset advises it as random until the reads run on again,
+ * see sstm_file_seek(). the file must not be truncated while it is
+ * open.
+ * 
+ * @param ctx the pointer pointing to a context pointer.
+ * @param path the path of the file.
+ * @return SSTM_ERR if the file cannot be opened, is not a regular
+ *         file or is 4 GiB or larger.
+*/
+SSTM_API sstm_res_t sstm_open_mmap(sstm_ctx_t **ctx, const char *path) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(open_mmap, NULL, 0);
+    res = sstm_do_open_mmap(ctx, path);
+    SSTM_PROBE_EXIT(open_mmap, res == SSTM_OK ? *ctx : NULL,
+                    res == SSTM_OK ? (*ctx)->conf.cap_size : 0, res, 0);
+
+    return res;
+}
+
+#endif
+
+#if SSTM_USE_SOURCE
+
+/**
+ * @brief publish where the consumer of a source stream reads, and
+ *        wake the fetching thread if it is idle.
+ * 
+ * called after the seeking offset has moved or space has been freed.
+*/
+static void sstm_src_kick(sstm_ctx_t *ctx) {
+    if (ctx->src.func == NULL) {
+        return;
+    }
+
+    /* the fetching thread marks itself idle before it
+       looks at the stream, so either it sees the change
+       or it is seen idle here. */
+    __atomic_store_n(&ctx->src.need_pos, ctx->head_pos + ctx->seek_offs, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ctx->src.idle, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&ctx->src.lock);
+        __atomic_store_n(&ctx->src.idle, 0, __ATOMIC_SEQ_CST);
+        pthread_cond_signal(&ctx->src.fetch_cond);
+        pthread_mutex_unlock(&ctx->src.lock);
+    }
+}
+
+/**
+ * @brief wait until a source stream has size bytes of fresh data, or
+ *        its fetching thread cannot fetch them.
+ * 
+ * the fetching thread stops when the data is past the end of the
+ * source or the free space cannot take the next block, so a read of
+ * more than the stream can hold does not wait forever.
+ * 
+ * @return the result of the failed fetch if the data is missing
+ *         because of it, SSTM_OK otherwise.
+*/
+static sstm_res_t sstm_src_wait(sstm_ctx_t *ctx, sstm_size_t size) {
+    sstm_res_t res;
+
+    if (ctx->src.func == NULL || SSTM_LOAD(ctx->cache.fresh_size) >= size) {
+        return SSTM_OK;
+    }
+
+    pthread_mutex_lock(&ctx->src.lock);
+    __atomic_store_n(&ctx->src.need_pos, ctx->head_pos + ctx->seek_offs + size, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ctx->src.idle, 0, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&ctx->src.fetch_cond);
+    while (SSTM_LOAD(ctx->cache.fresh_size) < size && !ctx->src.idle) {
+        pthread_cond_wait(&ctx->src.data_cond, &ctx->src.lock);
+    }
+    res = SSTM_LOAD(ctx->cache.fresh_size) < size ? ctx->src.err : SSTM_OK;
+    pthread_mutex_unlock(&ctx->src.lock);
+
+    return res;
+}
+
+/**
+ * @brief move a source stream to another part of the source, dropping
+ *        all of its data.
+ * 
+ * the fetching thread writes nothing but the free space without the
+ * lock, and drops a fetch started before the refill once it is done.
+ * 
+ * @param ctx context pointer.
+ * @param pos the position of the source to fetch from.
+*/
+static void sstm_src_refill(sstm_ctx_t *ctx, sstm_u64_t pos) {
+    sstm_size_t idx = (sstm_size_t)(pos % (ctx->conf.cap_size + 1));
+
+    pthread_mutex_lock(&ctx->src.lock);
+    ctx->src.gen++;
+    ctx->src.err = SSTM_OK;
+    ctx->head_idx = idx;
+    ctx->tail_idx = idx;
+    ctx->seek_offs = 0;
+    SSTM_STORE(ctx->head_pos, pos);
+    SSTM_STORE(ctx->tail_pos, pos);
+    SSTM_STORE(ctx->cache.used_size, 0);
+    SSTM_STORE(ctx->cache.fresh_size, 0);
+    SSTM_STORE(ctx->cache.free_size, ctx->conf.cap_size);
+    ctx->cache.stale_size = 0;
+#if SSTM_USE_TIME
+    SSTM_STORE(ctx->time.marks.head, ctx->time.marks.tail);
+    ctx->time.next_pos = 0;
+#endif
+    __atomic_store_n(&ctx->src.need_pos, pos, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ctx->src.idle, 0, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&ctx->src.fetch_cond);
+    pthread_mutex_unlock(&ctx->src.lock);
+    SSTM_COUNT(ctx, src_refills, 1);
+
+#if SSTM_USE_EVENTFD
+    sstm_evfd_sync_read(ctx);
+    sstm_evfd_sync_write(ctx);
+#endif
+}
+
+/**
+ * @brief stop the fetching thread of a source stream, waiting for the
+ *        fetch it is doing.
+*/
+static void sstm_src_stop(sstm_ctx_t *ctx) {
+    pthread_mutex_lock(&ctx->src.lock);
+    ctx->src.stop = 1;
+    pthread_cond_signal(&ctx->src.fetch_cond);
+    pthread_mutex_unlock(&ctx->src.lock);
+    pthread_join(ctx->src.thread, NULL);
+
+    pthread_cond_destroy(&ctx->src.data_cond);
+    pthread_cond_destroy(&ctx->src.fetch_cond);
+    pthread_mutex_destroy(&ctx->src.lock);
+}
+
+#endif
+
+/**
+ * @brief delete a seekable stream.
+ * 
+ * a shared context is detached instead, see sstm_shm_detach().
+ * 
+ * @param ctx context pointer.
+*/
+SSTM_API sstm_res_t sstm_del(sstm_ctx_t *ctx) {
+    SSTM_ASSERT(ctx != NULL);
+
+#if SSTM_USE_SHM
+    if (ctx->shm.magic != 0) {
+        return sstm_shm_detach(ctx);
+    }
+#endif
+
+    SSTM_PROBE_ENTRY(del, ctx, ctx->conf.cap_size);
+
+#if SSTM_USE_SOURCE
+    if (ctx->src.func != NULL) {
+        sstm_src_stop(ctx);
+    }
+#endif
+
+#if SSTM_USE_EVENTFD
+    if (ctx->evfd.read_fd >= 0) {
+        close(ctx->evfd.read_fd);
+        close(ctx->evfd.write_fd);
+    }
+#endif
+
+#if SSTM_USE_RECORD
+    free(ctx->rec.marks.ring);
+#endif
+#if SSTM_USE_TIME
+    free(ctx->time.marks.ring);
+#endif
+#if SSTM_USE_HOLE
+    free(ctx->hole.marks.ring);
+#endif
+#if SSTM_USE_REF
+
+    /* the data of the refs is dropped with the stream. */
+    sstm_ref_release(ctx, ctx->ref.tail);
+    free(ctx->ref.ring);
+#endif
+#if SSTM_USE_FILE
+    if (!ctx->file.mapped) {
+        sstm_ring_free(ctx);
+    } else if (ctx->file.map_size != 0) {
+        munmap(SSTM_RING(ctx), ctx->file.map_size);
+    }
+#else
+    sstm_ring_free(ctx);
+#endif
+    free(ctx);
+
+    SSTM_PROBE_EXIT(del, NULL, 0, SSTM_OK, 0);
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief get the status of the seekable stream.
+ * 
+ * @param ctx context pointer.
+ * @param stat status pointer.
+*/
+SSTM_API sstm_res_t sstm_stat(sstm_ctx_t *ctx, sstm_stat_t *stat) {
+    SSTM_ASSERT(ctx != NULL);
+    SSTM_ASSERT(stat != NULL);
+
+    SSTM_PROBE_ENTRY(stat, ctx, 0);
+
+    /* the fields of the options that are off read 0. */
+    memset(stat, 0, sizeof(*stat));
+
+    stat->cap_size = ctx->conf.cap_size;
+    stat->used_size = SSTM_LOAD(ctx->cache.used_size);
+    stat->stale_size = ctx->cache.stale_size;
+    stat->fresh_size = SSTM_LOAD(ctx->cache.fresh_size);
+    stat->free_size = SSTM_LOAD(ctx->cache.free_size);
+    stat->seek_offs = ctx->seek_offs;
+    stat->head_pos = SSTM_LOAD(ctx->head_pos);
+    stat->tail_pos = SSTM_LOAD(ctx->tail_pos);
+
+#if SSTM_USE_STATS
+    stat->used_peak = ctx->stat.used_peak;
+    stat->write_bytes = ctx->stat.write_bytes;
+    stat->read_bytes = ctx->stat.read_bytes;
+    stat->clean_bytes = ctx->stat.clean_bytes;
+    stat->write_splits = ctx->stat.write_splits;
+    stat->read_splits = ctx->stat.read_splits;
+    stat->no_space_errs = ctx->stat.no_space_errs;
+    stat->no_data_errs = ctx->stat.no_data_errs;
+    stat->seek_backs = ctx->stat.seek_backs;
+    stat->seek_fwds = ctx->stat.seek_fwds;
+#endif
+#if SSTM_USE_RECORD
+    stat->rec_count = (sstm_size_t)(SSTM_LOAD(ctx->rec.marks.tail) - ctx->rec.marks.head);
+    stat->rec_offs = ctx->rec.seek < ctx->rec.marks.head ? 0 :
+                     (sstm_size_t)(ctx->rec.seek - ctx->rec.marks.head);
+#endif
+#if SSTM_USE_MMAP
+    stat->mem_kind = ctx->mem.kind;
+#endif
+#if SSTM_USE_NT && SSTM_USE_STATS
+    stat->nt_writes = ctx->stat.nt_writes;
+    stat->nt_reads = ctx->stat.nt_reads;
+#endif
+#if SSTM_USE_HOLE
+    stat->hole_count = (sstm_size_t)(SSTM_LOAD(ctx->hole.marks.tail) - ctx->hole.marks.head);
+#if SSTM_USE_STATS
+    stat->hole_bytes = ctx->stat.hole_bytes;
+#endif
+#endif
+#if SSTM_USE_REF
+    stat->ref_count = (sstm_size_t)(SSTM_LOAD(ctx->ref.tail) - ctx->ref.head);
+#if SSTM_USE_STATS
+    stat->ref_bytes = ctx->stat.ref_bytes;
+#endif
+#endif
+#if SSTM_USE_SOURCE
+    stat->src_size = ctx->src.size;
+#if SSTM_USE_STATS
+    stat->src_fetches = ctx->stat.src_fetches;
+    stat->src_refills = ctx->stat.src_refills;
+#endif
+#endif
+
+    SSTM_PROBE_EXIT(stat, ctx, 0, SSTM_OK, ctx->cache.used_size);
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief the body of sstm_clean(), without instrumentation.
+*/
+static sstm_res_t sstm_do_clean(sstm_ctx_t *ctx) {
+    sstm_size_t stale_size;
+    sstm_size_t free_size;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    stale_size = ctx->cache.stale_size;
+    if (stale_size == 0) {
+        return SSTM_OK;
+    }
+
+    ctx->head_idx = (ctx->head_idx + stale_size) % (ctx->conf.cap_size + 1);
+
+    /* before the free size, see sstm_pread(). */
+    SSTM_STORE(ctx->head_pos, ctx->head_pos + stale_size);
+#if SSTM_USE_RECORD
+    sstm_marks_trim(&ctx->rec.marks, ctx->head_pos);
+#endif
+#if SSTM_USE_TIME
+    sstm_marks_trim(&ctx->time.marks, ctx->head_pos);
+#endif
+#if SSTM_USE_HOLE
+    sstm_hole_trim(&ctx->hole.marks, ctx->head_pos);
+#endif
+#if SSTM_USE_REF
+    sstm_ref_trim(ctx, ctx->head_pos);
+#endif
+
+    /* update cache, the free size goes last as it
+       hands the space over to the producer. */
+    SSTM_SUB(ctx->cache.used_size, stale_size);
+    ctx->cache.stale_size = 0;
+    ctx->seek_offs = 0;
+    SSTM_COUNT(ctx, clean_bytes, stale_size);
+#if SSTM_USE_FILE
+
+    /* a file view is never written, so the space is
+       not handed over, only its pages are dropped. */
+    if (ctx->file.mapped) {
+        sstm_file_drop(ctx);
+
+        return SSTM_OK;
+    }
+#endif
+    free_size = SSTM_ADD(ctx->cache.free_size, stale_size);
+
+#if SSTM_USE_WAIT
+    sstm_wake(&ctx->wait.write_want, &ctx->wait.write_seq, free_size);
+#else
+    (void)free_size;
+#endif
+#if SSTM_USE_EVENTFD
+    sstm_evfd_sync_write(ctx);
+#endif
+#if SSTM_USE_MMAP && !SSTM_USE_SPSC
+    if (ctx->mem.flags & SSTM_MEM_RELEASE) {
+        sstm_ring_idle(ctx);
+    }
+#endif
+#if SSTM_USE_SOURCE
+    sstm_src_kick(ctx);
+#endif
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief clean the stale section of the seekable stream.
+ * 
+ * @param ctx context pointer.
+*/
+SSTM_API sstm_res_t sstm_clean(sstm_ctx_t *ctx) {
+    sstm_u64_t begin;
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(clean, ctx, 0);
+    SSTM_HIST_BEGIN(begin);
+    res = sstm_do_clean(ctx);
+    SSTM_HIST_END(ctx, SSTM_OP_CLEAN, begin);
+    SSTM_PROBE_EXIT(clean, ctx, 0, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#if SSTM_USE_NT
+
+/* how far ahead of the loads the source is prefetched. */
+#define SSTM_NT_PREFETCH        512
+
+/**
+ * define the non-temporal copy for one vector width. the destination
+ * is brought to the vector alignment with a plain copy, the bulk is
+ * moved four vectors at a time with the source prefetched with the
+ * NTA hint and the given aligned store, and the remainder is copied
+ * plainly again.
+*/
+#define SSTM_NT_COPY_FUNC(name, isa, vec_t, loadu, store)                           \
+    __attribute__((target(isa)))                                                    \
+    static void name(void *dst, const void *src, sstm_size_t size) {                \
+        sstm_u8_t *d = (sstm_u8_t *)dst;                                            \
+        const sstm_u8_t *s = (const sstm_u8_t *)src;                                \
+        sstm_size_t head = (sstm_size_t)(-(uintptr_t)d & (sizeof(vec_t) - 1));      \
+                                                                                    \
+        if (head > size) {                                                          \
+            head = size;                                                            \
+        }                                                                           \
+        memcpy(d, s, head);                                                         \
+        d += head;                                                                  \
+        s += head;                                                                  \
+        size -= head;                                                               \
+        while (size >= 4 * sizeof(vec_t)) {                                         \
+            _mm_prefetch((const char *)s + SSTM_NT_PREFETCH, _MM_HINT_NTA);         \
+            _mm_prefetch((const char *)s + SSTM_NT_PREFETCH + 64, _MM_HINT_NTA);    \
+            store((vec_t *)d, loadu((const vec_t *)s));                             \
+            store((vec_t *)d + 1, loadu((const vec_t *)s + 1));                     \
+            store((vec_t *)d + 2, loadu((const vec_t *)s + 2));                     \
+            store((vec_t *)d + 3, loadu((const vec_t *)s + 3));                     \
+            d += 4 * sizeof(vec_t);                                                 \
+            s += 4 * sizeof(vec_t);                                                 \
+            size -= 4 * sizeof(vec_t);                                              \
+        }                                                                           \
+        memcpy(d, s, size);                                                         \
+    }
+
+/* into the ring, with streaming stores. */
+SSTM_NT_COPY_FUNC(sstm_copy_nt_sse2, "sse2", __m128i, _mm_loadu_si128, _mm_stream_si128)
+SSTM_NT_COPY_FUNC(sstm_copy_nt_avx2, "avx2", __m256i, _mm256_loadu_si256, _mm256_stream_si256)
+SSTM_NT_COPY_FUNC(sstm_copy_nt_avx512, "avx512f", __m512i, _mm512_loadu_si512, _mm512_stream_si512)
+
+/* out of the ring, with plain stores. */
+SSTM_NT_COPY_FUNC(sstm_copy_nta_sse2, "sse2", __m128i, _mm_loadu_si128, _mm_store_si128)
+SSTM_NT_COPY_FUNC(sstm_copy_nta_avx2, "avx2", __m256i, _mm256_loadu_si256, _mm256_store_si256)
+SSTM_NT_COPY_FUNC(sstm_copy_nta_avx512, "avx512f", __m512i, _mm512_loadu_si512, _mm512_store_si512)
+
+/**
+ * @brief copy data into the ring buffer with non-temporal stores,
+ *        using the widest vectors the cpu supports.
+ * 
+ * the stores are weakly ordered, the sfence makes them visible
+ * before the cache fields that publish the data are updated.
+ * 
+ * @param dst destination pointer.
+ * @param src source pointer.
+ * @param size data size.
+*/
+static void sstm_copy_nt(void *dst, const void *src, sstm_size_t size) {
+    if (__builtin_cpu_supports("avx512f")) {
+        sstm_copy_nt_avx512(dst, src, size);
+    } else if (__builtin_cpu_supports("avx2")) {
+        sstm_copy_nt_avx2(dst, src, size);
+    } else if (__builtin_cpu_supports("sse2")) {
+        sstm_copy_nt_sse2(dst, src, size);
+    } else {
+        memcpy(dst, src, size);
+    }
+    _mm_sfence();
+}
+
+/**
+ * @brief copy data out of the ring buffer with non-temporal loads,
+ *        using the widest vectors the cpu supports.
+ * 
+ * the ring is prefetched with the NTA hint so that it does not
+ * evict the working set, while the caller's buffer is written with
+ * plain stores, as it is usually read right after.
+ * 
+ * @param dst destination pointer.
+ * @param src source pointer.
+ * @param size data size.
+*/
+static void sstm_copy_nta(void *dst, const void *src, sstm_size_t size) {
+    if (__builtin_cpu_supports("avx512f")) {
+        sstm_copy_nta_avx512(dst, src, size);
+    } else if (__builtin_cpu_supports("avx2")) {
+        sstm_copy_nta_avx2(dst, src, size);
+    } else if (__builtin_cpu_supports("sse2")) {
+        sstm_copy_nta_sse2(dst, src, size);
+    } else {
+        memcpy(dst, src, size);
+    }
+}
+
+#endif
+
+/**
+ * @brief copy data into the ring buffer, with non-temporal stores
+ *        when nt is set.
+*/
+static inline void sstm_memcpy_in(void *dst, const void *src, sstm_size_t size, sstm_bool_t nt) {
+#if SSTM_USE_NT
+    if (nt) {
+        sstm_copy_nt(dst, src, size);
+
+        return;
+    }
+#endif
+    (void)nt;
+    memcpy(dst, src, size);
+}
+
+/**
+ * @brief copy data out of the stream, with non-temporal loads
+ *        when nt is set.
+*/
+static inline void sstm_memcpy_out(void *dst, const void *src, sstm_size_t size, sstm_bool_t nt) {
+#if SSTM_USE_NT
+    if (nt) {
+        sstm_copy_nta(dst, src, size);
+
+        return;
+    }
+#endif
+    (void)nt;
+    memcpy(dst, src, size);
+}
+
+#if SSTM_USE_HOLE || SSTM_USE_REF
+
+/**
+ * @brief copy data out of the ring buffer from an index.
+*/
+static void sstm_copy_ring(sstm_ctx_t *ctx, sstm_size_t idx, void *data, sstm_size_t size,
+                           sstm_bool_t nt) {
+    sstm_size_t first_copy_size = ctx->conf.cap_size + 1 - idx;
+
+    if (first_copy_size >= size) {
+        sstm_memcpy_out(data, SSTM_RING(ctx) + idx, size, nt);
+    } else {
+        sstm_memcpy_out(data, SSTM_RING(ctx) + idx, first_copy_size, nt);
+        sstm_memcpy_out((sstm_u8_t *)data + first_copy_size, SSTM_RING(ctx),
+                        size - first_copy_size, nt);
+    }
+}
+
+#endif
+
+#if SSTM_USE_HOLE
+
+/**
+ * @brief copy data out of the stream, with zeros for the holes.
+ * 
+ * @param ctx context pointer.
+ * @param pos the position of data.
+ * @param data data pointer.
+ * @param size data size.
+ * @param zeroed whether data is zeroed already, the holes are then
+ *        skipped.
+ * @param nt whether to copy with non-temporal stores.
+*/
+static void sstm_hole_copy(sstm_ctx_t *ctx, sstm_u64_t pos, void *data, sstm_size_t size,
+                           sstm_bool_t zeroed, sstm_bool_t nt) {
+    sstm_u64_t n = SSTM_LOAD(ctx->hole.marks.head);
+    sstm_u64_t tail = SSTM_LOAD(ctx->hole.marks.tail);
+    sstm_size_t ring_size = ctx->conf.cap_size + 1;
+    sstm_u8_t *dst = (sstm_u8_t *)data;
+    sstm_u64_t done = pos;
+    sstm_u64_t hole_pos;
+    sstm_u64_t hole_end;
+
+    while (sstm_hole_next(&ctx->hole.marks, &n, tail, pos, pos + size, &hole_pos, &hole_end)) {
+        if (hole_pos > done) {
+            sstm_copy_ring(ctx, (sstm_size_t)(done % ring_size), dst + (done - pos),
+                           (sstm_size_t)(hole_pos - done), nt);
+        }
+        if (!zeroed) {
+            memset(dst + (hole_pos - pos), 0, (size_t)(hole_end - hole_pos));
+        }
+        done = hole_end;
+    }
+    if (pos + size > done) {
+        sstm_copy_ring(ctx, (sstm_size_t)(done % ring_size), dst + (done - pos),
+                       (sstm_size_t)(pos + size - done), nt);
+    }
+}
+
+#endif
+
+#if SSTM_USE_REF
+
+/**
+ * @brief copy data that is not in a ref out of the stream.
+*/
+static void sstm_ref_gap(sstm_ctx_t *ctx, sstm_u64_t pos, void *data, sstm_size_t size,
+                         sstm_bool_t zeroed, sstm_bool_t nt) {
+#if SSTM_USE_HOLE
+    sstm_hole_copy(ctx, pos, data, size, zeroed, nt);
+#else
+    (void)zeroed;
+    sstm_copy_ring(ctx, (sstm_size_t)(pos % (ctx->conf.cap_size + 1)), data, size, nt);
+#endif
+}
+
+/**
+ * @brief copy data out of the stream, from the refs for their parts.
+ * 
+ * see sstm_hole_copy() for the parameters.
+*/
+static void sstm_ref_copy(sstm_ctx_t *ctx, sstm_u64_t pos, void *data, sstm_size_t size,
+                          sstm_bool_t zeroed, sstm_bool_t nt) {
+    sstm_u64_t n = SSTM_LOAD(ctx->ref.head);
+    sstm_u64_t tail = SSTM_LOAD(ctx->ref.tail);
+    sstm_u8_t *dst = (sstm_u8_t *)data;
+    sstm_u64_t done = pos;
+    sstm_u64_t ref_pos;
+    sstm_u64_t ref_end;
+    const sstm_ref_t *ref;
+
+    for (; n != tail && done < pos + size; n++) {
+        ref = &ctx->ref.ring[n & ctx->ref.mask];
+        if (ref->pos >= pos + size) {
+            break;
+        }
+        if (ref->pos + ref->size <= pos) {
+            continue;
+        }
+        ref_pos = ref->pos > pos ? ref->pos : pos;
+        ref_end = ref->pos + ref->size < pos + size ? ref->pos + ref->size : pos + size;
+        if (ref_pos > done) {
+            sstm_ref_gap(ctx, done, dst + (done - pos), (sstm_size_t)(ref_pos - done), zeroed, nt);
+        }
+        sstm_memcpy_out(dst + (ref_pos - pos), ref->data + (ref_pos - ref->pos),
+                        (sstm_size_t)(ref_end - ref_pos), nt);
+        done = ref_end;
+    }
+    if (pos + size > done) {
+        sstm_ref_gap(ctx, done, dst + (done - pos), (sstm_size_t)(pos + size - done), zeroed, nt);
+    }
+}
+
+#endif
+
+#if SSTM_USE_HOLE || SSTM_USE_REF
+
+/**
+ * @brief check whether all the data of the stream is in the ring
+ *        buffer, i.e. there are no holes or refs.
+*/
+static inline sstm_bool_t sstm_ring_only(sstm_ctx_t *ctx) {
+#if SSTM_USE_HOLE
+    if (SSTM_LOAD(ctx->hole.marks.head) != SSTM_LOAD(ctx->hole.marks.tail)) {
+        return 0;
+    }
+#endif
+#if SSTM_USE_REF
+    if (SSTM_LOAD(ctx->ref.head) != SSTM_LOAD(ctx->ref.tail)) {
+        return 0;
+    }
+#endif
+
+    return 1;
+}
+
+/**
+ * @brief get the number of holes and refs dropped so far, which
+ *        changes whenever a clean hands their slots back.
+*/
+static inline sstm_u64_t sstm_span_epoch(sstm_ctx_t *ctx) {
+    sstm_u64_t epoch = 0;
+
+#if SSTM_USE_HOLE
+    epoch += SSTM_LOAD(ctx->hole.marks.head);
+#endif
+#if SSTM_USE_REF
+    epoch += SSTM_LOAD(ctx->ref.head);
+#endif
+    (void)ctx;
+
+    return epoch;
+}
+
+/**
+ * @brief copy data at a position out of the stream, from wherever
+ *        each part of it is.
+ * 
+ * see sstm_hole_copy() for the parameters.
+*/
+static void sstm_copy_pos(sstm_ctx_t *ctx, sstm_u64_t pos, void *data, sstm_size_t size,
+                          sstm_bool_t zeroed, sstm_bool_t nt) {
+#if SSTM_USE_REF
+    sstm_ref_copy(ctx, pos, data, size, zeroed, nt);
+#else
+    sstm_hole_copy(ctx, pos, data, size, zeroed, nt);
+#endif
+}
+
+#endif
+
+/**
+ * @brief copy data out of the used section.
+ * 
+ * @param ctx context pointer.
+ * @param offs the offset of data from the head of the stream.
+ * @param data data pointer.
+ * @param size data size.
+*/
+static void sstm_copy_out(sstm_ctx_t *ctx, sstm_size_t offs, void *data, sstm_size_t size) {
+    sstm_u8_t *first_copy_ptr;
+    sstm_size_t new_head_idx;
+    sstm_bool_t nt;
+
+#if SSTM_USE_NT
+    nt = size >= SSTM_NT_MIN_SIZE;
+    if (nt) {
+        SSTM_COUNT(ctx, nt_reads, 1);
+    }
+#else
+    nt = 0;
+#endif
+
+    new_head_idx = (ctx->head_idx + offs) % (ctx->conf.cap_size + 1);
+#if SSTM_USE_HOLE || SSTM_USE_REF
+    if (!sstm_ring_only(ctx)) {
+        if (ctx->conf.cap_size + 1 - new_head_idx < size) {
+            SSTM_COUNT(ctx, read_splits, 1);
+        }
+        sstm_copy_pos(ctx, ctx->head_pos + offs, data, size, 0, nt);
+
+        return;
+    }
+#endif
+    first_copy_ptr = SSTM_RING(ctx) + new_head_idx;
+    if (ctx->conf.cap_size + 1 - new_head_idx >= size) {
+        sstm_memcpy_out(data, first_copy_ptr, size, nt);
+    } else {
+        sstm_size_t first_copy_size = ctx->conf.cap_size + 1 - new_head_idx;
+        sstm_size_t second_copy_size = size - first_copy_size;
+
+        sstm_memcpy_out(data, first_copy_ptr, first_copy_size, nt);
+        sstm_memcpy_out((sstm_u8_t *)data + first_copy_size, SSTM_RING(ctx), second_copy_size, nt);
+        SSTM_COUNT(ctx, read_splits, 1);
+    }
+}
+
+/**
+ * @brief the body of sstm_read(), without instrumentation.
+*/
+static sstm_res_t sstm_do_read(sstm_ctx_t *ctx, void *data, sstm_size_t size, sstm_bool_t cleanup) {
+#if SSTM_USE_SOURCE
+    sstm_res_t res;
+#endif
+
+    SSTM_ASSERT(ctx != NULL);
+
+    if (size == 0) {
+        return SSTM_OK;
+    }
+
+#if SSTM_USE_SOURCE
+
+    /* a source stream waits for the data to be fetched. */
+    res = sstm_src_wait(ctx, size);
+    if (res != SSTM_OK) {
+        return res;
+    }
+#endif
+
+    if (SSTM_LOAD(ctx->cache.fresh_size) < size) {
+        SSTM_COUNT(ctx, no_data_errs, 1);
+
+        return SSTM_ERR_NO_DATA;
+    }
+
+    /* copy data. */
+    if (data != NULL) {
+        sstm_copy_out(ctx, ctx->seek_offs, data, size);
+    }
+    ctx->seek_offs += size;
+    SSTM_COUNT(ctx, read_bytes, size);
+
+    /* update cache. */
+    ctx->cache.stale_size += size;
+    SSTM_SUB(ctx->cache.fresh_size, size);
+
+#if SSTM_USE_EVENTFD
+    sstm_evfd_sync_read(ctx);
+#endif
+#if SSTM_USE_FILE
+    if (ctx->file.mapped) {
+        sstm_file_read(ctx);
+    }
+#endif
+#if SSTM_USE_SOURCE
+    sstm_src_kick(ctx);
+#endif
+
+    if (cleanup) {
+        sstm_do_clean(ctx);
+    }
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief read data from the stream.
+ * 
+ * @param ctx context pointer.
+ * @param data data pointer, when NULL, no data will be copied.
+ * @param size data size.
+ * @param cleanup whether to clean the stale section after read.
+*/
+SSTM_API sstm_res_t sstm_read(sstm_ctx_t *ctx, void *data, sstm_size_t size, sstm_bool_t cleanup) {
+    sstm_u64_t begin;
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(read, ctx, size);
+    SSTM_HIST_BEGIN(begin);
+    res = sstm_do_read(ctx, data, size, cleanup);
+    SSTM_HIST_END(ctx, SSTM_OP_READ, begin);
+    SSTM_PROBE_EXIT(read, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#if SSTM_USE_HOLE
+
+/**
+ * @brief the body of sstm_read_zeroed(), without instrumentation.
+*/
+static sstm_res_t sstm_do_read_zeroed(sstm_ctx_t *ctx, void *data, sstm_size_t size,
+                                      sstm_bool_t cleanup) {
+    SSTM_ASSERT(ctx != NULL);
+
+    if (size == 0) {
+        return SSTM_OK;
+    }
+
+    if (SSTM_LOAD(ctx->cache.fresh_size) < size) {
+        SSTM_COUNT(ctx, no_data_errs, 1);
+
+        return SSTM_ERR_NO_DATA;
+    }
+
+    SSTM_ASSERT(data != NULL);
+
+    sstm_copy_pos(ctx, ctx->head_pos + ctx->seek_offs, data, size, 1, 0);
+
+    /* the data is checked to be there, this only moves
+       the seeking offset and cleans up. */
+    return sstm_do_read(ctx, NULL, size, cleanup);
+}
+
+/**
+ * @brief read data from the stream into a zeroed buffer, e.g. one
+ *        fresh from calloc() or mmap(), which the holes leave alone.
+ * 
+ * @param ctx context pointer.
+ * @param data data pointer, the size bytes at it must be zero.
+ * @param size data size.
+ * @param cleanup whether to clean the stale section after read.
+*/
+SSTM_API sstm_res_t sstm_read_zeroed(sstm_ctx_t *ctx, void *data, sstm_size_t size,
+                                     sstm_bool_t cleanup) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(read_zeroed, ctx, size);
+    res = sstm_do_read_zeroed(ctx, data, size, cleanup);
+    SSTM_PROBE_EXIT(read_zeroed, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#endif
+
+#if SSTM_USE_TIME
+
+/**
+ * @brief timestamp the data committed at a position, unless the last
+ *        timestamp is closer than the gap or the index is full.
+*/
+static void sstm_time_mark(sstm_ctx_t *ctx, sstm_u64_t pos) {
+    struct timespec ts;
+
+    if (pos < ctx->time.next_pos || sstm_marks_full(&ctx->time.marks)) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    sstm_marks_push(&ctx->time.marks, pos,
+                    (sstm_u64_t)ts.tv_sec * 1000000000 + (sstm_u64_t)ts.tv_nsec);
+    ctx->time.next_pos = pos + ctx->time.gap;
+}
+
+#endif
+
+/**
+ * @brief copy data to the tail of the ring buffer, it is not
+ *        part of the stream until sstm_commit().
+ * 
+ * @param ctx context pointer.
+ * @param data data pointer, when NULL, 0x00 will be written.
+ * @param size data size.
+*/
+static void sstm_copy_in(sstm_ctx_t *ctx, const void *data, sstm_size_t size) {
+    sstm_u8_t *first_copy_ptr;
+    sstm_bool_t nt;
+
+#if SSTM_USE_NT
+    nt = data != NULL && size >= SSTM_NT_MIN_SIZE;
+    if (nt) {
+        SSTM_COUNT(ctx, nt_writes, 1);
+    }
+#else
+    nt = 0;
+#endif
+
+    first_copy_ptr = SSTM_RING(ctx) + ctx->tail_idx;
+    if (ctx->conf.cap_size + 1 - ctx->tail_idx >= size) {
+        if (data != NULL) {
+            sstm_memcpy_in(first_copy_ptr, data, size, nt);
+        } else {
+            memset(first_copy_ptr, 0, size);
+        }
+        ctx->tail_idx = (ctx->tail_idx + size) % (ctx->conf.cap_size + 1);
+    } else {
+        sstm_size_t first_copy_size = ctx->conf.cap_size + 1 - ctx->tail_idx;
+        sstm_size_t second_copy_size = size - first_copy_size;
+
+        if (data != NULL) {
+            sstm_memcpy_in(first_copy_ptr, data, first_copy_size, nt);
+            sstm_memcpy_in(SSTM_RING(ctx), (const sstm_u8_t *)data + first_copy_size, second_copy_size, nt);
+        } else {
+            memset(first_copy_ptr, 0, first_copy_size);
+            memset(SSTM_RING(ctx), 0, second_copy_size);
+        }
+        ctx->tail_idx = second_copy_size;
+        SSTM_COUNT(ctx, write_splits, 1);
+    }
+}
+
+/**
+ * @brief append the data copied by sstm_copy_in() to the stream.
+ * 
+ * @param ctx context pointer.
+ * @param size data size.
+ * @return the fresh size after the commit.
+*/
+static sstm_size_t sstm_commit(sstm_ctx_t *ctx, sstm_size_t size) {
+    sstm_size_t fresh_size;
+    sstm_size_t used_size;
+    sstm_u64_t pos;
+
+    pos = ctx->tail_pos;
+
+    /* update cache, the fresh size goes before the used
+       size so a concurrent seek never sees more used data
+       than fresh data to take it from. */
+    fresh_size = SSTM_ADD(ctx->cache.fresh_size, size);
+    used_size = SSTM_ADD(ctx->cache.used_size, size);
+    SSTM_SUB(ctx->cache.free_size, size);
+
+    /* last, so the data before it is complete for
+       sstm_pread(), and a producer that takes over a
+       shared stream restarts from it. */
+    SSTM_STORE(ctx->tail_pos, pos + size);
+
+#if SSTM_USE_STATS
+    ctx->stat.write_bytes += size;
+    if (used_size > ctx->stat.used_peak) {
+        ctx->stat.used_peak = used_size;
+    }
+#else
+    (void)used_size;
+#endif
+
+#if SSTM_USE_TIME
+    sstm_time_mark(ctx, pos);
+#else
+    (void)pos;
+#endif
+
+    return fresh_size;
+}
+
+/**
+ * @brief tell the consumer about committed data.
+ * 
+ * @param ctx context pointer.
+ * @param fresh_size the fresh size returned by sstm_commit().
+*/
+static void sstm_notify(sstm_ctx_t *ctx, sstm_size_t fresh_size) {
+    (void)ctx;
+
+#if SSTM_USE_WAIT
+    sstm_wake(&ctx->wait.read_want, &ctx->wait.read_seq, fresh_size);
+#else
+    (void)fresh_size;
+#endif
+#if SSTM_USE_EVENTFD
+    sstm_evfd_sync_read(ctx);
+    sstm_evfd_sync_write(ctx);
+#endif
+}
+
+/**
+ * @brief the body of sstm_write(), without instrumentation.
+*/
+static sstm_res_t sstm_do_write(sstm_ctx_t *ctx, const void *data, sstm_size_t size) {
+    SSTM_ASSERT(ctx != NULL);
+
+    if (size == 0) {
+        return SSTM_OK;
+    }
+
+    if (SSTM_LOAD(ctx->cache.free_size) < size) {
+        SSTM_COUNT(ctx, no_space_errs, 1);
+
+        return SSTM_ERR_NO_SPACE;
+    }
+
+#if SSTM_USE_HOLE
+
+    /* the index is pushed before the commit publishes
+       the data, as with a record. the ring buffer under
+       a hole is never touched, so it is not committed. */
+    if (data == NULL && size >= SSTM_HOLE_MIN_SIZE && !sstm_marks_full(&ctx->hole.marks)) {
+        sstm_marks_push(&ctx->hole.marks, ctx->tail_pos, size);
+        ctx->tail_idx = (ctx->tail_idx + size) % (ctx->conf.cap_size + 1);
+        SSTM_COUNT(ctx, hole_bytes, size);
+        sstm_notify(ctx, sstm_commit(ctx, size));
+
+        return SSTM_OK;
+    }
+#endif
+
+#if SSTM_USE_MMAP
+    if (sstm_ring_commit(ctx, size) != SSTM_OK) {
+        return SSTM_ERR_NO_MEM;
+    }
+#endif
+
+    sstm_copy_in(ctx, data, size);
+    sstm_notify(ctx, sstm_commit(ctx, size));
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief write data to the seekable stream.
+ * 
+ * @param ctx seekable stream context.
+ * @param data data pointer, when NULL, 0x00 will be written, or
+ *        recorded as a hole with SSTM_USE_HOLE.
+ * @param size data size.
+*/
+SSTM_API sstm_res_t sstm_write(sstm_ctx_t *ctx, const void *data, sstm_size_t size) {
+    sstm_u64_t begin;
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(write, ctx, size);
+    SSTM_HIST_BEGIN(begin);
+    res = sstm_do_write(ctx, data, size);
+    SSTM_HIST_END(ctx, SSTM_OP_WRITE, begin);
+    SSTM_PROBE_EXIT(write, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#if SSTM_USE_REF
+
+/**
+ * @brief the body of sstm_write_ref(), without instrumentation.
+*/
+static sstm_res_t sstm_do_write_ref(sstm_ctx_t *ctx, const void *data, sstm_size_t size,
+                                    sstm_release_func_t release, void *arg) {
+    sstm_ref_t *ref;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    if (size == 0) {
+        return SSTM_OK;
+    }
+
+    SSTM_ASSERT(data != NULL);
+
+    if (SSTM_LOAD(ctx->cache.free_size) < size ||
+        ctx->ref.tail - SSTM_LOAD(ctx->ref.head) > ctx->ref.mask) {
+        SSTM_COUNT(ctx, no_space_errs, 1);
+
+        return SSTM_ERR_NO_SPACE;
+    }
+
+    /* the ref is pushed before the commit publishes it,
+       the ring buffer under it is left alone and is not
+       committed either. */
+    ref = &ctx->ref.ring[ctx->ref.tail & ctx->ref.mask];
+    ref->pos = ctx->tail_pos;
+    ref->data = (const sstm_u8_t *)data;
+    ref->size = size;
+    ref->release = release;
+    ref->arg = arg;
+    SSTM_STORE(ctx->ref.tail, ctx->ref.tail + 1);
+    ctx->tail_idx = (ctx->tail_idx + size) % (ctx->conf.cap_size + 1);
+    SSTM_COUNT(ctx, ref_bytes, size);
+    sstm_notify(ctx, sstm_commit(ctx, size));
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief append a buffer to the stream without copying it.
+ * 
+ * the buffer reads like written data, it takes its size of the
+ * capacity but none of the ring buffer is written. it must stay
+ * valid and unchanged until release is called, from an sstm_clean()
+ * once it is passed or from sstm_del(). in SPSC mode that clean is
+ * the first one after the sstm_pread() calls that can still see the
+ * buffer are over.
+ * 
+ * @param ctx seekable stream context.
+ * @param data data pointer.
+ * @param size data size, 0 writes nothing and release is not called.
+ * @param release called once the stream is done with the buffer,
+ *        NULL for none. it is not called on error.
+ * @param arg passed to release.
+*/
+SSTM_API sstm_res_t sstm_write_ref(sstm_ctx_t *ctx, const void *data, sstm_size_t size,
+                                   sstm_release_func_t release, void *arg) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(write_ref, ctx, size);
+    res = sstm_do_write_ref(ctx, data, size, release, arg);
+    SSTM_PROBE_EXIT(write_ref, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#endif
+
+#if SSTM_USE_SOURCE
+
+/**
+ * @brief get the size of the next fetch of a source stream, with the
+ *        lock held.
+ * 
+ * a fetch ends on a block boundary of the source and does not wrap
+ * around the ring buffer, it waits until the free space takes all of
+ * it.
+ * 
+ * @return the size, 0 if there is nothing to fetch for now.
+*/
+static sstm_size_t sstm_src_next(sstm_ctx_t *ctx) {
+    sstm_u64_t pos = ctx->tail_pos;
+    sstm_u64_t end;
+    sstm_size_t size;
+
+    end = __atomic_load_n(&ctx->src.need_pos, __ATOMIC_SEQ_CST) +
+          (sstm_u64_t)ctx->src.ahead * ctx->src.block;
+    if (ctx->src.err != SSTM_OK || pos >= ctx->src.size || pos >= end) {
+        return 0;
+    }
+
+    size = ctx->src.block - (sstm_size_t)(pos % ctx->src.block);
+    if (size > ctx->src.size - pos) {
+        size = (sstm_size_t)(ctx->src.size - pos);
+    }
+    if (size > ctx->conf.cap_size + 1 - ctx->tail_idx) {
+        size = ctx->conf.cap_size + 1 - ctx->tail_idx;
+    }
+
+    return SSTM_LOAD(ctx->cache.free_size) < size ? 0 : size;
+}
+
+/**
+ * @brief the fetching thread of a source stream, the producer of it.
+*/
+static void *sstm_src_main(void *arg) {
+    sstm_ctx_t *ctx = (sstm_ctx_t *)arg;
+    sstm_size_t size;
+    sstm_size_t idx;
+    sstm_u64_t gen;
+    sstm_u64_t pos;
+    sstm_res_t res;
+
+    pthread_mutex_lock(&ctx->src.lock);
+    while (!ctx->src.stop) {
+
+        /* idle before looking, see sstm_src_kick(). */
+        __atomic_store_n(&ctx->src.idle, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        size = sstm_src_next(ctx);
+        if (size == 0) {
+            pthread_cond_broadcast(&ctx->src.data_cond);
+            while (ctx->src.idle && !ctx->src.stop) {
+                pthread_cond_wait(&ctx->src.fetch_cond, &ctx->src.lock);
+            }
+            continue;
+        }
+        __atomic_store_n(&ctx->src.idle, 0, __ATOMIC_SEQ_CST);
+
+#if SSTM_USE_MMAP
+        if (sstm_ring_commit(ctx, size) != SSTM_OK) {
+            ctx->src.err = SSTM_ERR_NO_MEM;
+            continue;
+        }
+#endif
+
+        /* the source is read straight into the free space,
+           without the lock. */
+        gen = ctx->src.gen;
+        pos = ctx->tail_pos;
+        idx = ctx->tail_idx;
+        pthread_mutex_unlock(&ctx->src.lock);
+        res = ctx->src.func(ctx->src.arg, pos, SSTM_RING(ctx) + idx, size);
+        pthread_mutex_lock(&ctx->src.lock);
+
+        /* the stream has been refilled meanwhile. */
+        if (gen != ctx->src.gen) {
+            continue;
+        }
+        if (res != SSTM_OK) {
+            ctx->src.err = res;
+            continue;
+        }
+
+        ctx->tail_idx = (idx + size) % (ctx->conf.cap_size + 1);
+        SSTM_COUNT(ctx, src_fetches, 1);
+        sstm_notify(ctx, sstm_commit(ctx, size));
+        pthread_cond_broadcast(&ctx->src.data_cond);
+    }
+    pthread_mutex_unlock(&ctx->src.lock);
+
+    return NULL;
+}
+
+/**
+ * @brief the body of sstm_source_new(), without instrumentation.
+*/
+static sstm_res_t sstm_do_source_new(sstm_ctx_t **ctx, sstm_conf_t *conf, sstm_u64_t size,
+                                     sstm_source_func_t func, void *arg) {
+    sstm_ctx_t *new_ctx;
+    sstm_res_t res;
+
+    SSTM_ASSERT(ctx != NULL);
+    SSTM_ASSERT(func != NULL);
+
+    res = sstm_do_new(&new_ctx, conf);
+    if (res != SSTM_OK) {
+        return res;
+    }
+
+    new_ctx->src.arg = arg;
+    new_ctx->src.size = size;
+    new_ctx->src.block = conf == NULL || conf->src_block == 0 ? SSTM_SRC_BLOCK_DEF : conf->src_block;
+    if (new_ctx->src.block > new_ctx->conf.cap_size) {
+        new_ctx->src.block = new_ctx->conf.cap_size;
+    }
+    new_ctx->src.ahead = conf == NULL || conf->src_ahead == 0 ? SSTM_SRC_AHEAD_DEF : conf->src_ahead;
+    new_ctx->src.gen = 0;
+    new_ctx->src.need_pos = 0;
+    new_ctx->src.idle = 0;
+    new_ctx->src.stop = 0;
+    new_ctx->src.err = SSTM_OK;
+
+    if (pthread_mutex_init(&new_ctx->src.lock, NULL) != 0) {
+        goto fail;
+    }
+    if (pthread_cond_init(&new_ctx->src.fetch_cond, NULL) != 0) {
+        goto fail_lock;
+    }
+    if (pthread_cond_init(&new_ctx->src.data_cond, NULL) != 0) {
+        goto fail_fetch_cond;
+    }
+
+    /* set last, sstm_del() stops the thread if it is set. */
+    new_ctx->src.func = func;
+    if (pthread_create(&new_ctx->src.thread, NULL, sstm_src_main, new_ctx) != 0) {
+        new_ctx->src.func = NULL;
+        goto fail_data_cond;
+    }
+
+    *ctx = new_ctx;
+
+    return SSTM_OK;
+
+fail_data_cond:
+    pthread_cond_destroy(&new_ctx->src.data_cond);
+fail_fetch_cond:
+    pthread_cond_destroy(&new_ctx->src.fetch_cond);
+fail_lock:
+    pthread_mutex_destroy(&new_ctx->src.lock);
+fail:
+    sstm_del(new_ctx);
+
+    return SSTM_ERR;
+}
+
+/**
+ * @brief create a stream that caches a random access source.
+ * 
+ * the stream reads as the whole source, from position 0 to size. a
+ * thread of its own fetches the source in blocks of conf.src_block
+ * bytes, up to conf.src_ahead blocks ahead of the seeking offset,
+ * straight into the ring buffer. reads wait for the data they need to
+ * be fetched. a seek to a part of the source that the stream does not
+ * hold, before its head or past its tail, drops all of its data and
+ * returns at once, the fetching starts over from there. SSTM_SEEK_END
+ * seeks from the end of the source.
+ * 
+ * the stream must be read with cleanup, or cleaned, for the fetches to
+ * go on. the caller is its consumer and nothing may write to it.
+ * sstm_pread() is only valid from the consumer, since a refill can
+ * move the head backwards. sstm_del() waits for the fetch in
+ * progress.
+ * 
+ * @param ctx the pointer pointing to a context pointer.
+ * @param conf configuration pointer.
+ * @param size the size of the source.
+ * @param func reads the source, see sstm_source_func_t.
+ * @param arg passed to func.
+*/
+SSTM_API sstm_res_t sstm_source_new(sstm_ctx_t **ctx, sstm_conf_t *conf, sstm_u64_t size,
+                                    sstm_source_func_t func, void *arg) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(source_new, NULL, conf == NULL ? 0 : conf->cap_size);
+    res = sstm_do_source_new(ctx, conf, size, func, arg);
+    SSTM_PROBE_EXIT(source_new, res == SSTM_OK ? *ctx : NULL,
+                    res == SSTM_OK ? (*ctx)->conf.cap_size : 0, res, 0);
+
+    return res;
+}
+
+#endif
+
+/**
+ * @brief move the seeking offset within the used section.
+ * 
+ * @param ctx context pointer.
+ * @param abs_offs the new seeking offset.
+*/
+static sstm_res_t sstm_seek_offs(sstm_ctx_t *ctx, sstm_size_t abs_offs) {
+
+    /* check offset. */
+    if (abs_offs > SSTM_LOAD(ctx->cache.used_size)) {
+        return SSTM_ERR_BAD_OFFS;
+    }
+    if (abs_offs == ctx->seek_offs) {
+        return SSTM_OK;
+    }
+
+    /* update cache, the fresh size is moved by the
+       distance of the seek instead of being derived from
+       the used size, which the producer may be changing. */
+    if (abs_offs > ctx->cache.stale_size) {
+        SSTM_SUB(ctx->cache.fresh_size, abs_offs - ctx->cache.stale_size);
+        SSTM_COUNT(ctx, seek_fwds, 1);
+    } else {
+        SSTM_ADD(ctx->cache.fresh_size, ctx->cache.stale_size - abs_offs);
+        SSTM_COUNT(ctx, seek_backs, 1);
+    }
+#if SSTM_USE_FILE
+    if (ctx->file.mapped) {
+        sstm_file_seek(ctx, abs_offs);
+    }
+#endif
+    ctx->seek_offs = abs_offs;
+    ctx->cache.stale_size = abs_offs;
+#if SSTM_USE_SOURCE
+    sstm_src_kick(ctx);
+#endif
+
+#if SSTM_USE_EVENTFD
+    sstm_evfd_sync_read(ctx);
+#endif
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief the body of sstm_seek_pos(), without instrumentation.
+*/
+static sstm_res_t sstm_do_seek_pos(sstm_ctx_t *ctx, sstm_u64_t pos) {
+    SSTM_ASSERT(ctx != NULL);
+
+#if SSTM_USE_SOURCE
+
+    /* a seek outside of the data a source stream holds
+       refills it, up to the end of the source. */
+    if (ctx->src.func != NULL) {
+        if (pos > ctx->src.size) {
+            return SSTM_ERR_BAD_OFFS;
+        }
+        if (pos < ctx->head_pos || pos - ctx->head_pos > SSTM_LOAD(ctx->cache.used_size)) {
+            if (pos > ctx->head_pos + ctx->seek_offs) {
+                SSTM_COUNT(ctx, seek_fwds, 1);
+            } else {
+                SSTM_COUNT(ctx, seek_backs, 1);
+            }
+            sstm_src_refill(ctx, pos);
+
+            return SSTM_OK;
+        }
+    }
+#endif
+
+    if (pos < ctx->head_pos) {
+        return SSTM_ERR_BAD_OFFS;
+    }
+    if (pos - ctx->head_pos > SSTM_LOAD(ctx->cache.used_size)) {
+        return SSTM_ERR_BAD_OFFS;
+    }
+
+    return sstm_seek_offs(ctx, (sstm_size_t)(pos - ctx->head_pos));
+}
+
+/**
+ * @brief the body of sstm_seek(), without instrumentation.
+*/
+static sstm_res_t sstm_do_seek(sstm_ctx_t *ctx, sstm_offs_t offset, sstm_whence_t whence) {
+    sstm_offs_t abs_offs;
+#if SSTM_USE_SOURCE
+    sstm_s64_t src_offs;
+#endif
+
+    SSTM_ASSERT(ctx != NULL);
+    SSTM_ASSERT(whence == SSTM_SEEK_SET ||
+                whence == SSTM_SEEK_CUR ||
+                whence == SSTM_SEEK_END);
+
+#if SSTM_USE_SOURCE
+
+    /* the end of a source stream is the end of the source. */
+    if (ctx->src.func != NULL) {
+        switch (whence) {
+            case SSTM_SEEK_SET: src_offs = offset; break;
+            case SSTM_SEEK_CUR: src_offs = (sstm_s64_t)ctx->seek_offs + offset; break;
+            case SSTM_SEEK_END: src_offs = (sstm_s64_t)(ctx->src.size - ctx->head_pos) + offset; break;
+            default: return SSTM_ERR;
+        }
+        if (src_offs < -(sstm_s64_t)ctx->head_pos) {
+            return SSTM_ERR_BAD_OFFS;
+        }
+
+        return sstm_do_seek_pos(ctx, ctx->head_pos + (sstm_u64_t)src_offs);
+    }
+#endif
+
+    /* calculate the absolute offset. */
+    switch (whence) {
+        case SSTM_SEEK_SET: abs_offs = offset; break;
+        case SSTM_SEEK_CUR: abs_offs = (sstm_offs_t)ctx->seek_offs + offset; break;
+        case SSTM_SEEK_END: abs_offs = (sstm_offs_t)SSTM_LOAD(ctx->cache.used_size) + offset; break;
+        default: return SSTM_ERR;
+    }
+
+    /* check offset. */
+    if (abs_offs < 0) {
+        return SSTM_ERR_BAD_OFFS;
+    }
+
+    return sstm_seek_offs(ctx, (sstm_size_t)abs_offs);
+}
+
+/**
+ * @brief seek the seekable stream.
+ * 
+ * @param ctx seekable stream context.
+ * @param offset offset.
+ * @param whence whence.
+*/
+SSTM_API sstm_res_t sstm_seek(sstm_ctx_t *ctx, sstm_offs_t offset, sstm_whence_t whence) {
+    sstm_u64_t begin;
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(seek, ctx, offset);
+    SSTM_HIST_BEGIN(begin);
+    res = sstm_do_seek(ctx, offset, whence);
+    SSTM_HIST_END(ctx, SSTM_OP_SEEK, begin);
+    SSTM_PROBE_EXIT(seek, ctx, offset, res, ctx->cache.used_size);
+
+    return res;
+}
+
+/**
+ * @brief seek the seekable stream to an absolute position.
+ * 
+ * the position can be anywhere between stat.head_pos and
+ * stat.tail_pos, which sstm_seek() cannot reach past 2 GiB from the
+ * seeking offset. on a source stream it can be anywhere in the
+ * source, a position outside of the data the stream holds refills
+ * it once.
+ * 
+ * @param ctx seekable stream context.
+ * @param pos absolute position, counted from the first byte ever
+ *        written.
+*/
+SSTM_API sstm_res_t sstm_seek_pos(sstm_ctx_t *ctx, sstm_u64_t pos) {
+    sstm_u64_t begin;
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(seek_pos, ctx, pos);
+    SSTM_HIST_BEGIN(begin);
+    res = sstm_do_seek_pos(ctx, pos);
+    SSTM_HIST_END(ctx, SSTM_OP_SEEK, begin);
+    SSTM_PROBE_EXIT(seek_pos, ctx, pos, res, ctx->cache.used_size);
+
+    return res;
+}
+
+/**
+ * @brief copy data at an absolute position, see sstm_pread().
+*/
+static sstm_res_t sstm_pread_copy(sstm_ctx_t *ctx, sstm_u64_t pos, void *data, sstm_size_t size) {
+    sstm_u64_t tail_pos;
+#if SSTM_USE_HOLE || SSTM_USE_REF
+    sstm_u64_t epoch;
+#else
+    sstm_size_t ring_size;
+    sstm_size_t idx;
+#endif
+
+    SSTM_ASSERT(ctx != NULL);
+
+    if (size == 0) {
+        return SSTM_OK;
+    }
+
+    if (pos < SSTM_LOAD(ctx->head_pos)) {
+        return SSTM_ERR_BAD_OFFS;
+    }
+
+    /* pos + size can wrap, compare against what is left instead. */
+    tail_pos = SSTM_LOAD(ctx->tail_pos);
+    if (pos > tail_pos || size > tail_pos - pos) {
+        return SSTM_ERR_NO_DATA;
+    }
+
+    SSTM_ASSERT(data != NULL);
+
+#if SSTM_USE_HOLE || SSTM_USE_REF
+
+    /* a clean can hand the slots of the holes or refs being
+       looked up to the producer, the copy is then done again. */
+    do {
+        epoch = sstm_span_epoch(ctx);
+        sstm_copy_pos(ctx, pos, data, size, 0, 0);
+#if SSTM_USE_SPSC
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+    } while (sstm_span_epoch(ctx) != epoch && pos >= SSTM_LOAD(ctx->head_pos));
+#else
+
+    /* every index is its position modulo the ring size. */
+    ring_size = ctx->conf.cap_size + 1;
+    idx = (sstm_size_t)(pos % ring_size);
+    if (ring_size - idx >= size) {
+        memcpy(data, SSTM_RING(ctx) + idx, size);
+    } else {
+        memcpy(data, SSTM_RING(ctx) + idx, ring_size - idx);
+        memcpy((sstm_u8_t *)data + (ring_size - idx), SSTM_RING(ctx), size - (ring_size - idx));
+    }
+#if SSTM_USE_SPSC
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+#endif
+
+    /* the head is the epoch of the data: a clean moves it
+       before it frees the space, and the producer can only
+       overwrite freed space. if it has not passed pos after
+       the copy, nothing was overwritten during it. */
+    if (pos < SSTM_LOAD(ctx->head_pos)) {
+        return SSTM_ERR_BAD_OFFS;
+    }
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief the body of sstm_pread(), without instrumentation.
+*/
+static sstm_res_t sstm_do_pread(sstm_ctx_t *ctx, sstm_u64_t pos, void *data, sstm_size_t size) {
+#if SSTM_USE_REF && SSTM_USE_SPSC
+    sstm_u64_t gen;
+    sstm_res_t res;
+
+    /* the refs it can see are not released until it is done. */
+    gen = sstm_ref_enter(ctx);
+    res = sstm_pread_copy(ctx, pos, data, size);
+    sstm_ref_exit(ctx, gen);
+
+    return res;
+#else
+    return sstm_pread_copy(ctx, pos, data, size);
+#endif
+}
+
+/**
+ * @brief read data at an absolute position, without moving the
+ *        seeking offset or cleaning anything.
+ * 
+ * the data between stat.head_pos and stat.tail_pos can be read,
+ * whether it has been read already or not. in SPSC mode it can be
+ * called from any number of threads besides the producer and the
+ * consumer, a read that loses its data to a concurrent sstm_clean()
+ * fails instead of returning what was written over it.
+ * 
+ * @param ctx context pointer.
+ * @param pos absolute position, counted from the first byte ever
+ *        written.
+ * @param data data pointer.
+ * @param size data size.
+ * @return SSTM_ERR_BAD_OFFS if the data before pos + size has been
+ *         cleaned, SSTM_ERR_NO_DATA if it has not been written.
+*/
+SSTM_API sstm_res_t sstm_pread(sstm_ctx_t *ctx, sstm_u64_t pos, void *data, sstm_size_t size) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(pread, ctx, size);
+    res = sstm_do_pread(ctx, pos, data, size);
+    SSTM_PROBE_EXIT(pread, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+/**
+ * @brief the body of sstm_pipe(), without instrumentation.
+*/
+static sstm_res_t sstm_do_pipe(sstm_ctx_t *src, sstm_ctx_t *dst, sstm_size_t size, sstm_bool_t cleanup) {
+    sstm_size_t src_ring_size;
+    sstm_size_t dst_ring_size;
+    sstm_size_t src_idx;
+    sstm_size_t copy_size;
+    sstm_size_t left_size;
+
+    SSTM_ASSERT(src != NULL);
+    SSTM_ASSERT(dst != NULL);
+
+    if (size == 0) {
+        return SSTM_OK;
+    }
+
+    /* nothing is changed until both sides are known to fit. */
+    if (SSTM_LOAD(src->cache.fresh_size) < size) {
+        SSTM_COUNT(src, no_data_errs, 1);
+
+        return SSTM_ERR_NO_DATA;
+    }
+    if (SSTM_LOAD(dst->cache.free_size) < size) {
+        SSTM_COUNT(dst, no_space_errs, 1);
+
+        return SSTM_ERR_NO_SPACE;
+    }
+
+#if SSTM_USE_MMAP
+    if (sstm_ring_commit(dst, size) != SSTM_OK) {
+        return SSTM_ERR_NO_MEM;
+    }
+#endif
+
+    src_ring_size = src->conf.cap_size + 1;
+    dst_ring_size = dst->conf.cap_size + 1;
+    src_idx = (src->head_idx + src->seek_offs) % src_ring_size;
+    if (src_ring_size - src_idx < size) {
+        SSTM_COUNT(src, read_splits, 1);
+    }
+    if (dst_ring_size - dst->tail_idx < size) {
+        SSTM_COUNT(dst, write_splits, 1);
+    }
+
+    left_size = size;
+#if SSTM_USE_HOLE || SSTM_USE_REF
+
+    /* data that is not all in the ring buffer of src is
+       copied by position, to the one or two stretches of
+       dst it goes to. */
+    if (!sstm_ring_only(src)) {
+        copy_size = dst_ring_size - dst->tail_idx < size ? dst_ring_size - dst->tail_idx : size;
+        sstm_copy_pos(src, src->head_pos + src->seek_offs,
+                      SSTM_RING(dst) + dst->tail_idx, copy_size, 0, 0);
+        if (copy_size < size) {
+            sstm_copy_pos(src, src->head_pos + src->seek_offs + copy_size,
+                          SSTM_RING(dst), size - copy_size, 0, 0);
+        }
+        dst->tail_idx = (dst->tail_idx + size) % dst_ring_size;
+        left_size = 0;
+    }
+#endif
+
+    /* one copy per stretch between the two wrap points,
+       so three at most. */
+    for (; left_size != 0; left_size -= copy_size) {
+        copy_size = left_size;
+        if (copy_size > src_ring_size - src_idx) {
+            copy_size = src_ring_size - src_idx;
+        }
+        if (copy_size > dst_ring_size - dst->tail_idx) {
+            copy_size = dst_ring_size - dst->tail_idx;
+        }
+        memcpy(SSTM_RING(dst) + dst->tail_idx, SSTM_RING(src) + src_idx, copy_size);
+        src_idx = (src_idx + copy_size) % src_ring_size;
+        dst->tail_idx = (dst->tail_idx + copy_size) % dst_ring_size;
+    }
+
+    sstm_notify(dst, sstm_commit(dst, size));
+
+    /* the data is checked to be there, this only moves
+       the seeking offset and cleans up. */
+    return sstm_do_read(src, NULL, size, cleanup);
+}
+
+/**
+ * @brief move data from one stream to another without a
+ *        temporary buffer.
+ * 
+ * the data is read from the seeking offset of src, as with
+ * sstm_read(), and appended to dst, as with sstm_write(). on any
+ * error neither stream is changed. in SPSC mode the caller acts as
+ * the consumer of src and the producer of dst.
+ * 
+ * @param src the stream to read from.
+ * @param dst the stream to write to.
+ * @param size data size.
+ * @param cleanup whether to clean the stale section of src after read.
+*/
+SSTM_API sstm_res_t sstm_pipe(sstm_ctx_t *src, sstm_ctx_t *dst, sstm_size_t size, sstm_bool_t cleanup) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(pipe, src, size);
+    res = sstm_do_pipe(src, dst, size, cleanup);
+    SSTM_PROBE_EXIT(pipe, src, size, res, dst->cache.used_size);
+
+    return res;
+}
+
+#if SSTM_USE_RECORD
+
+/**
+ * @brief the body of sstm_write_record(), without instrumentation.
+*/
+static sstm_res_t sstm_do_write_record(sstm_ctx_t *ctx, const void *data, sstm_size_t size) {
+    sstm_u32_t hdr;
+    sstm_u64_t pos;
+    sstm_size_t fresh_size;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    if (size > ctx->conf.cap_size - SSTM_REC_HDR_SIZE ||
+        SSTM_LOAD(ctx->cache.free_size) < SSTM_REC_HDR_SIZE + size ||
+        sstm_marks_full(&ctx->rec.marks)) {
+        SSTM_COUNT(ctx, no_space_errs, 1);
+
+        return SSTM_ERR_NO_SPACE;
+    }
+
+#if SSTM_USE_MMAP
+    if (sstm_ring_commit(ctx, SSTM_REC_HDR_SIZE + size) != SSTM_OK) {
+        return SSTM_ERR_NO_MEM;
+    }
+#endif
+
+    /* the header and the payload are committed together,
+       and the record is marked after that, so a marked
+       record is always complete. */
+    hdr = (sstm_u32_t)size;
+    pos = ctx->tail_pos;
+    sstm_copy_in(ctx, &hdr, SSTM_REC_HDR_SIZE);
+    sstm_copy_in(ctx, data, size);
+    fresh_size = sstm_commit(ctx, SSTM_REC_HDR_SIZE + size);
+    sstm_marks_push(&ctx->rec.marks, pos, size);
+    sstm_notify(ctx, fresh_size);
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief write a record to the seekable stream.
+ * 
+ * the record takes SSTM_REC_HDR_SIZE + size bytes of the stream
+ * and one slot of the record index, SSTM_ERR_NO_SPACE is returned
+ * when either is short.
+ * 
+ * @param ctx seekable stream context.
+ * @param data data pointer, when NULL, 0x00 will be written.
+ * @param size data size, can be 0.
+*/
+SSTM_API sstm_res_t sstm_write_record(sstm_ctx_t *ctx, const void *data, sstm_size_t size) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(write_record, ctx, size);
+    res = sstm_do_write_record(ctx, data, size);
+    SSTM_PROBE_EXIT(write_record, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+/**
+ * @brief the body of sstm_read_record(), without instrumentation.
+*/
+static sstm_res_t sstm_do_read_record(sstm_ctx_t *ctx, void *data, sstm_size_t size,
+                                      sstm_size_t *rec_size, sstm_bool_t cleanup) {
+    sstm_marks_t *marks;
+    sstm_mark_t *mark;
+    sstm_size_t payload_size;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    marks = &ctx->rec.marks;
+    if (ctx->rec.seek < marks->head) {
+        ctx->rec.seek = marks->head;
+    }
+
+    /* records are marked once they are complete,
+       so this is the whole availability check. */
+    if (ctx->rec.seek == SSTM_LOAD(marks->tail)) {
+        SSTM_COUNT(ctx, no_data_errs, 1);
+
+        return SSTM_ERR_NO_DATA;
+    }
+
+    /* the seeking offset was moved off the record
+       boundary by sstm_seek() or sstm_read(). */
+    mark = &marks->ring[ctx->rec.seek & marks->mask];
+    if (mark->pos != ctx->head_pos + ctx->seek_offs) {
+        return SSTM_ERR_BAD_OFFS;
+    }
+
+    payload_size = (sstm_size_t)mark->val;
+    if (rec_size != NULL) {
+        *rec_size = payload_size;
+    }
+    if (data != NULL) {
+        if (size < payload_size) {
+            return SSTM_ERR_NO_SPACE;
+        }
+        sstm_copy_out(ctx, ctx->seek_offs + SSTM_REC_HDR_SIZE, data, payload_size);
+    }
+    ctx->rec.seek += 1;
+
+    return sstm_do_read(ctx, NULL, SSTM_REC_HDR_SIZE + payload_size, cleanup);
+}
+
+/**
+ * @brief read the record at the seeking offset.
+ * 
+ * the seeking offset must be at a record boundary, which holds
+ * as long as it is only moved by the record functions, otherwise
+ * SSTM_ERR_BAD_OFFS is returned until sstm_seek_record() is
+ * called.
+ * 
+ * @param ctx seekable stream context.
+ * @param data data pointer, when NULL, the record is skipped.
+ * @param size data size, when smaller than the record,
+ *        SSTM_ERR_NO_SPACE is returned and nothing is read.
+ * @param rec_size the pointer to store the record size, can be NULL.
+ * @param cleanup whether to clean the stale section after read.
+*/
+SSTM_API sstm_res_t sstm_read_record(sstm_ctx_t *ctx, void *data, sstm_size_t size,
+                                     sstm_size_t *rec_size, sstm_bool_t cleanup) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(read_record, ctx, size);
+    res = sstm_do_read_record(ctx, data, size, rec_size, cleanup);
+    SSTM_PROBE_EXIT(read_record, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+/**
+ * @brief the body of sstm_seek_record(), without instrumentation.
+*/
+static sstm_res_t sstm_do_seek_record(sstm_ctx_t *ctx, sstm_size_t rec) {
+    sstm_marks_t *marks;
+    sstm_u64_t pos;
+    sstm_res_t res;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    marks = &ctx->rec.marks;
+    if (rec >= SSTM_LOAD(marks->tail) - marks->head) {
+        return SSTM_ERR_BAD_OFFS;
+    }
+
+    pos = marks->ring[(marks->head + rec) & marks->mask].pos;
+    res = sstm_do_seek(ctx, (sstm_offs_t)(pos - ctx->head_pos), SSTM_SEEK_SET);
+    if (res == SSTM_OK) {
+        ctx->rec.seek = marks->head + rec;
+    }
+
+    return res;
+}
+
+/**
+ * @brief seek to a record.
+ * 
+ * @param ctx seekable stream context.
+ * @param rec the record number, 0 is the first record in the stream.
+*/
+SSTM_API sstm_res_t sstm_seek_record(sstm_ctx_t *ctx, sstm_size_t rec) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(seek_record, ctx, rec);
+    res = sstm_do_seek_record(ctx, rec);
+    SSTM_PROBE_EXIT(seek_record, ctx, rec, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#endif
+
+#if SSTM_USE_TIME
+
+/**
+ * @brief the body of sstm_seek_time(), without instrumentation.
+*/
+static sstm_res_t sstm_do_seek_time(sstm_ctx_t *ctx, sstm_u64_t stamp) {
+    sstm_marks_t *marks;
+    sstm_u64_t low;
+    sstm_u64_t high;
+    sstm_u64_t mid;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    /* find the first timestamp >= stamp, the marks
+       are in write order so their values are sorted. */
+    marks = &ctx->time.marks;
+    low = marks->head;
+    high = SSTM_LOAD(marks->tail);
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (marks->ring[mid & marks->mask].val < stamp) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == SSTM_LOAD(marks->tail)) {
+        return SSTM_ERR_NO_DATA;
+    }
+
+    return sstm_do_seek(ctx, (sstm_offs_t)(marks->ring[low & marks->mask].pos - ctx->head_pos),
+                        SSTM_SEEK_SET);
+}
+
+/**
+ * @brief seek to the first write at or after a point in time.
+ * 
+ * with conf.time_gap > 0 only some writes are timestamped, the
+ * seek then lands on the first timestamped one, which can be up
+ * to time_gap bytes after the first write at or after stamp.
+ * 
+ * @param ctx seekable stream context.
+ * @param stamp CLOCK_MONOTONIC time in nanoseconds.
+*/
+SSTM_API sstm_res_t sstm_seek_time(sstm_ctx_t *ctx, sstm_u64_t stamp) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(seek_time, ctx, stamp);
+    res = sstm_do_seek_time(ctx, stamp);
+    SSTM_PROBE_EXIT(seek_time, ctx, stamp, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#endif
+
+#if SSTM_USE_XFORM
+
+/**
+ * @brief run a transform over one run of data and advance its position.
+*/
+static void sstm_xform_run(sstm_xform_t *xform, void *dst, const void *src, sstm_size_t size) {
+    if (size != 0) {
+        xform->func(xform, dst, src, size);
+        xform->pos += size;
+    }
+}
+
+/**
+ * @brief transform data into the tail of the ring buffer, it is not
+ *        part of the stream until sstm_commit().
+ * 
+ * a unit that straddles the end of the ring buffer is transformed
+ * into a bounce buffer and copied to both ends from there.
+ * 
+ * @param ctx context pointer.
+ * @param data data pointer.
+ * @param size data size, a multiple of xform->unit.
+ * @param xform transform.
+*/
+static void sstm_xform_in(sstm_ctx_t *ctx, const void *data, sstm_size_t size, sstm_xform_t *xform) {
+    sstm_u8_t bounce[SSTM_XFORM_UNIT_MAX];
+    const sstm_u8_t *src = (const sstm_u8_t *)data;
+    sstm_size_t first_copy_size;
+    sstm_size_t split_size;
+    sstm_size_t lead_size;
+
+    first_copy_size = ctx->conf.cap_size + 1 - ctx->tail_idx;
+    if (first_copy_size >= size) {
+        sstm_xform_run(xform, SSTM_RING(ctx) + ctx->tail_idx, src, size);
+        ctx->tail_idx = (ctx->tail_idx + size) % (ctx->conf.cap_size + 1);
+
+        return;
+    }
+
+    /* the whole units before the end of the ring. */
+    split_size = first_copy_size % xform->unit;
+    first_copy_size -= split_size;
+    sstm_xform_run(xform, SSTM_RING(ctx) + ctx->tail_idx, src, first_copy_size);
+    src += first_copy_size;
+    size -= first_copy_size;
+
+    /* the unit across it. */
+    lead_size = 0;
+    if (split_size != 0) {
+        lead_size = xform->unit - split_size;
+        sstm_xform_run(xform, bounce, src, xform->unit);
+        memcpy(SSTM_RING(ctx) + ctx->tail_idx + first_copy_size, bounce, split_size);
+        memcpy(SSTM_RING(ctx), bounce + split_size, lead_size);
+        src += xform->unit;
+        size -= xform->unit;
+    }
+
+    /* the rest after it. */
+    sstm_xform_run(xform, SSTM_RING(ctx) + lead_size, src, size);
+    ctx->tail_idx = lead_size + size;
+    SSTM_COUNT(ctx, write_splits, 1);
+}
+
+/**
+ * @brief transform data out of the used section, the counterpart
+ *        of sstm_xform_in().
+ * 
+ * @param ctx context pointer.
+ * @param offs the offset of data from the head of the stream.
+ * @param data data pointer.
+ * @param size data size, a multiple of xform->unit.
+ * @param xform transform.
+*/
+static void sstm_xform_out(sstm_ctx_t *ctx, sstm_size_t offs, void *data, sstm_size_t size,
+                           sstm_xform_t *xform) {
+    sstm_u8_t bounce[SSTM_XFORM_UNIT_MAX];
+    sstm_u8_t *dst = (sstm_u8_t *)data;
+    sstm_size_t new_head_idx;
+    sstm_size_t first_copy_size;
+    sstm_size_t split_size;
+    sstm_size_t lead_size;
+
+#if SSTM_USE_HOLE || SSTM_USE_REF
+
+    /* the data outside the ring buffer goes through the
+       transform from a copy, a piece at a time. */
+    if (!sstm_ring_only(ctx)) {
+        sstm_u8_t piece[SSTM_XFORM_UNIT_MAX * 16];
+        sstm_size_t piece_size = sizeof(piece) - sizeof(piece) % xform->unit;
+
+        while (size > 0) {
+            if (piece_size > size) {
+                piece_size = size;
+            }
+            sstm_copy_out(ctx, offs, piece, piece_size);
+            sstm_xform_run(xform, dst, piece, piece_size);
+            offs += piece_size;
+            dst += piece_size;
+            size -= piece_size;
+        }
+
+        return;
+    }
+#endif
+
+    new_head_idx = (ctx->head_idx + offs) % (ctx->conf.cap_size + 1);
+    first_copy_size = ctx->conf.cap_size + 1 - new_head_idx;
+    if (first_copy_size >= size) {
+        sstm_xform_run(xform, dst, SSTM_RING(ctx) + new_head_idx, size);
+
+        return;
+    }
+
+    split_size = first_copy_size % xform->unit;
+    first_copy_size -= split_size;
+    sstm_xform_run(xform, dst, SSTM_RING(ctx) + new_head_idx, first_copy_size);
+    dst += first_copy_size;
+    size -= first_copy_size;
+
+    lead_size = 0;
+    if (split_size != 0) {
+        lead_size = xform->unit - split_size;
+        memcpy(bounce, SSTM_RING(ctx) + new_head_idx + first_copy_size, split_size);
+        memcpy(bounce + split_size, SSTM_RING(ctx), lead_size);
+        sstm_xform_run(xform, dst, bounce, xform->unit);
+        dst += xform->unit;
+        size -= xform->unit;
+    }
+
+    sstm_xform_run(xform, dst, SSTM_RING(ctx) + lead_size, size);
+    SSTM_COUNT(ctx, read_splits, 1);
+}
+
+/**
+ * @brief check that a transfer can go through a transform.
+*/
+static sstm_bool_t sstm_xform_ok(const sstm_xform_t *xform, sstm_size_t size) {
+    return xform->func != NULL &&
+           xform->unit != 0 &&
+           xform->unit <= SSTM_XFORM_UNIT_MAX &&
+           size % xform->unit == 0;
+}
+
+/**
+ * @brief the body of sstm_write_xform(), without instrumentation.
+*/
+static sstm_res_t sstm_do_write_xform(sstm_ctx_t *ctx, const void *data, sstm_size_t size,
+                                      sstm_xform_t *xform) {
+    SSTM_ASSERT(ctx != NULL);
+    SSTM_ASSERT(xform != NULL);
+
+    if (!sstm_xform_ok(xform, size)) {
+        return SSTM_ERR;
+    }
+
+    if (size == 0) {
+        return SSTM_OK;
+    }
+
+    SSTM_ASSERT(data != NULL);
+
+    if (SSTM_LOAD(ctx->cache.free_size) < size) {
+        SSTM_COUNT(ctx, no_space_errs, 1);
+
+        return SSTM_ERR_NO_SPACE;
+    }
+
+#if SSTM_USE_MMAP
+    if (sstm_ring_commit(ctx, size) != SSTM_OK) {
+        return SSTM_ERR_NO_MEM;
+    }
+#endif
+
+    sstm_xform_in(ctx, data, size, xform);
+    sstm_notify(ctx, sstm_commit(ctx, size));
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief write data to the seekable stream through a transform,
+ *        which is applied while the data is copied into the ring.
+ * 
+ * the transform stays untouched when SSTM_ERR_NO_SPACE is returned,
+ * so the write can be retried with it.
+ * 
+ * @param ctx seekable stream context.
+ * @param data data pointer.
+ * @param size data size, a multiple of xform->unit.
+ * @param xform transform, see sstm_xform_xor() and its siblings.
+*/
+SSTM_API sstm_res_t sstm_write_xform(sstm_ctx_t *ctx, const void *data, sstm_size_t size,
+                                     sstm_xform_t *xform) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(write_xform, ctx, size);
+    res = sstm_do_write_xform(ctx, data, size, xform);
+    SSTM_PROBE_EXIT(write_xform, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+/**
+ * @brief the body of sstm_read_xform(), without instrumentation.
+*/
+static sstm_res_t sstm_do_read_xform(sstm_ctx_t *ctx, void *data, sstm_size_t size,
+                                     sstm_bool_t cleanup, sstm_xform_t *xform) {
+#if SSTM_USE_SOURCE
+    sstm_res_t res;
+#endif
+
+    SSTM_ASSERT(ctx != NULL);
+    SSTM_ASSERT(xform != NULL);
+
+    if (!sstm_xform_ok(xform, size)) {
+        return SSTM_ERR;
+    }
+
+    if (size == 0) {
+        return SSTM_OK;
+    }
+
+    SSTM_ASSERT(data != NULL);
+
+#if SSTM_USE_SOURCE
+    res = sstm_src_wait(ctx, size);
+    if (res != SSTM_OK) {
+        return res;
+    }
+#endif
+
+    if (SSTM_LOAD(ctx->cache.fresh_size) < size) {
+        SSTM_COUNT(ctx, no_data_errs, 1);
+
+        return SSTM_ERR_NO_DATA;
+    }
+
+    sstm_xform_out(ctx, ctx->seek_offs, data, size, xform);
+    ctx->seek_offs += size;
+    SSTM_COUNT(ctx, read_bytes, size);
+
+    /* update cache. */
+    ctx->cache.stale_size += size;
+    SSTM_SUB(ctx->cache.fresh_size, size);
+
+#if SSTM_USE_EVENTFD
+    sstm_evfd_sync_read(ctx);
+#endif
+#if SSTM_USE_FILE
+    if (ctx->file.mapped) {
+        sstm_file_read(ctx);
+    }
+#endif
+#if SSTM_USE_SOURCE
+    sstm_src_kick(ctx);
+#endif
+
+    if (cleanup) {
+        sstm_do_clean(ctx);
+    }
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief read data from the stream through a transform, which is
+ *        applied while the data is copied out of the ring.
+ * 
+ * @param ctx context pointer.
+ * @param data data pointer.
+ * @param size data size, a multiple of xform->unit.
+ * @param cleanup whether to clean the stale section after read.
+ * @param xform transform, see sstm_xform_xor() and its siblings.
+*/
+SSTM_API sstm_res_t sstm_read_xform(sstm_ctx_t *ctx, void *data, sstm_size_t size,
+                                    sstm_bool_t cleanup, sstm_xform_t *xform) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(read_xform, ctx, size);
+    res = sstm_do_read_xform(ctx, data, size, cleanup, xform);
+    SSTM_PROBE_EXIT(read_xform, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+/**
+ * @brief XOR the data with a 4 byte mask, 8 bytes at a time.
+*/
+static void sstm_xform_xor_func(sstm_xform_t *xform, void *dst, const void *src, sstm_size_t size) {
+    const sstm_u8_t *key = (const sstm_u8_t *)&xform->state;
+    const sstm_u8_t *s = (const sstm_u8_t *)src;
+    sstm_u8_t *d = (sstm_u8_t *)dst;
+    sstm_u8_t mask[8];
+    sstm_u64_t mask_word;
+    sstm_u64_t word;
+    sstm_size_t i;
+
+    /* the key rotated to the phase of the first byte. */
+    for (i = 0; i < sizeof(mask); i++) {
+        mask[i] = key[(xform->pos + i) % 4];
+    }
+    memcpy(&mask_word, mask, sizeof(mask_word));
+
+    for (i = 0; i + 8 <= size; i += 8) {
+        memcpy(&word, s + i, 8);
+        word ^= mask_word;
+        memcpy(d + i, &word, 8);
+    }
+    for (; i < size; i++) {
+        d[i] = s[i] ^ mask[i % 8];
+    }
+}
+
+/**
+ * @brief set up a transform that XORs the data with a repeating 4
+ *        byte mask, e.g. to unmask WebSocket payloads.
+ * 
+ * @param xform transform.
+ * @param key the mask, its bytes in the order they are applied,
+ *        i.e. as loaded from memory.
+*/
+SSTM_API sstm_res_t sstm_xform_xor(sstm_xform_t *xform, sstm_u32_t key) {
+    SSTM_ASSERT(xform != NULL);
+
+    xform->func = sstm_xform_xor_func;
+    xform->unit = 1;
+    xform->pos = 0;
+    xform->state = 0;
+    memcpy(&xform->state, &key, sizeof(key));
+    xform->user = NULL;
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief reverse the byte order of every 2 byte word.
+*/
+static void sstm_xform_bswap16_func(sstm_xform_t *xform, void *dst, const void *src, sstm_size_t size) {
+    const sstm_u8_t *s = (const sstm_u8_t *)src;
+    sstm_u8_t *d = (sstm_u8_t *)dst;
+    sstm_u16_t word;
+    sstm_size_t i;
+
+    (void)xform;
+
+    for (i = 0; i < size; i += 2) {
+        memcpy(&word, s + i, 2);
+        word = __builtin_bswap16(word);
+        memcpy(d + i, &word, 2);
+    }
+}
+
+/**
+ * @brief reverse the byte order of every 4 byte word.
+*/
+static void sstm_xform_bswap32_func(sstm_xform_t *xform, void *dst, const void *src, sstm_size_t size) {
+    const sstm_u8_t *s = (const sstm_u8_t *)src;
+    sstm_u8_t *d = (sstm_u8_t *)dst;
+    sstm_u32_t word;
+    sstm_size_t i;
+
+    (void)xform;
+
+    for (i = 0; i < size; i += 4) {
+        memcpy(&word, s + i, 4);
+        word = __builtin_bswap32(word);
+        memcpy(d + i, &word, 4);
+    }
+}
+
+/**
+ * @brief reverse the byte order of every 8 byte word.
+*/
+static void sstm_xform_bswap64_func(sstm_xform_t *xform, void *dst, const void *src, sstm_size_t size) {
+    const sstm_u8_t *s = (const sstm_u8_t *)src;
+    sstm_u8_t *d = (sstm_u8_t *)dst;
+    sstm_u64_t word;
+    sstm_size_t i;
+
+    (void)xform;
+
+    for (i = 0; i < size; i += 8) {
+        memcpy(&word, s + i, 8);
+        word = __builtin_bswap64(word);
+        memcpy(d + i, &word, 8);
+    }
+}
+
+/**
+ * @brief set up a transform that reverses the byte order of every
+ *        2, 4 or 8 byte word.
+ * 
+ * @param xform transform.
+ * @param width word width in bytes.
+*/
+SSTM_API sstm_res_t sstm_xform_bswap(sstm_xform_t *xform, sstm_size_t width) {
+    SSTM_ASSERT(xform != NULL);
+
+    switch (width) {
+        case 2: xform->func = sstm_xform_bswap16_func; break;
+        case 4: xform->func = sstm_xform_bswap32_func; break;
+        case 8: xform->func = sstm_xform_bswap64_func; break;
+        default: return SSTM_ERR;
+    }
+    xform->unit = width;
+    xform->pos = 0;
+    xform->state = 0;
+    xform->user = NULL;
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief update a CRC-32C while copying, one bit at a time.
+*/
+static sstm_u32_t sstm_crc32c_sw(sstm_u32_t crc, sstm_u8_t *d, const sstm_u8_t *s, sstm_size_t size) {
+    sstm_size_t i;
+    int bit;
+
+    for (i = 0; i < size; i++) {
+        crc ^= s[i];
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+        }
+        d[i] = s[i];
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+/**
+ * @brief update a CRC-32C while copying, with the SSE4.2 crc32
+ *        instruction.
+*/
+__attribute__((target("sse4.2")))
+static sstm_u32_t sstm_crc32c_hw(sstm_u32_t crc, sstm_u8_t *d, const sstm_u8_t *s, sstm_size_t size) {
+    sstm_u64_t word;
+    sstm_size_t i;
+
+    for (i = 0; i + 8 <= size; i += 8) {
+        memcpy(&word, s + i, 8);
+        crc = (sstm_u32_t)__builtin_ia32_crc32di(crc, word);
+        memcpy(d + i, &word, 8);
+    }
+    for (; i < size; i++) {
+        crc = __builtin_ia32_crc32qi(crc, s[i]);
+        d[i] = s[i];
+    }
+
+    return crc;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+/**
+ * @brief update a CRC-32C while copying, with the armv8 crc32c
+ *        instructions.
+*/
+static sstm_u32_t sstm_crc32c_hw(sstm_u32_t crc, sstm_u8_t *d, const sstm_u8_t *s, sstm_size_t size) {
+    sstm_u64_t word;
+    sstm_size_t i;
+
+    for (i = 0; i + 8 <= size; i += 8) {
+        memcpy(&word, s + i, 8);
+        crc = __crc32cd(crc, word);
+        memcpy(d + i, &word, 8);
+    }
+    for (; i < size; i++) {
+        crc = __crc32cb(crc, s[i]);
+        d[i] = s[i];
+    }
+
+    return crc;
+}
+
+#endif
+
+/**
+ * @brief copy the data unchanged and fold it into the running hash.
+*/
+static void sstm_xform_hash_func(sstm_xform_t *xform, void *dst, const void *src, sstm_size_t size) {
+    sstm_u32_t crc = ~(sstm_u32_t)xform->state;
+
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc = sstm_crc32c_hw(crc, (sstm_u8_t *)dst, (const sstm_u8_t *)src, size);
+    } else {
+        crc = sstm_crc32c_sw(crc, (sstm_u8_t *)dst, (const sstm_u8_t *)src, size);
+    }
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    crc = sstm_crc32c_hw(crc, (sstm_u8_t *)dst, (const sstm_u8_t *)src, size);
+#else
+    crc = sstm_crc32c_sw(crc, (sstm_u8_t *)dst, (const sstm_u8_t *)src, size);
+#endif
+    xform->state = ~crc;
+}
+
+/**
+ * @brief set up a transform that copies the data unchanged and keeps
+ *        the CRC-32C of everything it copied in xform->state.
+ * 
+ * @param xform transform.
+*/
+SSTM_API sstm_res_t sstm_xform_hash(sstm_xform_t *xform) {
+    SSTM_ASSERT(xform != NULL);
+
+    xform->func = sstm_xform_hash_func;
+    xform->unit = 1;
+    xform->pos = 0;
+    xform->state = 0;
+    xform->user = NULL;
+
+    return SSTM_OK;
+}
+
+#endif
+
+#if SSTM_USE_SHARD
+
+/* one shard of a set, the writer owns the stream's
+   producer side and the reader the rest. */
+typedef struct _sstm_shard {
+    sstm_ctx_t *ctx;
+
+    /* the header of the entry at the seeking offset,
+       once it has been read. */
+    sstm_bool_t hdr_valid;
+    sstm_u64_t hdr_seq;
+    sstm_u64_t hdr_size;
+} sstm_shard_t;
+
+struct _sstm_shardset {
+
+    /* the next sequence number, taken by every
+       write. it has a cache line to itself, the
+       writers share nothing else. */
+    sstm_u64_t write_seq;
+    sstm_u8_t write_pad[64 - sizeof(sstm_u64_t)];
+
+    /* the remaining fields are owned by the reader. */
+
+    /* the sequence number of the next entry to merge. */
+    sstm_u64_t merge_seq;
+
+    /* the shard the last entry was merged from. */
+    sstm_size_t merge_idx;
+
+    /* the stream the shards are merged into. */
+    sstm_ctx_t *merged;
+
+    sstm_size_t shard_num;
+    sstm_shard_t *shards;
+};
+
+/**
+ * @brief delete a shard set.
+ * 
+ * @param set shard set, with any of its streams missing.
+*/
+SSTM_API sstm_res_t sstm_shardset_del(sstm_shardset_t *set) {
+    sstm_size_t i;
+
+    SSTM_ASSERT(set != NULL);
+
+    if (set->shards != NULL) {
+        for (i = 0; i < set->shard_num; i++) {
+            if (set->shards[i].ctx != NULL) {
+                sstm_del(set->shards[i].ctx);
+            }
+        }
+        free(set->shards);
+    }
+    if (set->merged != NULL) {
+        sstm_del(set->merged);
+    }
+    free(set);
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief create a shard set.
+ * 
+ * every shard and the merged stream are created with conf, so an
+ * entry of up to cap_size - SSTM_SHARD_HDR_SIZE bytes can be written.
+ * 
+ * @param set pointer to the shard set pointer.
+ * @param conf configuration of every stream in the set.
+ * @param shard_num the number of shards, e.g. one per cpu.
+*/
+SSTM_API sstm_res_t sstm_shardset_new(sstm_shardset_t **set, sstm_conf_t *conf, sstm_size_t shard_num) {
+    sstm_shardset_t *new_set;
+    sstm_res_t res;
+    sstm_size_t i;
+
+    SSTM_ASSERT(set != NULL);
+
+    if (shard_num == 0) {
+        return SSTM_ERR;
+    }
+
+    new_set = (sstm_shardset_t *)calloc(1, sizeof(sstm_shardset_t));
+    if (new_set == NULL) {
+        return SSTM_ERR_NO_MEM;
+    }
+
+    new_set->shard_num = shard_num;
+    new_set->shards = (sstm_shard_t *)calloc(shard_num, sizeof(sstm_shard_t));
+    if (new_set->shards == NULL) {
+        sstm_shardset_del(new_set);
+
+        return SSTM_ERR_NO_MEM;
+    }
+
+    res = sstm_do_new(&new_set->merged, conf);
+    for (i = 0; i < shard_num && res == SSTM_OK; i++) {
+        res = sstm_do_new(&new_set->shards[i].ctx, conf);
+    }
+    if (res != SSTM_OK) {
+        sstm_shardset_del(new_set);
+
+        return res;
+    }
+
+    *set = new_set;
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief get the stream the shards are merged into.
+ * 
+ * the reader reads, seeks and cleans it with the usual functions,
+ * it must not be written.
+ * 
+ * @param set shard set.
+ * @param ctx pointer to the context pointer.
+*/
+SSTM_API sstm_res_t sstm_shardset_ctx(sstm_shardset_t *set, sstm_ctx_t **ctx) {
+    SSTM_ASSERT(set != NULL);
+    SSTM_ASSERT(ctx != NULL);
+
+    *ctx = set->merged;
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief the body of sstm_shardset_write(), without instrumentation.
+*/
+static sstm_res_t sstm_do_shardset_write(sstm_shardset_t *set, sstm_size_t shard,
+                                         const void *data, sstm_size_t size) {
+    sstm_u8_t hdr[SSTM_SHARD_HDR_SIZE];
+    sstm_size_t free_size;
+    sstm_ctx_t *ctx;
+    sstm_u64_t seq;
+    sstm_u64_t hdr_size;
+
+    SSTM_ASSERT(set != NULL);
+
+    if (shard >= set->shard_num) {
+        return SSTM_ERR;
+    }
+    ctx = set->shards[shard].ctx;
+
+    /* the writer is the only one to use up the free space,
+       so once it is checked the write cannot fail and leave
+       a hole in the sequence for the reader to wait on. */
+    free_size = SSTM_LOAD(ctx->cache.free_size);
+    if (free_size < SSTM_SHARD_HDR_SIZE || free_size - SSTM_SHARD_HDR_SIZE < size) {
+        SSTM_COUNT(ctx, no_space_errs, 1);
+
+        return SSTM_ERR_NO_SPACE;
+    }
+
+#if SSTM_USE_MMAP
+    if (sstm_ring_commit(ctx, SSTM_SHARD_HDR_SIZE + size) != SSTM_OK) {
+        return SSTM_ERR_NO_MEM;
+    }
+#endif
+
+    seq = __atomic_fetch_add(&set->write_seq, 1, __ATOMIC_RELAXED);
+    hdr_size = size;
+    memcpy(hdr, &seq, sizeof(seq));
+    memcpy(hdr + sizeof(seq), &hdr_size, sizeof(hdr_size));
+
+    /* one commit for both, so the reader never
+       sees a header without its data. */
+    sstm_copy_in(ctx, hdr, SSTM_SHARD_HDR_SIZE);
+    sstm_copy_in(ctx, data, size);
+    sstm_notify(ctx, sstm_commit(ctx, SSTM_SHARD_HDR_SIZE + size));
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief write an entry to one shard of the set.
+ * 
+ * every shard must have a single writer at a time, e.g. the worker
+ * thread with that index. the entry is tagged with the next sequence
+ * number of the set, which is the order it is merged in.
+ * 
+ * @param set shard set.
+ * @param shard shard index.
+ * @param data data pointer, when NULL, 0x00 will be written.
+ * @param size data size, can be 0.
+*/
+SSTM_API sstm_res_t sstm_shardset_write(sstm_shardset_t *set, sstm_size_t shard,
+                                        const void *data, sstm_size_t size) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(shardset_write, set, size);
+    res = sstm_do_shardset_write(set, shard, data, size);
+    SSTM_PROBE_EXIT(shardset_write, set, size, res, 0);
+
+    return res;
+}
+
+/**
+ * @brief read the header of the next entry of a shard, if needed.
+ * 
+ * @return whether the shard has an entry.
+*/
+static sstm_bool_t sstm_shard_peek(sstm_shard_t *shard) {
+    sstm_u8_t hdr[SSTM_SHARD_HDR_SIZE];
+
+    if (shard->hdr_valid) {
+        return 1;
+    }
+
+    /* the entry is committed as a whole, the header
+       being there means the data is there too. */
+    if (sstm_do_read(shard->ctx, hdr, SSTM_SHARD_HDR_SIZE, 0) != SSTM_OK) {
+        return 0;
+    }
+    memcpy(&shard->hdr_seq, hdr, sizeof(shard->hdr_seq));
+    memcpy(&shard->hdr_size, hdr + sizeof(shard->hdr_seq), sizeof(shard->hdr_size));
+    shard->hdr_valid = 1;
+
+    return 1;
+}
+
+/**
+ * @brief the body of sstm_shardset_merge(), without instrumentation.
+*/
+static sstm_res_t sstm_do_shardset_merge(sstm_shardset_t *set, sstm_size_t *size) {
+    sstm_shard_t *shard;
+    sstm_size_t merge_size;
+    sstm_size_t idx;
+    sstm_size_t i;
+    sstm_res_t res;
+
+    SSTM_ASSERT(set != NULL);
+
+    merge_size = 0;
+    res = SSTM_OK;
+    while (res == SSTM_OK) {
+
+        /* the sequence numbers of a shard only go up, so the
+           next one can only be at the head of some shard.
+           entries tend to come in runs from the same writer,
+           the search starts at the last shard. */
+        shard = NULL;
+        for (i = 0; i < set->shard_num; i++) {
+            idx = (set->merge_idx + i) % set->shard_num;
+            if (sstm_shard_peek(&set->shards[idx]) &&
+                set->shards[idx].hdr_seq == set->merge_seq) {
+                shard = &set->shards[idx];
+                set->merge_idx = idx;
+                break;
+            }
+        }
+
+        /* the next entry is not written yet, even though
+           later ones can be. */
+        if (shard == NULL) {
+            break;
+        }
+
+        if (shard->hdr_size == 0) {
+            res = sstm_do_clean(shard->ctx);
+        } else {
+            res = sstm_do_pipe(shard->ctx, set->merged, (sstm_size_t)shard->hdr_size, 1);
+        }
+        if (res == SSTM_OK) {
+            merge_size += (sstm_size_t)shard->hdr_size;
+            shard->hdr_valid = 0;
+            set->merge_seq += 1;
+        }
+    }
+
+    if (size != NULL) {
+        *size = merge_size;
+    }
+
+    return res;
+}
+
+/**
+ * @brief append the written entries to the merged stream, in the
+ *        order of their sequence numbers.
+ * 
+ * the merge stops at the first entry that is not written yet, and
+ * returns SSTM_ERR_NO_SPACE when it stops because the merged stream
+ * is full. only the data of the entries is merged, not the headers.
+ * it must be called from the reader.
+ * 
+ * @param set shard set.
+ * @param size the size of data merged, can be NULL.
+*/
+SSTM_API sstm_res_t sstm_shardset_merge(sstm_shardset_t *set, sstm_size_t *size) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(shardset_merge, set, 0);
+    res = sstm_do_shardset_merge(set, size);
+    SSTM_PROBE_EXIT(shardset_merge, set, 0, res, set->merged->cache.used_size);
+
+    return res;
+}
+
+#endif
+
+#if SSTM_USE_SHM
+
+/* "SSTM" and the layout version of the shared context. */
+#define SSTM_SHM_MAGIC          0x4d545353u
+
+/**
+ * @brief check whether a process is still alive.
+ * 
+ * a pid can be reused once the process is gone, so a dead peer is
+ * only noticed until the pid is taken again.
+*/
+static sstm_bool_t sstm_shm_alive(sstm_s32_t pid) {
+    return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+/**
+ * @brief take a role of a shared stream, from a dead process if
+ *        needed.
+*/
+static sstm_res_t sstm_shm_claim(sstm_ctx_t *ctx, sstm_u32_t role) {
+    sstm_s32_t self = (sstm_s32_t)getpid();
+    sstm_s32_t pid;
+
+    pid = __atomic_load_n(&ctx->shm.pid[role], __ATOMIC_ACQUIRE);
+    do {
+        if (pid != 0 && pid != self && sstm_shm_alive(pid)) {
+            return SSTM_ERR_BUSY;
+        }
+    } while (!__atomic_compare_exchange_n(&ctx->shm.pid[role], &pid, self, 0,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    /* a dead producer can have copied data it never
+       committed, tail_pos is only moved by a commit. */
+    if (pid != 0 && pid != self && role == SSTM_SHM_PRODUCER) {
+        ctx->tail_idx = (sstm_size_t)(ctx->tail_pos % (ctx->conf.cap_size + 1));
+    }
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief create a stream in shared memory and take one of its roles.
+ * 
+ * the context and the ring buffer are placed in one shared mapping
+ * of fd, which the other process passes to sstm_shm_attach(). both
+ * must be built with the same SSTM_USE_* options.
+ * 
+ * @param ctx the pointer pointing to a context pointer.
+ * @param conf configuration pointer.
+ * @param fd an empty file from shm_open() or memfd_create(), it
+ *        is resized but not closed.
+ * @param role SSTM_SHM_PRODUCER or SSTM_SHM_CONSUMER.
+*/
+SSTM_API sstm_res_t sstm_shm_new(sstm_ctx_t **ctx, sstm_conf_t *conf, int fd, sstm_u32_t role) {
+    sstm_size_t cap_size;
+    sstm_size_t alloc_size;
+    size_t ring_offs;
+    size_t map_size;
+    struct stat st;
+    sstm_ctx_t *new_ctx;
+    void *ptr;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    if (role != SSTM_SHM_PRODUCER && role != SSTM_SHM_CONSUMER) {
+        return SSTM_ERR;
+    }
+
+    /* a file that is already in use by a stream would be
+       wiped under the processes attached to it. */
+    if (fstat(fd, &st) != 0 || st.st_size != 0) {
+        return SSTM_ERR;
+    }
+
+    cap_size = sstm_conf_cap_size(conf);
+    alloc_size = sstm_alloc_size(cap_size);
+    ring_offs = (sizeof(sstm_ctx_t) + 63) & ~(size_t)63;
+    map_size = ring_offs + alloc_size;
+    if (ftruncate(fd, (off_t)map_size) != 0) {
+        return SSTM_ERR_NO_MEM;
+    }
+
+    ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return SSTM_ERR_NO_MEM;
+    }
+
+    new_ctx = (sstm_ctx_t *)ptr;
+    SSTM_RING_SET(new_ctx, (sstm_u8_t *)ptr + ring_offs);
+    sstm_ctx_init(new_ctx, cap_size, alloc_size);
+    new_ctx->shm.layout = sizeof(sstm_ctx_t);
+    new_ctx->shm.map_size = map_size;
+    new_ctx->shm.pid[role] = (sstm_s32_t)getpid();
+
+    /* last, an attach only trusts a context with the magic. */
+    __atomic_store_n(&new_ctx->shm.magic, SSTM_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    *ctx = new_ctx;
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief attach to a stream created by sstm_shm_new() and take one
+ *        of its roles.
+ * 
+ * a role held by a live process is not given out. a role whose
+ * process has died is taken over along with the state it left,
+ * except that a new producer drops whatever the old one copied but
+ * did not commit. a peer that died in the middle of a call can still
+ * leave that call half done.
+ * 
+ * @param ctx the pointer pointing to a context pointer.
+ * @param fd the file passed to sstm_shm_new(), it is not closed.
+ * @param role SSTM_SHM_PRODUCER or SSTM_SHM_CONSUMER.
+ * @return SSTM_ERR_BUSY if the role is held by a live process.
+*/
+SSTM_API sstm_res_t sstm_shm_attach(sstm_ctx_t **ctx, int fd, sstm_u32_t role) {
+    struct stat st;
+    sstm_ctx_t *new_ctx;
+    sstm_res_t res;
+    void *ptr;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    if (role != SSTM_SHM_PRODUCER && role != SSTM_SHM_CONSUMER) {
+        return SSTM_ERR;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(sstm_ctx_t)) {
+        return SSTM_ERR;
+    }
+
+    ptr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return SSTM_ERR_NO_MEM;
+    }
+
+    new_ctx = (sstm_ctx_t *)ptr;
+    if (__atomic_load_n(&new_ctx->shm.magic, __ATOMIC_ACQUIRE) != SSTM_SHM_MAGIC ||
+        new_ctx->shm.layout != sizeof(sstm_ctx_t) ||
+        new_ctx->shm.map_size != (sstm_u64_t)st.st_size) {
+        munmap(ptr, (size_t)st.st_size);
+
+        return SSTM_ERR;
+    }
+
+    res = sstm_shm_claim(new_ctx, role);
+    if (res != SSTM_OK) {
+        munmap(ptr, (size_t)st.st_size);
+
+        return res;
+    }
+
+    *ctx = new_ctx;
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief give up the roles of the current process and unmap a shared
+ *        stream, the stream itself stays for the other process.
+ * 
+ * @param ctx context pointer.
 */
-sstm_res_t sstm_seek(sstm_ctx_t *ctx, sstm_offs_t offset, sstm_whence_t whence) {
-    sstm_offs_t abs_offs;
+SSTM_API sstm_res_t sstm_shm_detach(sstm_ctx_t *ctx) {
+    sstm_s32_t self = (sstm_s32_t)getpid();
+    sstm_s32_t pid;
+    sstm_u32_t role;
 
     SSTM_ASSERT(ctx != NULL);
-    SSTM_ASSERT(whence == SSTM_SEEK_SET ||
-                whence == SSTM_SEEK_CUR ||
-                whence == SSTM_SEEK_END);
 
-    /* calculate the absolute offset. */
-    switch (whence) {
-        case SSTM_SEEK_SET: abs_offs = offset; break;
-        case SSTM_SEEK_CUR: abs_offs = (sstm_offs_t)ctx->seek_offs + offset; break;
-        case SSTM_SEEK_END: abs_offs = (sstm_offs_t)ctx->cache.used_size + offset; break;
+    if (ctx->shm.magic != SSTM_SHM_MAGIC) {
+        return SSTM_ERR;
     }
 
-    /* check offset. */
-    if (abs_offs < 0) {
-        return SSTM_ERR_BAD_OFFS;
+    for (role = SSTM_SHM_PRODUCER; role <= SSTM_SHM_CONSUMER; role++) {
+        pid = self;
+        __atomic_compare_exchange_n(&ctx->shm.pid[role], &pid, 0, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
     }
-    if ((sstm_size_t)abs_offs > ctx->cache.used_size) {
-        return SSTM_ERR_BAD_OFFS;
+    munmap(ctx, (size_t)ctx->shm.map_size);
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief check that the other side of a shared stream is attached
+ *        and alive.
+ * 
+ * a consumer that waits for data with sstm_read_wait() should use a
+ * timeout and check its producer with this between the waits, and
+ * the other way around.
+ * 
+ * @param ctx context pointer.
+ * @return SSTM_ERR_NO_PEER if the other role is free, or held by a
+ *         process that has died.
+*/
+SSTM_API sstm_res_t sstm_shm_peer(sstm_ctx_t *ctx) {
+    sstm_s32_t self = (sstm_s32_t)getpid();
+    sstm_s32_t pid;
+    sstm_u32_t role;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    if (ctx->shm.magic != SSTM_SHM_MAGIC) {
+        return SSTM_ERR;
+    }
+
+    for (role = SSTM_SHM_PRODUCER; role <= SSTM_SHM_CONSUMER; role++) {
+        pid = __atomic_load_n(&ctx->shm.pid[role], __ATOMIC_ACQUIRE);
+        if (pid == self) {
+            continue;
+        }
+        if (pid == 0 || !sstm_shm_alive(pid)) {
+            return SSTM_ERR_NO_PEER;
+        }
+    }
+
+    return SSTM_OK;
+}
+
+#endif
+
+#if SSTM_USE_DUP
+
+/**
+ * @brief write the data of a stream from a position up to tail_pos
+ *        to a ring buffer file, the data before head_pos is skipped.
+*/
+static sstm_res_t sstm_dup_sync(sstm_ctx_t *ctx, int fd, sstm_u64_t pos) {
+    sstm_size_t ring_size = ctx->conf.cap_size + 1;
+    sstm_size_t offs;
+    sstm_size_t size;
+    sstm_size_t part;
+    ssize_t len;
+
+    if (pos < ctx->head_pos) {
+        pos = ctx->head_pos;
+    }
+    offs = (sstm_size_t)(pos % ring_size);
+    size = (sstm_size_t)(ctx->tail_pos - pos);
+    while (size > 0) {
+        part = ring_size - offs < size ? ring_size - offs : size;
+        len = pwrite(fd, SSTM_RING(ctx) + offs, part, (off_t)offs);
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            return SSTM_ERR;
+        }
+        offs = (sstm_size_t)((offs + (sstm_size_t)len) % ring_size);
+        size -= (sstm_size_t)len;
+    }
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief give a clone its own copy of the per-context state that is
+ *        not part of the stream data.
+*/
+static sstm_res_t sstm_dup_ctx(sstm_ctx_t *clone, const sstm_ctx_t *ctx) {
+    *clone = *ctx;
+#if SSTM_USE_RECORD
+    if (sstm_marks_dup(&clone->rec.marks, &ctx->rec.marks) != SSTM_OK) {
+        return SSTM_ERR_NO_MEM;
     }
-    if ((sstm_size_t)abs_offs == ctx->seek_offs) {
+#endif
+#if SSTM_USE_TIME
+    if (sstm_marks_dup(&clone->time.marks, &ctx->time.marks) != SSTM_OK) {
+#if SSTM_USE_RECORD
+        free(clone->rec.marks.ring);
+#endif
+        return SSTM_ERR_NO_MEM;
+    }
+#endif
+#if SSTM_USE_HOLE
+    if (sstm_marks_dup(&clone->hole.marks, &ctx->hole.marks) != SSTM_OK) {
+#if SSTM_USE_RECORD
+        free(clone->rec.marks.ring);
+#endif
+#if SSTM_USE_TIME
+        free(clone->time.marks.ring);
+#endif
+        return SSTM_ERR_NO_MEM;
+    }
+#endif
+#if SSTM_USE_REF
+
+    /* the stream has no refs, see sstm_do_dup(). */
+    if (sstm_ref_init(clone, (sstm_size_t)(ctx->ref.mask + 1)) != SSTM_OK) {
+#if SSTM_USE_RECORD
+        free(clone->rec.marks.ring);
+#endif
+#if SSTM_USE_TIME
+        free(clone->time.marks.ring);
+#endif
+#if SSTM_USE_HOLE
+        free(clone->hole.marks.ring);
+#endif
+        return SSTM_ERR_NO_MEM;
+    }
+    clone->ref.head = ctx->ref.tail;
+    clone->ref.tail = ctx->ref.tail;
+#if SSTM_USE_SPSC
+    clone->ref.retired = ctx->ref.tail;
+#endif
+#endif
+#if SSTM_USE_WAIT
+    clone->wait.read_want = 0;
+    clone->wait.write_want = 0;
+    clone->wait.read_seq = 0;
+    clone->wait.write_seq = 0;
+#endif
+#if SSTM_USE_EVENTFD
+    clone->evfd.read_fd = -1;
+    clone->evfd.write_fd = -1;
+    clone->evfd.read_ready = 0;
+    clone->evfd.write_ready = 0;
+    clone->evfd.read_lock = 0;
+    clone->evfd.write_lock = 0;
+#endif
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief free what sstm_dup_ctx() allocated for a clone.
+*/
+static void sstm_dup_ctx_free(sstm_ctx_t *clone) {
+#if SSTM_USE_RECORD
+    free(clone->rec.marks.ring);
+#endif
+#if SSTM_USE_TIME
+    free(clone->time.marks.ring);
+#endif
+#if SSTM_USE_HOLE
+    free(clone->hole.marks.ring);
+#endif
+#if SSTM_USE_REF
+    free(clone->ref.ring);
+#endif
+    (void)clone;
+}
+
+/**
+ * @brief clone a stream whose ring buffer is on the heap, by copying
+ *        it.
+*/
+static sstm_res_t sstm_dup_copy(sstm_ctx_t *ctx, sstm_ctx_t *clone) {
+    sstm_u8_t *ring;
+
+    ring = (sstm_u8_t *)malloc(ctx->cache.alloc_size);
+    if (ring == NULL) {
+        return SSTM_ERR_NO_MEM;
+    }
+    memcpy(ring, SSTM_RING(ctx), ctx->cache.alloc_size);
+    SSTM_RING_SET(clone, ring);
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief the body of sstm_dup(), without instrumentation.
+*/
+static sstm_res_t sstm_do_dup(sstm_ctx_t *ctx, sstm_ctx_t **clone) {
+    sstm_dup_file_t *file = ctx->dup.file;
+    sstm_dup_file_t *new_file = NULL;
+    sstm_ctx_t *new_ctx;
+    sstm_u8_t *ring;
+    sstm_res_t res;
+
+    SSTM_ASSERT(ctx != NULL);
+    SSTM_ASSERT(clone != NULL);
+
+#if SSTM_USE_REF
+
+    /* a ref is released once, by the one stream that
+       holds it. */
+    if (ctx->ref.head != ctx->ref.tail) {
+        return SSTM_ERR;
+    }
+#endif
+#if SSTM_USE_FILE
+    if (ctx->file.mapped) {
+        return SSTM_ERR;
+    }
+#endif
+#if SSTM_USE_SOURCE
+    if (ctx->src.func != NULL) {
+        return SSTM_ERR;
+    }
+#endif
+
+    new_ctx = (sstm_ctx_t *)malloc(sizeof(sstm_ctx_t));
+    if (new_ctx == NULL) {
+        return SSTM_ERR_NO_MEM;
+    }
+    res = sstm_dup_ctx(new_ctx, ctx);
+    if (res != SSTM_OK) {
+        free(new_ctx);
+
+        return res;
+    }
+
+    if (file == NULL) {
+        res = sstm_dup_copy(ctx, new_ctx);
+        if (res != SSTM_OK) {
+            goto fail;
+        }
+
+        *clone = new_ctx;
+
         return SSTM_OK;
     }
 
-    /* update cache. */
-    ctx->seek_offs = (sstm_size_t)abs_offs;
-    ctx->cache.stale_size = (sstm_size_t)abs_offs;
-    ctx->cache.fresh_size = ctx->cache.used_size - ctx->cache.stale_size;
+    /* bring the file up to date. a private mapping only
+       differs from its file where it was written since
+       base_pos, unless the file is mapped by older clones,
+       which must keep seeing it as it is. */
+    if (!ctx->dup.shared) {
+        if (__atomic_load_n(&file->refs, __ATOMIC_ACQUIRE) == 1) {
+            res = sstm_dup_sync(ctx, file->fd, ctx->dup.base_pos);
+        } else {
+            new_file = sstm_dup_file_new(ctx->dup.map_size);
+            if (new_file == NULL) {
+                res = SSTM_ERR_NO_MEM;
+                goto fail;
+            }
+            res = sstm_dup_sync(ctx, new_file->fd, ctx->head_pos);
+            file = new_file;
+        }
+        if (res != SSTM_OK) {
+            goto fail;
+        }
+    }
+
+    ring = (sstm_u8_t *)mmap(NULL, ctx->dup.map_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE, file->fd, 0);
+    if (ring == (sstm_u8_t *)MAP_FAILED) {
+        res = SSTM_ERR_NO_MEM;
+        goto fail;
+    }
+
+    /* the file is frozen from now on, so ctx maps it privately
+       as well, in place. its content does not change. */
+    if (ctx->dup.shared || new_file != NULL) {
+        if (mmap(SSTM_RING(ctx), ctx->dup.map_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_FIXED, file->fd, 0) == MAP_FAILED) {
+            munmap(ring, ctx->dup.map_size);
+            res = SSTM_ERR_NO_MEM;
+            goto fail;
+        }
+    }
+    if (new_file != NULL) {
+        sstm_dup_file_put(ctx->dup.file);
+        ctx->dup.file = new_file;
+    }
+    __atomic_add_fetch(&file->refs, 1, __ATOMIC_ACQ_REL);
+    ctx->dup.shared = 0;
+    ctx->dup.base_pos = ctx->tail_pos;
+
+    SSTM_RING_SET(new_ctx, ring);
+    new_ctx->dup.file = file;
+    new_ctx->dup.shared = 0;
+    new_ctx->dup.base_pos = ctx->tail_pos;
+
+    *clone = new_ctx;
+
+    return SSTM_OK;
+
+fail:
+    if (new_file != NULL) {
+        sstm_dup_file_put(new_file);
+    }
+    sstm_dup_ctx_free(new_ctx);
+    free(new_ctx);
+
+    return res;
+}
+
+/**
+ * @brief clone a seekable stream.
+ * 
+ * the clone has the data, the positions and the seeking offset of
+ * ctx, and is then used and deleted on its own. the two share the
+ * pages of the ring buffer copy-on-write, so that the clone takes no
+ * copy when ctx has not been written since it was created or last
+ * cloned. otherwise what was written since is synced to the shared
+ * file, or the used data if an older clone still maps it. neither
+ * side of ctx may run during the call.
+ * 
+ * @param ctx context pointer.
+ * @param clone the pointer pointing to a context pointer.
+*/
+SSTM_API sstm_res_t sstm_dup(sstm_ctx_t *ctx, sstm_ctx_t **clone) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(dup, ctx, ctx->conf.cap_size);
+    res = sstm_do_dup(ctx, clone);
+    SSTM_PROBE_EXIT(dup, res == SSTM_OK ? *clone : NULL,
+                    ctx->conf.cap_size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#endif
+
+#if SSTM_USE_WAIT
+
+/**
+ * @brief wait until enough fresh data is in the stream.
+ * 
+ * @param ctx seekable stream context.
+ * @param size the fresh size to wait for.
+ * @param timeout timeout in milliseconds, negative for infinite.
+*/
+SSTM_API sstm_res_t sstm_read_wait(sstm_ctx_t *ctx, sstm_size_t size, sstm_s32_t timeout) {
+    sstm_res_t res;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    SSTM_PROBE_ENTRY(read_wait, ctx, size);
+
+    if (size > ctx->conf.cap_size) {
+        res = SSTM_ERR_NO_DATA;
+    } else {
+        res = sstm_wait(&ctx->cache.fresh_size, &ctx->wait.read_want,
+                        &ctx->wait.read_seq, size, timeout);
+    }
+
+    SSTM_PROBE_EXIT(read_wait, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+/**
+ * @brief wait until enough free space is in the stream.
+ * 
+ * @param ctx seekable stream context.
+ * @param size the free size to wait for.
+ * @param timeout timeout in milliseconds, negative for infinite.
+*/
+SSTM_API sstm_res_t sstm_write_wait(sstm_ctx_t *ctx, sstm_size_t size, sstm_s32_t timeout) {
+    sstm_res_t res;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    SSTM_PROBE_ENTRY(write_wait, ctx, size);
+
+    if (size > ctx->conf.cap_size) {
+        res = SSTM_ERR_NO_SPACE;
+    } else {
+        res = sstm_wait(&ctx->cache.free_size, &ctx->wait.write_want,
+                        &ctx->wait.write_seq, size, timeout);
+    }
+
+    SSTM_PROBE_EXIT(write_wait, ctx, size, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#endif
+
+#if SSTM_USE_EVENTFD
+
+/**
+ * @brief the body of sstm_evfd(), without instrumentation.
+*/
+static sstm_res_t sstm_do_evfd(sstm_ctx_t *ctx, sstm_size_t read_lowat, sstm_size_t write_hiwat,
+                               int *read_fd, int *write_fd) {
+    SSTM_ASSERT(ctx != NULL);
+
+    if (ctx->evfd.read_fd < 0) {
+        ctx->evfd.read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ctx->evfd.read_fd < 0) {
+            return SSTM_ERR;
+        }
+        ctx->evfd.write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ctx->evfd.write_fd < 0) {
+            close(ctx->evfd.read_fd);
+            ctx->evfd.read_fd = -1;
+
+            return SSTM_ERR;
+        }
+    }
+
+    /* clamp the watermarks to what can be reached. */
+    if (read_lowat == 0) {
+        read_lowat = 1;
+    } else if (read_lowat > ctx->conf.cap_size) {
+        read_lowat = ctx->conf.cap_size;
+    }
+    if (write_hiwat == 0) {
+        write_hiwat = 1;
+    } else if (write_hiwat > ctx->conf.cap_size) {
+        write_hiwat = ctx->conf.cap_size;
+    }
+    ctx->evfd.read_lowat = read_lowat;
+    ctx->evfd.write_hiwat = write_hiwat;
+
+    sstm_evfd_sync_read(ctx);
+    sstm_evfd_sync_write(ctx);
+
+    if (read_fd != NULL) {
+        *read_fd = ctx->evfd.read_fd;
+    }
+    if (write_fd != NULL) {
+        *write_fd = ctx->evfd.write_fd;
+    }
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief get the eventfds that signal the readiness of the stream.
+ * 
+ * the eventfds are created on the first call and closed by
+ * sstm_del(), later calls only change the watermarks. both are
+ * level triggered and become readable (EPOLLIN) when:
+ * 
+ * - read_fd: fresh size >= read_lowat.
+ * - write_fd: free size >= write_hiwat.
+ * 
+ * they are only written when a watermark is crossed, not on every
+ * operation. call it before the stream is shared between threads.
+ * 
+ * @param ctx seekable stream context.
+ * @param read_lowat the low watermark of fresh size, 0 means 1.
+ * @param write_hiwat the high watermark of free size, 0 means 1.
+ * @param read_fd the pointer to store the read eventfd, can be NULL.
+ * @param write_fd the pointer to store the write eventfd, can be NULL.
+*/
+SSTM_API sstm_res_t sstm_evfd(sstm_ctx_t *ctx, sstm_size_t read_lowat, sstm_size_t write_hiwat,
+                              int *read_fd, int *write_fd) {
+    sstm_res_t res;
+
+    SSTM_PROBE_ENTRY(evfd, ctx, read_lowat);
+    res = sstm_do_evfd(ctx, read_lowat, write_hiwat, read_fd, write_fd);
+    SSTM_PROBE_EXIT(evfd, ctx, read_lowat, res, ctx->cache.used_size);
+
+    return res;
+}
+
+#endif
+
+#if SSTM_USE_HIST
+
+/**
+ * @brief take a snapshot of the histogram of an operation.
+ * 
+ * @param ctx seekable stream context.
+ * @param op the operation.
+ * @param hist the histogram pointer to fill.
+*/
+SSTM_API sstm_res_t sstm_hist(sstm_ctx_t *ctx, sstm_op_t op, sstm_hist_t *hist) {
+    SSTM_ASSERT(ctx != NULL);
+    SSTM_ASSERT(hist != NULL);
+
+    if (op < 0 || op >= SSTM_OP_NUM) {
+        return SSTM_ERR;
+    }
+
+    memcpy(hist, &ctx->hist[op], sizeof(*hist));
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief clear the histograms of all operations.
+ * 
+ * @param ctx seekable stream context.
+*/
+SSTM_API sstm_res_t sstm_hist_clear(sstm_ctx_t *ctx) {
+    sstm_size_t i;
+
+    SSTM_ASSERT(ctx != NULL);
+
+    for (i = 0; i < SSTM_OP_NUM; i++) {
+        sstm_hist_init(&ctx->hist[i]);
+    }
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief merge a histogram into another one, e.g. to combine the
+ *        snapshots of several streams.
+ * 
+ * @param dst the histogram to merge into, zero it to start.
+ * @param src the histogram to merge.
+*/
+SSTM_API sstm_res_t sstm_hist_merge(sstm_hist_t *dst, const sstm_hist_t *src) {
+    sstm_size_t i;
+
+    SSTM_ASSERT(dst != NULL);
+    SSTM_ASSERT(src != NULL);
+
+    if (src->count == 0) {
+        return SSTM_OK;
+    }
+
+    if (dst->count == 0 || src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    for (i = 0; i < SSTM_HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+
+    return SSTM_OK;
+}
+
+/**
+ * @brief get the value at a percentile of a histogram.
+ * 
+ * the value is the highest one of its bucket, capped by the
+ * recorded maximum.
+ * 
+ * @param hist histogram pointer.
+ * @param pct the percentile in [0, 1], e.g. 0.999.
+ * @param value the pointer to store the value in cycles.
+*/
+SSTM_API sstm_res_t sstm_hist_pct(const sstm_hist_t *hist, double pct, sstm_u64_t *value) {
+    sstm_u64_t rank;
+    sstm_u64_t seen;
+    sstm_size_t i;
+
+    SSTM_ASSERT(hist != NULL);
+    SSTM_ASSERT(value != NULL);
+
+    if (hist->count == 0) {
+        return SSTM_ERR_NO_DATA;
+    }
+
+    /* the rank of the value, 1 based. */
+    rank = (sstm_u64_t)(pct * (double)hist->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > hist->count) {
+        rank = hist->count;
+    }
+
+    seen = 0;
+    for (i = 0; i < SSTM_HIST_BUCKETS - 1; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    *value = i == SSTM_HIST_BUCKETS - 1 ? hist->max : sstm_hist_low(i + 1) - 1;
+    if (*value > hist->max) {
+        *value = hist->max;
+    }
 
     return SSTM_OK;
 }
+
+#endif
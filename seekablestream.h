@@ -28,6 +28,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* basic data types. */
 typedef int8_t              sstm_s8_t;
 typedef uint8_t             sstm_u8_t;
@@ -38,6 +42,9 @@ typedef uint16_t            sstm_u16_t;
 typedef int32_t             sstm_s32_t;
 typedef uint32_t            sstm_u32_t;
 
+typedef int64_t             sstm_s64_t;
+typedef uint64_t            sstm_u64_t;
+
 typedef sstm_u8_t           sstm_bool_t;
 
 typedef sstm_s32_t          sstm_res_t;
@@ -52,6 +59,203 @@ typedef struct _sstm_ctx    sstm_ctx_t;
 #define SSTM_ASSERT(cond)
 #endif
 
+/* allow one producer thread (sstm_write) and one
+   consumer thread (sstm_read, sstm_seek, sstm_clean)
+   to share a stream without external locking. */
+#ifndef SSTM_USE_SPSC
+#define SSTM_USE_SPSC           0
+#endif
+
+/* enable sstm_read_wait() and sstm_write_wait(),
+   which sleep on a futex (linux only). */
+#ifndef SSTM_USE_WAIT
+#define SSTM_USE_WAIT           0
+#endif
+
+/* enable sstm_evfd(), which exposes the stream
+   readiness as eventfds (linux only). */
+#ifndef SSTM_USE_EVENTFD
+#define SSTM_USE_EVENTFD        0
+#endif
+
+/* waiting only makes sense with another thread
+   on the other side of the stream. */
+#if SSTM_USE_WAIT && !SSTM_USE_SPSC
+#undef SSTM_USE_SPSC
+#define SSTM_USE_SPSC           1
+#endif
+
+/* define SSTM_IMPLEMENTATION before including this
+   header to compile the whole library into the current
+   translation unit as static inline functions, so that
+   reads and writes of constant sizes can be inlined. */
+#ifdef SSTM_IMPLEMENTATION
+#define SSTM_API                static inline
+#else
+#define SSTM_API
+#endif
+
+/* keep the cumulative counters of sstm_stat_t,
+   when disabled they all read 0. */
+#ifndef SSTM_USE_STATS
+#define SSTM_USE_STATS          1
+#endif
+
+/* record cycle count histograms of sstm_read(),
+   sstm_write(), sstm_seek() and sstm_clean(). */
+#ifndef SSTM_USE_HIST
+#define SSTM_USE_HIST           0
+#endif
+
+/* place sys/sdt.h probes at the entry and
+   exit of the public functions. */
+#ifndef SSTM_USE_USDT
+#define SSTM_USE_USDT           0
+#endif
+
+/* enable sstm_write_record(), sstm_read_record()
+   and sstm_seek_record(). */
+#ifndef SSTM_USE_RECORD
+#define SSTM_USE_RECORD         0
+#endif
+
+/* timestamp the writes and enable sstm_seek_time(). */
+#ifndef SSTM_USE_TIME
+#define SSTM_USE_TIME           0
+#endif
+
+/* allow the ring buffer to be mapped with huge pages
+   and bound to a NUMA node, see conf.mem_flags (linux
+   only). */
+#ifndef SSTM_USE_MMAP
+#define SSTM_USE_MMAP           0
+#endif
+
+/* copy writes of at least SSTM_NT_MIN_SIZE bytes with
+   non-temporal stores and reads of as many with
+   non-temporal loads, so that they do not evict the
+   working set from the caches (x86 only). */
+#ifndef SSTM_USE_NT
+#define SSTM_USE_NT             0
+#endif
+
+#if SSTM_USE_NT && !(defined(__x86_64__) || defined(__i386__))
+#undef SSTM_USE_NT
+#define SSTM_USE_NT             0
+#endif
+
+/* enable sstm_write_xform() and sstm_read_xform(),
+   which transform the data in the same pass that
+   copies it. */
+#ifndef SSTM_USE_XFORM
+#define SSTM_USE_XFORM          0
+#endif
+
+/* enable sstm_shardset_t, a set of streams with one
+   writer each, merged in write order into one stream
+   for the reader. */
+#ifndef SSTM_USE_SHARD
+#define SSTM_USE_SHARD          0
+#endif
+
+/* the shards are written and merged from
+   different threads. */
+#if SSTM_USE_SHARD && !SSTM_USE_SPSC
+#undef SSTM_USE_SPSC
+#define SSTM_USE_SPSC           1
+#endif
+
+/* enable sstm_shm_new() and sstm_shm_attach(), which
+   place a stream in shared memory for a producer and a
+   consumer process (linux only). */
+#ifndef SSTM_USE_SHM
+#define SSTM_USE_SHM            0
+#endif
+
+/* the two sides of a shared stream run at the
+   same time, in different processes. */
+#if SSTM_USE_SHM && !SSTM_USE_SPSC
+#undef SSTM_USE_SPSC
+#define SSTM_USE_SPSC           1
+#endif
+
+/* record the zeros written by sstm_write(ctx, NULL,
+   size) as holes instead of writing them to the ring
+   buffer, see SSTM_HOLE_MIN_SIZE. */
+#ifndef SSTM_USE_HOLE
+#define SSTM_USE_HOLE           0
+#endif
+
+/* enable sstm_write_ref(), which links a buffer into
+   the stream instead of copying it. */
+#ifndef SSTM_USE_REF
+#define SSTM_USE_REF            0
+#endif
+
+/* these keep parts of the context in process
+   private memory or file descriptors. */
+#if SSTM_USE_SHM && (SSTM_USE_RECORD || SSTM_USE_TIME || SSTM_USE_EVENTFD || SSTM_USE_MMAP || \
+                     SSTM_USE_HOLE || SSTM_USE_REF)
+#error "SSTM_USE_SHM cannot be combined with SSTM_USE_RECORD, SSTM_USE_TIME, SSTM_USE_EVENTFD, SSTM_USE_MMAP, SSTM_USE_HOLE or SSTM_USE_REF"
+#endif
+
+/* enable sstm_dup(), which clones a stream by sharing
+   its ring buffer pages copy-on-write (linux only). */
+#ifndef SSTM_USE_DUP
+#define SSTM_USE_DUP            0
+#endif
+
+/* these map the ring buffer their own way. */
+#if SSTM_USE_DUP && (SSTM_USE_MMAP || SSTM_USE_SHM)
+#error "SSTM_USE_DUP cannot be combined with SSTM_USE_MMAP or SSTM_USE_SHM"
+#endif
+
+/* enable sstm_open_mmap(), which reads a file as a
+   stream through a read only mapping of it. */
+#ifndef SSTM_USE_FILE
+#define SSTM_USE_FILE           0
+#endif
+
+/* enable sstm_source_new(), a stream that caches a
+   random access source, fetched by a thread of its
+   own (needs pthreads). */
+#ifndef SSTM_USE_SOURCE
+#define SSTM_USE_SOURCE         0
+#endif
+
+/* the fetching thread is the producer. */
+#if SSTM_USE_SOURCE && !SSTM_USE_SPSC
+#undef SSTM_USE_SPSC
+#define SSTM_USE_SPSC           1
+#endif
+
+/* the fetching thread belongs to one process. */
+#if SSTM_USE_SOURCE && SSTM_USE_SHM
+#error "SSTM_USE_SOURCE cannot be combined with SSTM_USE_SHM"
+#endif
+
+/* below about half of the last level cache a copy is
+   likely to be read again while it is still cached. */
+#ifndef SSTM_NT_MIN_SIZE
+#define SSTM_NT_MIN_SIZE        (256 * 1024)
+#endif
+
+/* smaller runs of zeros are cheaper to write
+   than to look up on every read. */
+#ifndef SSTM_HOLE_MIN_SIZE
+#define SSTM_HOLE_MIN_SIZE      4096
+#endif
+
+/* how far ahead of the reads of a file view its pages
+   are asked for while it is read sequentially. */
+#ifndef SSTM_FILE_AHEAD_SIZE
+#define SSTM_FILE_AHEAD_SIZE    (2 * 1024 * 1024)
+#endif
+
+/* the fields of both structures do not depend on the SSTM_USE_*
+   options, so that code built with other options agrees on their
+   layout. the status fields of the options that are off read 0, the
+   configuration fields of the options that are off are ignored. */
 typedef struct _sstm_stat {
 
     /* the actual usable memory size
@@ -77,12 +281,124 @@ typedef struct _sstm_stat {
 
     /* current seeking offset. */
     sstm_size_t seek_offs;
+
+    /* the highest used size ever reached. */
+    sstm_size_t used_peak;
+
+    /* the total size of data written, read
+       (including reads with NULL data) and
+       cleaned. */
+    sstm_u64_t write_bytes;
+    sstm_u64_t read_bytes;
+    sstm_u64_t clean_bytes;
+
+    /* the number of writes and reads that
+       were split into two copies at the end
+       of the ring buffer. */
+    sstm_u64_t write_splits;
+    sstm_u64_t read_splits;
+
+    /* the number of writes that failed with
+       SSTM_ERR_NO_SPACE and reads that failed
+       with SSTM_ERR_NO_DATA. */
+    sstm_u64_t no_space_errs;
+    sstm_u64_t no_data_errs;
+
+    /* the number of seeks that moved the
+       seeking offset backwards and forwards. */
+    sstm_u64_t seek_backs;
+    sstm_u64_t seek_fwds;
+
+    /* the absolute positions of the first
+       byte in the stream and of the end of
+       it, counted from the first byte ever
+       written, see sstm_pread(). */
+    sstm_u64_t head_pos;
+    sstm_u64_t tail_pos;
+
+    /* the number of records in the stream. */
+    sstm_size_t rec_count;
+
+    /* the number of records before the
+       record seeking offset. */
+    sstm_size_t rec_offs;
+
+    /* how the ring buffer is backed, one of
+       SSTM_MEM_KIND_*. */
+    sstm_u32_t mem_kind;
+
+    /* the number of writes copied with
+       non-temporal stores and of reads copied
+       with non-temporal loads. */
+    sstm_u64_t nt_writes;
+    sstm_u64_t nt_reads;
+
+    /* the number of holes in the stream. */
+    sstm_size_t hole_count;
+
+    /* the number of zeros written as holes. */
+    sstm_u64_t hole_bytes;
+
+    /* the number of refs in the stream. */
+    sstm_size_t ref_count;
+
+    /* the number of bytes written by ref. */
+    sstm_u64_t ref_bytes;
+
+    /* the size of the source, 0 for a stream
+       without one. */
+    sstm_u64_t src_size;
+
+    /* the number of fetches from the source, and
+       of seeks that moved the stream to another
+       part of it. */
+    sstm_u64_t src_fetches;
+    sstm_u64_t src_refills;
 } sstm_stat_t;
 
+/* zero the configuration before setting the fields in use,
+   0 means the default for every field. */
 typedef struct _sstm_conf {
 
     /* the capacity of seekable stream. */
     sstm_size_t cap_size;
+
+    /* the maximum number of records in the
+       stream, 0 means cap_size / 64. */
+    sstm_size_t rec_num;
+
+    /* the maximum number of timestamps in
+       the stream, 0 means cap_size / 64. */
+    sstm_size_t time_num;
+
+    /* the minimum distance in bytes between
+       timestamps, 0 means every write. */
+    sstm_size_t time_gap;
+
+    /* SSTM_MEM_* flags, 0 means malloc(). */
+    sstm_u32_t mem_flags;
+
+    /* the node to bind the ring buffer to,
+       with SSTM_MEM_NUMA. */
+    sstm_s32_t numa_node;
+
+    /* the maximum number of holes in the stream,
+       0 means cap_size / SSTM_HOLE_MIN_SIZE, which
+       is never exceeded. */
+    sstm_size_t hole_num;
+
+    /* the maximum number of refs in the stream,
+       0 means SSTM_REF_NUM_DEF. */
+    sstm_size_t ref_num;
+
+    /* the size of the fetches from the source, 0
+       means SSTM_SRC_BLOCK_DEF. it is cut down to
+       cap_size. */
+    sstm_size_t src_block;
+
+    /* the number of blocks fetched ahead of the
+       seeking offset, 0 means SSTM_SRC_AHEAD_DEF. */
+    sstm_size_t src_ahead;
 } sstm_conf_t;
 
 typedef enum _sstm_whence {
@@ -97,28 +413,332 @@ typedef enum _sstm_whence {
     SSTM_SEEK_END,
 } sstm_whence_t;
 
+#if SSTM_USE_HIST
+
+typedef enum _sstm_op {
+    SSTM_OP_READ                = 0,
+    SSTM_OP_WRITE,
+    SSTM_OP_SEEK,
+    SSTM_OP_CLEAN,
+
+    SSTM_OP_NUM,
+} sstm_op_t;
+
+/* every power of two is split into 2^SSTM_HIST_SUB_BITS
+   linear buckets, values up to 2^(SSTM_HIST_MAG_MAX + 1)
+   are told apart with a relative error of 1/16. */
+#define SSTM_HIST_SUB_BITS      4
+#define SSTM_HIST_MAG_MAX       39
+#define SSTM_HIST_BUCKETS       ((SSTM_HIST_MAG_MAX - SSTM_HIST_SUB_BITS + 2) << SSTM_HIST_SUB_BITS)
+
+typedef struct _sstm_hist {
+
+    /* the number of recorded values. */
+    sstm_u64_t count;
+
+    /* the sum, minimum and maximum of
+       recorded values, in cycles. */
+    sstm_u64_t sum;
+    sstm_u64_t min;
+    sstm_u64_t max;
+
+    sstm_u32_t buckets[SSTM_HIST_BUCKETS];
+} sstm_hist_t;
+
+#endif
+
 #define SSTM_CAP_SIZE_MIN       128
 #define SSTM_CAP_SIZE_DEF       1024
 
+/* a record is a 32-bit length in host byte
+   order followed by the payload. */
+#define SSTM_REC_HDR_SIZE       4
+
+#if SSTM_USE_MMAP
+
+/* back the ring buffer with 2 MiB or 1 GiB hugetlb
+   pages, falling back to transparent huge pages
+   when none are reserved. */
+#define SSTM_MEM_HUGE_2M        (1u << 0)
+#define SSTM_MEM_HUGE_1G        (1u << 1)
+
+/* map with normal pages and ask for transparent
+   huge pages. */
+#define SSTM_MEM_THP            (1u << 2)
+
+/* bind the ring buffer to conf.numa_node. */
+#define SSTM_MEM_NUMA           (1u << 3)
+
+/* fault every page in at creation. */
+#define SSTM_MEM_PREFAULT       (1u << 4)
+
+/* lock the ring buffer in memory, which needs
+   enough RLIMIT_MEMLOCK. */
+#define SSTM_MEM_LOCK           (1u << 5)
+
+/* only reserve address space at creation, pages are
+   committed as the writes first reach them. with it,
+   SSTM_MEM_PREFAULT and SSTM_MEM_LOCK apply to each
+   part as it is committed. */
+#define SSTM_MEM_LAZY           (1u << 6)
+
+/* give the free pages back to the system once the
+   stream stays under 1 / 2^SSTM_MEM_IDLE_SHIFT full
+   for SSTM_MEM_IDLE_CLEANS cleans in a row, it is
+   ignored in SPSC mode. */
+#define SSTM_MEM_RELEASE        (1u << 7)
+
+#ifndef SSTM_MEM_IDLE_SHIFT
+#define SSTM_MEM_IDLE_SHIFT     3
+#endif
+
+#ifndef SSTM_MEM_IDLE_CLEANS
+#define SSTM_MEM_IDLE_CLEANS    64
+#endif
+
+#define SSTM_MEM_KIND_HEAP      0
+#define SSTM_MEM_KIND_PAGE      1
+#define SSTM_MEM_KIND_HUGE_2M   2
+#define SSTM_MEM_KIND_HUGE_1G   3
+
+/* a file view, see sstm_open_mmap(). */
+#define SSTM_MEM_KIND_FILE      4
+
+#endif
+
+#if SSTM_USE_XFORM
+
+/* the largest unit a transform can work in. */
+#define SSTM_XFORM_UNIT_MAX     64
+
+typedef struct _sstm_xform sstm_xform_t;
+
+/* transform size bytes from src into dst, size is
+   a multiple of the unit and the two never overlap. */
+typedef void (*sstm_xform_func_t)(sstm_xform_t *xform, void *dst,
+                                  const void *src, sstm_size_t size);
+
+struct _sstm_xform {
+
+    /* the transform function. */
+    sstm_xform_func_t func;
+
+    /* the size of the units the data is
+       transformed in, from 1 to
+       SSTM_XFORM_UNIT_MAX. every transfer
+       must be a multiple of it. */
+    sstm_size_t unit;
+
+    /* the number of bytes transformed so
+       far, i.e. the position of the first
+       byte of src. */
+    sstm_u64_t pos;
+
+    /* the XOR mask, or the running hash. */
+    sstm_u64_t state;
+
+    /* free for custom transforms. */
+    void *user;
+};
+
+#endif
+
+#if SSTM_USE_SHARD
+
+/* every shard entry starts with its u64 sequence
+   number and u64 size. */
+#define SSTM_SHARD_HDR_SIZE     16
+
+typedef struct _sstm_shardset sstm_shardset_t;
+
+#endif
+
+#if SSTM_USE_REF
+
+#define SSTM_REF_NUM_DEF        256
+
+/* give a buffer back once the stream is done with it,
+   arg is the one given to sstm_write_ref(). */
+typedef void (*sstm_release_func_t)(void *arg, const void *data, sstm_size_t size);
+
+#endif
+
+#if SSTM_USE_SOURCE
+
+#define SSTM_SRC_BLOCK_DEF      (64 * 1024)
+#define SSTM_SRC_AHEAD_DEF      4
+
+/* read size bytes of the source at pos into data, pos + size
+   never passes the end of the source. it is called from the
+   fetching thread of the stream, anything but SSTM_OK is
+   returned by the reads that wait for the data. */
+typedef sstm_res_t (*sstm_source_func_t)(void *arg, sstm_u64_t pos, void *data, sstm_size_t size);
+
+#endif
+
+#if SSTM_USE_SHM
+
+/* the roles of the processes sharing a stream. */
+#define SSTM_SHM_PRODUCER       0
+#define SSTM_SHM_CONSUMER       1
+
+#endif
+
 #define SSTM_OK                 0
 #define SSTM_ERR                -1
 #define SSTM_ERR_NO_MEM         -2
 #define SSTM_ERR_NO_SPACE       -3
 #define SSTM_ERR_NO_DATA        -4
 #define SSTM_ERR_BAD_OFFS       -5
+#define SSTM_ERR_TIMEOUT        -6
+#define SSTM_ERR_NO_PEER        -7
+#define SSTM_ERR_BUSY           -8
+
+SSTM_API sstm_res_t sstm_new(sstm_ctx_t **ctx, sstm_conf_t *conf);
+
+SSTM_API sstm_res_t sstm_del(sstm_ctx_t *ctx);
+
+SSTM_API sstm_res_t sstm_stat(sstm_ctx_t *ctx, sstm_stat_t *stat);
+
+SSTM_API sstm_res_t sstm_clean(sstm_ctx_t *ctx);
+
+SSTM_API sstm_res_t sstm_read(sstm_ctx_t *ctx, void *data, sstm_size_t size, sstm_bool_t cleanup);
+
+SSTM_API sstm_res_t sstm_write(sstm_ctx_t *ctx, const void *data, sstm_size_t size);
+
+SSTM_API sstm_res_t sstm_seek(sstm_ctx_t *ctx, sstm_offs_t offset, sstm_whence_t whence);
+
+SSTM_API sstm_res_t sstm_seek_pos(sstm_ctx_t *ctx, sstm_u64_t pos);
+
+SSTM_API sstm_res_t sstm_pread(sstm_ctx_t *ctx, sstm_u64_t pos, void *data, sstm_size_t size);
+
+SSTM_API sstm_res_t sstm_pipe(sstm_ctx_t *src, sstm_ctx_t *dst, sstm_size_t size, sstm_bool_t cleanup);
+
+#if SSTM_USE_HOLE
+
+SSTM_API sstm_res_t sstm_read_zeroed(sstm_ctx_t *ctx, void *data, sstm_size_t size, sstm_bool_t cleanup);
 
-sstm_res_t sstm_new(sstm_ctx_t **ctx, sstm_conf_t *conf);
+#endif
+
+#if SSTM_USE_REF
+
+SSTM_API sstm_res_t sstm_write_ref(sstm_ctx_t *ctx, const void *data, sstm_size_t size,
+                                   sstm_release_func_t release, void *arg);
+
+#endif
+
+#if SSTM_USE_FILE
+
+SSTM_API sstm_res_t sstm_open_mmap(sstm_ctx_t **ctx, const char *path);
+
+#endif
+
+#if SSTM_USE_SOURCE
+
+SSTM_API sstm_res_t sstm_source_new(sstm_ctx_t **ctx, sstm_conf_t *conf, sstm_u64_t size,
+                                    sstm_source_func_t func, void *arg);
+
+#endif
 
-sstm_res_t sstm_del(sstm_ctx_t *ctx);
+#if SSTM_USE_SHARD
 
-sstm_res_t sstm_stat(sstm_ctx_t *ctx, sstm_stat_t *stat);
+SSTM_API sstm_res_t sstm_shardset_new(sstm_shardset_t **set, sstm_conf_t *conf, sstm_size_t shard_num);
 
-sstm_res_t sstm_clean(sstm_ctx_t *ctx);
+SSTM_API sstm_res_t sstm_shardset_del(sstm_shardset_t *set);
 
-sstm_res_t sstm_read(sstm_ctx_t *ctx, void *data, sstm_size_t size, sstm_bool_t cleanup);
+SSTM_API sstm_res_t sstm_shardset_ctx(sstm_shardset_t *set, sstm_ctx_t **ctx);
 
-sstm_res_t sstm_write(sstm_ctx_t *ctx, const void *data, sstm_size_t size);
+SSTM_API sstm_res_t sstm_shardset_write(sstm_shardset_t *set, sstm_size_t shard,
+                                        const void *data, sstm_size_t size);
 
-sstm_res_t sstm_seek(sstm_ctx_t *ctx, sstm_offs_t offset, sstm_whence_t whence);
+SSTM_API sstm_res_t sstm_shardset_merge(sstm_shardset_t *set, sstm_size_t *size);
+
+#endif
+
+#if SSTM_USE_SHM
+
+SSTM_API sstm_res_t sstm_shm_new(sstm_ctx_t **ctx, sstm_conf_t *conf, int fd, sstm_u32_t role);
+
+SSTM_API sstm_res_t sstm_shm_attach(sstm_ctx_t **ctx, int fd, sstm_u32_t role);
+
+SSTM_API sstm_res_t sstm_shm_detach(sstm_ctx_t *ctx);
+
+SSTM_API sstm_res_t sstm_shm_peer(sstm_ctx_t *ctx);
+
+#endif
+
+#if SSTM_USE_DUP
+
+SSTM_API sstm_res_t sstm_dup(sstm_ctx_t *ctx, sstm_ctx_t **clone);
+
+#endif
+
+#if SSTM_USE_WAIT
+
+SSTM_API sstm_res_t sstm_read_wait(sstm_ctx_t *ctx, sstm_size_t size, sstm_s32_t timeout);
+
+SSTM_API sstm_res_t sstm_write_wait(sstm_ctx_t *ctx, sstm_size_t size, sstm_s32_t timeout);
+
+#endif
+
+#if SSTM_USE_RECORD
+
+SSTM_API sstm_res_t sstm_write_record(sstm_ctx_t *ctx, const void *data, sstm_size_t size);
+
+SSTM_API sstm_res_t sstm_read_record(sstm_ctx_t *ctx, void *data, sstm_size_t size,
+                                     sstm_size_t *rec_size, sstm_bool_t cleanup);
+
+SSTM_API sstm_res_t sstm_seek_record(sstm_ctx_t *ctx, sstm_size_t rec);
+
+#endif
+
+#if SSTM_USE_TIME
+
+SSTM_API sstm_res_t sstm_seek_time(sstm_ctx_t *ctx, sstm_u64_t stamp);
+
+#endif
+
+#if SSTM_USE_XFORM
+
+SSTM_API sstm_res_t sstm_write_xform(sstm_ctx_t *ctx, const void *data, sstm_size_t size,
+                                     sstm_xform_t *xform);
+
+SSTM_API sstm_res_t sstm_read_xform(sstm_ctx_t *ctx, void *data, sstm_size_t size,
+                                    sstm_bool_t cleanup, sstm_xform_t *xform);
+
+SSTM_API sstm_res_t sstm_xform_xor(sstm_xform_t *xform, sstm_u32_t key);
+
+SSTM_API sstm_res_t sstm_xform_bswap(sstm_xform_t *xform, sstm_size_t width);
+
+SSTM_API sstm_res_t sstm_xform_hash(sstm_xform_t *xform);
+
+#endif
+
+#if SSTM_USE_HIST
+
+SSTM_API sstm_res_t sstm_hist(sstm_ctx_t *ctx, sstm_op_t op, sstm_hist_t *hist);
+
+SSTM_API sstm_res_t sstm_hist_clear(sstm_ctx_t *ctx);
+
+SSTM_API sstm_res_t sstm_hist_merge(sstm_hist_t *dst, const sstm_hist_t *src);
+
+SSTM_API sstm_res_t sstm_hist_pct(const sstm_hist_t *hist, double pct, sstm_u64_t *value);
+
+#endif
+
+#if SSTM_USE_EVENTFD
+
+SSTM_API sstm_res_t sstm_evfd(sstm_ctx_t *ctx, sstm_size_t read_lowat, sstm_size_t write_hiwat,
+                              int *read_fd, int *write_fd);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(SSTM_IMPLEMENTATION) && !defined(__SSTM_C__)
+#include "seekablestream.c"
+#endif
 
 #endif
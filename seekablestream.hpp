@@ -0,0 +1,600 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2023 Alex Chen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SSTM_HPP__
+#define __SSTM_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+#include "seekablestream.h"
+
+namespace sstm {
+
+/* result of a stream operation, wraps the SSTM_* codes. */
+struct [[nodiscard]] result {
+    sstm_res_t code;
+
+    constexpr bool ok() const noexcept {
+        return code == SSTM_OK;
+    }
+
+    constexpr explicit operator bool() const noexcept {
+        return ok();
+    }
+
+    friend constexpr bool operator==(result lhs, result rhs) noexcept = default;
+};
+
+inline constexpr result ok{SSTM_OK};
+inline constexpr result err_no_space{SSTM_ERR_NO_SPACE};
+inline constexpr result err_no_data{SSTM_ERR_NO_DATA};
+inline constexpr result err_bad_offs{SSTM_ERR_BAD_OFFS};
+
+/**
+ * a seekable stream with a compile-time capacity and inline storage.
+ *
+ * it follows the semantics of the C API, but keeps the ring buffer
+ * inside the object, so it needs no heap allocation and can be a
+ * member of other objects. as the ring size (Capacity + 1) is a
+ * constant, the index math compiles to a multiply or, when Capacity
+ * is 2^n - 1, to a mask.
+ *
+ * the ring, seek and clean logic is written again here on purpose
+ * rather than shared with the C code: sharing it would mean going
+ * through sstm_ctx_t and its run-time capacity, which is what this
+ * class avoids. it only covers the basic read, write, seek and clean
+ * paths, so a fix to those in seekablestream.c must be made here too.
+ *
+ * it is not thread safe.
+*/
+template <sstm_size_t Capacity>
+class stream {
+    static_assert(Capacity >= SSTM_CAP_SIZE_MIN, "capacity is below SSTM_CAP_SIZE_MIN");
+
+    /* the ring size, Capacity + 1, must fit in sstm_size_t. */
+    static_assert(Capacity < std::numeric_limits<sstm_size_t>::max(), "capacity is too large");
+
+public:
+    static constexpr sstm_size_t cap_size = Capacity;
+
+    stream() noexcept = default;
+
+    /**
+     * @brief get the status of the seekable stream.
+    */
+    [[nodiscard]] sstm_stat_t stat() const noexcept {
+        sstm_stat_t stat{};
+
+        stat.cap_size = cap_size;
+        stat.used_size = used_size_;
+        stat.stale_size = seek_offs_;
+        stat.fresh_size = used_size_ - seek_offs_;
+        stat.free_size = cap_size - used_size_;
+        stat.seek_offs = seek_offs_;
+        stat.head_pos = head_pos_;
+        stat.tail_pos = tail_pos_;
+
+        return stat;
+    }
+
+    [[nodiscard]] sstm_size_t fresh_size() const noexcept {
+        return used_size_ - seek_offs_;
+    }
+
+    [[nodiscard]] sstm_size_t free_size() const noexcept {
+        return cap_size - used_size_;
+    }
+
+    /**
+     * @brief clean the stale section of the seekable stream.
+    */
+    result clean() noexcept {
+        head_idx_ = wrap(head_idx_ + seek_offs_);
+        head_pos_ += seek_offs_;
+        used_size_ -= seek_offs_;
+        seek_offs_ = 0;
+
+        return ok;
+    }
+
+    /**
+     * @brief read data from the stream.
+     *
+     * @param data the buffer to fill, its size is the read size.
+     * @param cleanup whether to clean the stale section after read.
+    */
+    result read(std::span<std::byte> data, bool cleanup = false) noexcept {
+        if (fresh_size() < data.size()) {
+            return err_no_data;
+        }
+
+        copy_out(data.data(), static_cast<sstm_size_t>(data.size()));
+
+        return advance(static_cast<sstm_size_t>(data.size()), cleanup);
+    }
+
+    /**
+     * @brief read a trivially copyable value from the stream.
+    */
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    result read_value(T &value, bool cleanup = false) noexcept {
+        if (fresh_size() < sizeof(T)) {
+            return err_no_data;
+        }
+
+        copy_out(&value, sizeof(T));
+
+        return advance(sizeof(T), cleanup);
+    }
+
+    /**
+     * @brief skip data in the stream without copying it.
+    */
+    result skip(sstm_size_t size, bool cleanup = false) noexcept {
+        if (fresh_size() < size) {
+            return err_no_data;
+        }
+
+        return advance(size, cleanup);
+    }
+
+    /**
+     * @brief write data to the seekable stream.
+    */
+    result write(std::span<const std::byte> data) noexcept {
+        if (free_size() < data.size()) {
+            return err_no_space;
+        }
+
+        copy_in(data.data(), static_cast<sstm_size_t>(data.size()));
+
+        return ok;
+    }
+
+    /**
+     * @brief write a trivially copyable value to the seekable stream.
+    */
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    result write_value(const T &value) noexcept {
+        if (free_size() < sizeof(T)) {
+            return err_no_space;
+        }
+
+        copy_in(&value, sizeof(T));
+
+        return ok;
+    }
+
+    /**
+     * @brief seek the seekable stream.
+    */
+    result seek(sstm_offs_t offset, sstm_whence_t whence = SSTM_SEEK_SET) noexcept {
+        sstm_offs_t abs_offs;
+
+        switch (whence) {
+            case SSTM_SEEK_SET: abs_offs = offset; break;
+            case SSTM_SEEK_CUR: abs_offs = static_cast<sstm_offs_t>(seek_offs_) + offset; break;
+            case SSTM_SEEK_END: abs_offs = static_cast<sstm_offs_t>(used_size_) + offset; break;
+            default: return result{SSTM_ERR};
+        }
+
+        if (abs_offs < 0 || static_cast<sstm_size_t>(abs_offs) > used_size_) {
+            return err_bad_offs;
+        }
+        seek_offs_ = static_cast<sstm_size_t>(abs_offs);
+
+        return ok;
+    }
+
+private:
+    static constexpr sstm_size_t ring_size = Capacity + 1;
+
+    static constexpr sstm_size_t wrap(sstm_size_t idx) noexcept {
+        return idx % ring_size;
+    }
+
+    void copy_out(void *data, sstm_size_t size) const noexcept {
+        sstm_size_t idx = wrap(head_idx_ + seek_offs_);
+        sstm_size_t first_copy_size = ring_size - idx;
+
+        if (first_copy_size >= size) {
+            std::memcpy(data, ring_buff_.data() + idx, size);
+        } else {
+            std::memcpy(data, ring_buff_.data() + idx, first_copy_size);
+            std::memcpy(static_cast<std::byte *>(data) + first_copy_size, ring_buff_.data(),
+                        size - first_copy_size);
+        }
+    }
+
+    void copy_in(const void *data, sstm_size_t size) noexcept {
+        sstm_size_t first_copy_size = ring_size - tail_idx_;
+
+        if (first_copy_size >= size) {
+            std::memcpy(ring_buff_.data() + tail_idx_, data, size);
+        } else {
+            std::memcpy(ring_buff_.data() + tail_idx_, data, first_copy_size);
+            std::memcpy(ring_buff_.data(), static_cast<const std::byte *>(data) + first_copy_size,
+                        size - first_copy_size);
+        }
+        tail_idx_ = wrap(tail_idx_ + size);
+        tail_pos_ += size;
+        used_size_ += size;
+    }
+
+    result advance(sstm_size_t size, bool cleanup) noexcept {
+
+        /* like sstm_read(), a read of nothing does not clean. */
+        if (size == 0) {
+            return ok;
+        }
+        seek_offs_ += size;
+        if (cleanup) {
+            return clean();
+        }
+
+        return ok;
+    }
+
+    sstm_size_t head_idx_ = 0;
+    sstm_size_t tail_idx_ = 0;
+
+    /* the absolute positions of head_idx_ and tail_idx_,
+       counted from the first byte ever written. */
+    sstm_u64_t head_pos_ = 0;
+    sstm_u64_t tail_pos_ = 0;
+
+    /* current seeking offset, equal to the stale size. */
+    sstm_size_t seek_offs_ = 0;
+
+    sstm_size_t used_size_ = 0;
+
+    /* ring buffer, left uninitialized. */
+    std::array<std::byte, ring_size> ring_buff_;
+};
+
+struct ctx_deleter {
+    void operator()(sstm_ctx_t *ctx) const noexcept {
+        sstm_del(ctx);
+    }
+};
+
+/* owning handle of a C stream context. */
+using handle = std::unique_ptr<sstm_ctx_t, ctx_deleter>;
+
+/**
+ * @brief create a new seekable stream owned by a handle.
+ *
+ * @param conf configuration pointer, can be NULL.
+ * @return the handle, empty when sstm_new() failed.
+*/
+inline handle make_handle(sstm_conf_t *conf = nullptr) noexcept {
+    sstm_ctx_t *ctx = nullptr;
+
+    if (sstm_new(&ctx, conf) != SSTM_OK) {
+        return handle{};
+    }
+
+    return handle{ctx};
+}
+
+#if defined(__cpp_impl_coroutine)
+
+/**
+ * coroutine interface of a C stream context.
+ *
+ * `co_await s.read(buf)` suspends until fresh_size is enough and
+ * `co_await s.write(buf)` suspends until free_size is enough. a
+ * suspended reader is resumed from inside the write (or seek) that
+ * makes the data available, a suspended writer from inside the clean
+ * that frees the space, so no thread is ever blocked.
+ *
+ * there is at most one suspended reader and one suspended writer,
+ * like the producer and consumer of a single stream. all operations
+ * on the context must go through this object, from one thread.
+ *
+ * a suspended coroutine may be destroyed, its awaiter unregisters
+ * itself. the object may be destroyed while one is suspended, which
+ * is then never resumed.
+ *
+ * waiters are resumed from a loop that is not entered again by the
+ * operations of the coroutines it resumes, so a reader and a writer
+ * handing data back and forth do not grow the stack.
+*/
+class async_stream {
+public:
+    class read_awaiter;
+    class write_awaiter;
+
+    explicit async_stream(sstm_ctx_t *ctx) noexcept : ctx_(ctx) {}
+
+    async_stream(const async_stream &) = delete;
+    async_stream &operator=(const async_stream &) = delete;
+
+    ~async_stream();
+
+    [[nodiscard]] sstm_ctx_t *native_handle() const noexcept {
+        return ctx_;
+    }
+
+    [[nodiscard]] sstm_stat_t stat() const noexcept {
+        sstm_stat_t stat;
+
+        sstm_stat(ctx_, &stat);
+
+        return stat;
+    }
+
+    /**
+     * @brief read data from the stream, suspending until it is there.
+     *
+     * @param data the buffer to fill, its size is the read size.
+     * @param cleanup whether to clean the stale section after read.
+    */
+    [[nodiscard]] read_awaiter read(std::span<std::byte> data, bool cleanup = false) noexcept;
+
+    /**
+     * @brief write data to the stream, suspending until it fits.
+    */
+    [[nodiscard]] write_awaiter write(std::span<const std::byte> data) noexcept;
+
+    /**
+     * @brief read without suspending, resumes a suspended writer if
+     *        the read frees enough space.
+    */
+    result try_read(std::span<std::byte> data, bool cleanup = false) noexcept {
+        result res{sstm_read(ctx_, data.data(), static_cast<sstm_size_t>(data.size()), cleanup)};
+
+        if (res && cleanup) {
+            resume_waiters();
+        }
+
+        return res;
+    }
+
+    /**
+     * @brief write without suspending, resumes a suspended reader if
+     *        the write provides enough data.
+    */
+    result try_write(std::span<const std::byte> data) noexcept {
+        result res{sstm_write(ctx_, data.data(), static_cast<sstm_size_t>(data.size()))};
+
+        if (res) {
+            resume_waiters();
+        }
+
+        return res;
+    }
+
+    result seek(sstm_offs_t offset, sstm_whence_t whence = SSTM_SEEK_SET) noexcept {
+        result res{sstm_seek(ctx_, offset, whence)};
+
+        if (res) {
+            resume_waiters();
+        }
+
+        return res;
+    }
+
+    result clean() noexcept {
+        result res{sstm_clean(ctx_)};
+
+        resume_waiters();
+
+        return res;
+    }
+
+    class read_awaiter {
+    public:
+        read_awaiter(const read_awaiter &) = delete;
+        read_awaiter &operator=(const read_awaiter &) = delete;
+
+        ~read_awaiter() {
+            if (stream_ != nullptr && stream_->reader_ == this) {
+                stream_->reader_ = nullptr;
+            }
+        }
+
+        bool await_ready() noexcept {
+            if (stream_->stat().fresh_size >= data_.size()) {
+                complete();
+
+                return true;
+            }
+            if (data_.size() > stream_->stat().cap_size) {
+                res_ = err_no_data;
+
+                return true;
+            }
+
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) noexcept {
+            if (stream_->reader_ != nullptr) {
+                res_ = result{SSTM_ERR};
+
+                return false;
+            }
+            handle_ = handle;
+            stream_->reader_ = this;
+
+            return true;
+        }
+
+        result await_resume() const noexcept {
+            return res_;
+        }
+
+    private:
+        friend class async_stream;
+
+        read_awaiter(async_stream &stream, std::span<std::byte> data, bool cleanup) noexcept
+            : stream_(&stream), data_(data), cleanup_(cleanup) {}
+
+        void complete() noexcept {
+            res_ = stream_->try_read(data_, cleanup_);
+        }
+
+        /* NULL once the stream is gone. */
+        async_stream *stream_;
+        std::span<std::byte> data_;
+        bool cleanup_;
+        result res_{SSTM_OK};
+        std::coroutine_handle<> handle_;
+    };
+
+    class write_awaiter {
+    public:
+        write_awaiter(const write_awaiter &) = delete;
+        write_awaiter &operator=(const write_awaiter &) = delete;
+
+        ~write_awaiter() {
+            if (stream_ != nullptr && stream_->writer_ == this) {
+                stream_->writer_ = nullptr;
+            }
+        }
+
+        bool await_ready() noexcept {
+            if (stream_->stat().free_size >= data_.size()) {
+                complete();
+
+                return true;
+            }
+            if (data_.size() > stream_->stat().cap_size) {
+                res_ = err_no_space;
+
+                return true;
+            }
+
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) noexcept {
+            if (stream_->writer_ != nullptr) {
+                res_ = result{SSTM_ERR};
+
+                return false;
+            }
+            handle_ = handle;
+            stream_->writer_ = this;
+
+            return true;
+        }
+
+        result await_resume() const noexcept {
+            return res_;
+        }
+
+    private:
+        friend class async_stream;
+
+        write_awaiter(async_stream &stream, std::span<const std::byte> data) noexcept
+            : stream_(&stream), data_(data) {}
+
+        void complete() noexcept {
+            res_ = stream_->try_write(data_);
+        }
+
+        /* NULL once the stream is gone. */
+        async_stream *stream_;
+        std::span<const std::byte> data_;
+        result res_{SSTM_OK};
+        std::coroutine_handle<> handle_;
+    };
+
+private:
+
+    /* a suspended waiter is completed before it is resumed, so the
+       coroutine observes the result of its operation, and it may
+       suspend again before control returns here. the operations of
+       the resumed coroutines only change the stream, this loop then
+       goes on with whatever waiter they made ready. */
+    void resume_waiters() noexcept {
+        bool resumed;
+
+        if (resuming_) {
+            return;
+        }
+        resuming_ = true;
+        do {
+            resumed = false;
+            if (reader_ != nullptr && stat().fresh_size >= reader_->data_.size()) {
+                read_awaiter *reader = std::exchange(reader_, nullptr);
+
+                reader->complete();
+                reader->handle_.resume();
+                resumed = true;
+            }
+            if (writer_ != nullptr && stat().free_size >= writer_->data_.size()) {
+                write_awaiter *writer = std::exchange(writer_, nullptr);
+
+                writer->complete();
+                writer->handle_.resume();
+                resumed = true;
+            }
+        } while (resumed);
+        resuming_ = false;
+    }
+
+    sstm_ctx_t *ctx_;
+    read_awaiter *reader_ = nullptr;
+    write_awaiter *writer_ = nullptr;
+    bool resuming_ = false;
+};
+
+inline async_stream::~async_stream() {
+    if (reader_ != nullptr) {
+        reader_->stream_ = nullptr;
+    }
+    if (writer_ != nullptr) {
+        writer_->stream_ = nullptr;
+    }
+}
+
+inline async_stream::read_awaiter async_stream::read(std::span<std::byte> data, bool cleanup) noexcept {
+    return read_awaiter{*this, data, cleanup};
+}
+
+inline async_stream::write_awaiter async_stream::write(std::span<const std::byte> data) noexcept {
+    return write_awaiter{*this, data};
+}
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,151 @@
+/**
+ * helpers shared by the tests.
+ *
+ * every test is a program of its own, built with the SSTM_USE_*
+ * options it needs along with the library, see the Makefile. the
+ * test data is a function of its absolute position in the stream,
+ * so that any part of it can be checked without keeping a copy.
+*/
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "seekablestream.h"
+
+/* fail the test with the location of the check. */
+#define TEST_CHECK(cond)                                                    \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                    \
+                    __FILE__, __LINE__, #cond);                             \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
+
+/**
+ * @brief get the next number of a xorshift generator, so that every
+ *        run of a test does the same operations.
+*/
+static inline sstm_u32_t test_rand(sstm_u32_t *state) {
+    sstm_u32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+/**
+ * @brief get the test data byte at an absolute position.
+*/
+static inline sstm_u8_t test_byte(sstm_u64_t pos) {
+    return (sstm_u8_t)((pos * 2654435761u) >> 13);
+}
+
+/**
+ * @brief fill a buffer with the test data from an absolute position.
+*/
+static inline void test_fill(void *data, sstm_u64_t pos, sstm_size_t size) {
+    sstm_size_t i;
+
+    for (i = 0; i < size; i++) {
+        ((sstm_u8_t *)data)[i] = test_byte(pos + i);
+    }
+}
+
+/**
+ * @brief check a buffer against the test data from an absolute position.
+*/
+static inline sstm_bool_t test_match(const void *data, sstm_u64_t pos, sstm_size_t size) {
+    sstm_size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (((const sstm_u8_t *)data)[i] != test_byte(pos + i)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief get the resident size of the process in bytes.
+*/
+static inline sstm_u64_t test_rss(void) {
+    unsigned long size;
+    unsigned long resident;
+    FILE *file;
+
+    file = fopen("/proc/self/statm", "r");
+    TEST_CHECK(file != NULL);
+    TEST_CHECK(fscanf(file, "%lu %lu", &size, &resident) == 2);
+    fclose(file);
+
+    return (sstm_u64_t)resident * (sstm_u64_t)sysconf(_SC_PAGESIZE);
+}
+
+/* the size of the model, more than any stream holds. */
+#define TEST_MODEL_SIZE         (1u << 18)
+
+/* what a stream is expected to hold, by absolute position,
+   for the data that is not a function of it (e.g. holes). */
+typedef struct _test_model {
+    sstm_ctx_t *ctx;
+    sstm_u8_t data[TEST_MODEL_SIZE];
+
+    /* the head, seeking and tail positions. */
+    sstm_u64_t head;
+    sstm_u64_t seek;
+    sstm_u64_t tail;
+} test_model_t;
+
+/**
+ * @brief set the data of the model at a position, zeros if data is
+ *        NULL.
+*/
+static inline void test_model_put(test_model_t *model, sstm_u64_t pos, const void *data,
+                                  sstm_size_t size) {
+    sstm_size_t i;
+
+    for (i = 0; i < size; i++) {
+        model->data[(pos + i) % TEST_MODEL_SIZE] =
+            data == NULL ? 0 : ((const sstm_u8_t *)data)[i];
+    }
+}
+
+/**
+ * @brief check a buffer against the data of the model at a position.
+*/
+static inline sstm_bool_t test_model_match(const test_model_t *model, sstm_u64_t pos,
+                                           const void *data, sstm_size_t size) {
+    sstm_size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (((const sstm_u8_t *)data)[i] != model->data[(pos + i) % TEST_MODEL_SIZE]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief check the positions of the stream against the model, and
+ *        take its head, which any clean may have moved.
+*/
+static inline void test_model_sync(test_model_t *model) {
+    sstm_stat_t stat;
+
+    sstm_stat(model->ctx, &stat);
+    TEST_CHECK(stat.tail_pos == model->tail);
+    TEST_CHECK(stat.head_pos + stat.seek_offs == model->seek);
+    model->head = stat.head_pos;
+}
+
+#endif
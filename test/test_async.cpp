@@ -0,0 +1,223 @@
+/**
+ * sstm::async_stream test.
+ *
+ * has a reader and a writer coroutine hand a million chunks back and
+ * forth through a small stream, which would run out of stack if each
+ * resume nested in the last one, then checks the fast paths, the
+ * sizes that can never complete, a second waiter on the same side,
+ * and the destruction of a suspended coroutine and of the stream
+ * under one.
+*/
+
+#include <coroutine>
+#include <cstring>
+#include <exception>
+
+#include "seekablestream.hpp"
+#include "test.h"
+
+#define TEST_CAP_SIZE           128
+#define TEST_MAX_SIZE           100
+#define TEST_TRANSFERS          1000000
+
+/* a coroutine that runs at once and stays suspended at its end,
+   so that it can be checked and is destroyed by its owner. */
+class test_task {
+public:
+    struct promise_type {
+        test_task get_return_object() noexcept {
+            return test_task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() noexcept {}
+
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+
+    test_task() noexcept = default;
+
+    explicit test_task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    test_task(test_task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    test_task &operator=(test_task &&other) noexcept {
+        reset();
+        handle_ = std::exchange(other.handle_, nullptr);
+
+        return *this;
+    }
+
+    ~test_task() {
+        reset();
+    }
+
+    [[nodiscard]] bool done() const noexcept {
+        return handle_.done();
+    }
+
+    void reset() noexcept {
+        if (handle_) {
+            std::exchange(handle_, nullptr).destroy();
+        }
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+static test_task test_writer(sstm::async_stream &strm, sstm_u32_t state) {
+    std::byte data[TEST_MAX_SIZE];
+    sstm_u64_t pos = 0;
+    sstm_size_t size;
+    int i;
+
+    for (i = 0; i < TEST_TRANSFERS; i++) {
+        size = test_rand(&state) % TEST_MAX_SIZE + 1;
+        test_fill(data, pos, size);
+        TEST_CHECK(co_await strm.write(std::span<const std::byte>(data, size)) == sstm::ok);
+        pos += size;
+    }
+}
+
+static test_task test_reader(sstm::async_stream &strm, sstm_u32_t state, sstm_u64_t *pos) {
+    std::byte data[TEST_MAX_SIZE];
+    sstm_size_t size;
+    int i;
+
+    for (i = 0; i < TEST_TRANSFERS; i++) {
+        size = test_rand(&state) % TEST_MAX_SIZE + 1;
+        TEST_CHECK(co_await strm.read(std::span<std::byte>(data, size), true) == sstm::ok);
+        TEST_CHECK(test_match(data, *pos, size));
+        *pos += size;
+    }
+}
+
+static test_task test_read_once(sstm::async_stream &strm, std::span<std::byte> data,
+                                sstm::result *res) {
+    *res = co_await strm.read(data, true);
+}
+
+static test_task test_write_once(sstm::async_stream &strm, std::span<const std::byte> data,
+                                 sstm::result *res) {
+    *res = co_await strm.write(data);
+}
+
+static void test_ping_pong(void) {
+    sstm::handle ctx;
+    sstm_conf_t conf;
+    sstm_u64_t write_total = 0;
+    sstm_u64_t read_pos = 0;
+    sstm_u32_t state = 9;
+    int i;
+
+    std::memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    ctx = sstm::make_handle(&conf);
+    TEST_CHECK(ctx != nullptr);
+
+    /* the reader reads the sizes the writer writes. */
+    for (i = 0; i < TEST_TRANSFERS; i++) {
+        write_total += test_rand(&state) % TEST_MAX_SIZE + 1;
+    }
+
+    sstm::async_stream strm{ctx.get()};
+    test_task reader = test_reader(strm, 9, &read_pos);
+    test_task writer = test_writer(strm, 9);
+
+    TEST_CHECK(reader.done() && writer.done());
+    TEST_CHECK(read_pos == write_total);
+    TEST_CHECK(strm.stat().used_size == 0);
+}
+
+static void test_edges(void) {
+    std::byte data[TEST_CAP_SIZE + 1] = {};
+    sstm::result res{SSTM_ERR};
+    sstm::result res2{SSTM_OK};
+    sstm::handle ctx;
+    sstm_conf_t conf;
+
+    std::memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    ctx = sstm::make_handle(&conf);
+    TEST_CHECK(ctx != nullptr);
+    sstm::async_stream strm{ctx.get()};
+
+    /* what can never complete fails at once. */
+    test_task big_read = test_read_once(strm, std::span<std::byte>(data, TEST_CAP_SIZE + 1), &res);
+    TEST_CHECK(big_read.done() && res == sstm::err_no_data);
+    test_task big_write = test_write_once(strm, std::span<const std::byte>(data, TEST_CAP_SIZE + 1), &res);
+    TEST_CHECK(big_write.done() && res == sstm::err_no_space);
+
+    /* what can complete at once does not suspend. */
+    test_task write = test_write_once(strm, std::span<const std::byte>(data, 10), &res);
+    TEST_CHECK(write.done() && res == sstm::ok);
+    test_task read = test_read_once(strm, std::span<std::byte>(data, 10), &res);
+    TEST_CHECK(read.done() && res == sstm::ok);
+
+    /* a second reader cannot wait next to the first. */
+    res = sstm::result{SSTM_ERR};
+    test_task reader = test_read_once(strm, std::span<std::byte>(data, 4), &res);
+    test_task reader2 = test_read_once(strm, std::span<std::byte>(data, 4), &res2);
+    TEST_CHECK(!reader.done() && reader2.done() && res2 == sstm::result{SSTM_ERR});
+
+    /* a suspended reader that is destroyed is not resumed. */
+    reader.reset();
+    TEST_CHECK(strm.try_write(std::span<const std::byte>(data, 4)) == sstm::ok);
+    TEST_CHECK(res == sstm::result{SSTM_ERR} && strm.stat().fresh_size == 4);
+
+    /* the next one is resumed by the seek that makes its data fresh. */
+    TEST_CHECK(strm.seek(0, SSTM_SEEK_END) == sstm::ok);
+    reader = test_read_once(strm, std::span<std::byte>(data, 4), &res);
+    TEST_CHECK(!reader.done());
+    TEST_CHECK(strm.seek(0, SSTM_SEEK_SET) == sstm::ok);
+    TEST_CHECK(reader.done() && res == sstm::ok);
+
+    /* a suspended writer is resumed by the clean that frees its space. */
+    TEST_CHECK(strm.try_write(std::span<const std::byte>(data, TEST_CAP_SIZE)) == sstm::ok);
+    res = sstm::result{SSTM_ERR};
+    test_task writer = test_write_once(strm, std::span<const std::byte>(data, 8), &res);
+    TEST_CHECK(!writer.done());
+    TEST_CHECK(strm.try_read(std::span<std::byte>(data, 8), false) == sstm::ok);
+    TEST_CHECK(!writer.done());
+    TEST_CHECK(strm.clean() == sstm::ok);
+    TEST_CHECK(writer.done() && res == sstm::ok);
+}
+
+static void test_stream_gone(void) {
+    std::byte data[8] = {};
+    sstm::result res{SSTM_ERR};
+    sstm::handle ctx = sstm::make_handle();
+
+    TEST_CHECK(ctx != nullptr);
+    test_task reader;
+
+    /* the awaiter outlives the stream, and is never resumed. */
+    {
+        sstm::async_stream strm{ctx.get()};
+
+        reader = test_read_once(strm, std::span<std::byte>(data), &res);
+        TEST_CHECK(!reader.done());
+    }
+    TEST_CHECK(sstm_write(ctx.get(), data, sizeof(data)) == SSTM_OK);
+    reader.reset();
+    TEST_CHECK(res == sstm::result{SSTM_ERR});
+}
+
+int main() {
+    test_ping_pong();
+    test_edges();
+    test_stream_gone();
+    std::printf("async ok\n");
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * sstm_dup() test.
+ *
+ * writes to and reads from a growing set of clones at random, each
+ * checked against a copy of what it was cloned from plus what was
+ * written to it since, so that a write to one clone showing up in
+ * another is caught.
+*/
+
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_CLONES             8
+#define TEST_CAP_SIZE           20000
+#define TEST_ROUNDS             40000
+
+static test_model_t test_models[TEST_CLONES];
+static sstm_u8_t test_data[TEST_CAP_SIZE];
+
+int main(void) {
+    test_model_t *model;
+    sstm_conf_t conf;
+    sstm_u32_t state = 12345;
+    sstm_size_t size;
+    sstm_size_t k;
+    int count = 1;
+    int i;
+    int j;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    TEST_CHECK(sstm_new(&test_models[0].ctx, &conf) == SSTM_OK);
+
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        model = &test_models[test_rand(&state) % (sstm_u32_t)count];
+        switch (test_rand(&state) % 10) {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+                size = test_rand(&state) % 3000;
+                for (k = 0; k < size; k++) {
+                    test_data[k] = (sstm_u8_t)test_rand(&state);
+                }
+                if (sstm_write(model->ctx, test_data, size) == SSTM_OK) {
+                    test_model_put(model, model->tail, test_data, size);
+                    model->tail += size;
+                } else {
+                    TEST_CHECK(model->tail - model->head + size > TEST_CAP_SIZE);
+                }
+                break;
+            case 8:
+                if (count == TEST_CLONES) {
+                    break;
+                }
+                TEST_CHECK(sstm_dup(model->ctx, &test_models[count].ctx) == SSTM_OK);
+                memcpy(test_models[count].data, model->data, sizeof(model->data));
+                test_models[count].head = model->head;
+                test_models[count].seek = model->seek;
+                test_models[count].tail = model->tail;
+                count++;
+                break;
+            case 9:
+                if (count == 1 || test_rand(&state) % 4 != 0) {
+                    break;
+                }
+                j = (int)(test_rand(&state) % (sstm_u32_t)count);
+                sstm_del(test_models[j].ctx);
+                count--;
+                if (j != count) {
+                    memcpy(&test_models[j], &test_models[count], sizeof(test_models[j]));
+                }
+                continue;
+            default:
+                size = test_rand(&state) % 3000;
+                if (sstm_read(model->ctx, test_data, size, 1) == SSTM_OK) {
+                    TEST_CHECK(test_model_match(model, model->seek, test_data, size));
+                    model->seek += size;
+                }
+                break;
+        }
+        test_model_sync(model);
+    }
+
+    for (j = 0; j < count; j++) {
+        sstm_del(test_models[j].ctx);
+    }
+    printf("dup ok\n");
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * sstm_evfd() test.
+ *
+ * checks that the eventfds become readable exactly when the fresh
+ * size reaches the low watermark and the free size the high one,
+ * then has a producer and a consumer thread that only ever poll the
+ * eventfds before they write and read, so that a crossing that is
+ * never signalled hangs the test.
+*/
+
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_CAP_SIZE           1000
+#define TEST_MAX_SIZE           300
+#define TEST_TOTAL              (64 * 1024 * 1024)
+
+static sstm_ctx_t *test_ctx;
+static int test_read_fd;
+static int test_write_fd;
+
+/**
+ * @brief check whether an eventfd is readable, waiting for it up to
+ *        timeout milliseconds, negative for infinite.
+*/
+static sstm_bool_t test_ready(int fd, int timeout) {
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    TEST_CHECK(poll(&pfd, 1, timeout) >= 0);
+
+    return (pfd.revents & POLLIN) != 0;
+}
+
+static void test_marks(void) {
+    sstm_u8_t data[TEST_CAP_SIZE];
+    sstm_conf_t conf;
+    int read_fd;
+    int write_fd;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    TEST_CHECK(sstm_new(&test_ctx, &conf) == SSTM_OK);
+    TEST_CHECK(sstm_evfd(test_ctx, 100, 300, &read_fd, &write_fd) == SSTM_OK);
+    TEST_CHECK(!test_ready(read_fd, 0) && test_ready(write_fd, 0));
+
+    /* the fresh size crosses the low watermark. */
+    TEST_CHECK(sstm_write(test_ctx, data, 99) == SSTM_OK);
+    TEST_CHECK(!test_ready(read_fd, 0));
+    TEST_CHECK(sstm_write(test_ctx, data, 1) == SSTM_OK);
+    TEST_CHECK(test_ready(read_fd, 0));
+    TEST_CHECK(sstm_read(test_ctx, data, 1, 0) == SSTM_OK);
+    TEST_CHECK(!test_ready(read_fd, 0));
+
+    /* a seek back makes the stale data fresh again. */
+    TEST_CHECK(sstm_seek(test_ctx, 0, SSTM_SEEK_SET) == SSTM_OK);
+    TEST_CHECK(test_ready(read_fd, 0));
+
+    /* the free size crosses the high watermark. */
+    TEST_CHECK(sstm_write(test_ctx, data, 600) == SSTM_OK);
+    TEST_CHECK(test_ready(write_fd, 0));
+    TEST_CHECK(sstm_write(test_ctx, data, 1) == SSTM_OK);
+    TEST_CHECK(!test_ready(write_fd, 0));
+    TEST_CHECK(sstm_read(test_ctx, data, 1, 1) == SSTM_OK);
+    TEST_CHECK(test_ready(write_fd, 0));
+
+    /* new watermarks apply at once, the same eventfds are kept. */
+    TEST_CHECK(sstm_evfd(test_ctx, 1000, 0, &test_read_fd, &test_write_fd) == SSTM_OK);
+    TEST_CHECK(test_read_fd == read_fd && test_write_fd == write_fd);
+    TEST_CHECK(!test_ready(read_fd, 0) && test_ready(write_fd, 0));
+
+    /* a watermark above the capacity is clamped to it. */
+    TEST_CHECK(sstm_evfd(test_ctx, 5000, 5000, NULL, NULL) == SSTM_OK);
+    TEST_CHECK(!test_ready(read_fd, 0) && !test_ready(write_fd, 0));
+    TEST_CHECK(sstm_seek(test_ctx, 0, SSTM_SEEK_END) == SSTM_OK);
+    TEST_CHECK(sstm_clean(test_ctx) == SSTM_OK);
+    TEST_CHECK(!test_ready(read_fd, 0) && test_ready(write_fd, 0));
+    TEST_CHECK(sstm_write(test_ctx, data, TEST_CAP_SIZE) == SSTM_OK);
+    TEST_CHECK(test_ready(read_fd, 0) && !test_ready(write_fd, 0));
+
+    sstm_del(test_ctx);
+}
+
+static void *test_producer(void *arg) {
+    sstm_u8_t data[TEST_MAX_SIZE];
+    sstm_u64_t pos = 0;
+
+    (void)arg;
+    while (pos < TEST_TOTAL) {
+        TEST_CHECK(test_ready(test_write_fd, -1));
+        test_fill(data, pos, TEST_MAX_SIZE);
+
+        /* the readiness may lag behind a crossing the other
+           side is signalling, like any spurious wake up. */
+        if (sstm_write(test_ctx, data, TEST_MAX_SIZE) != SSTM_OK) {
+            sched_yield();
+            continue;
+        }
+        pos += TEST_MAX_SIZE;
+    }
+
+    return NULL;
+}
+
+static void test_poll(void) {
+    sstm_u8_t data[TEST_CAP_SIZE];
+    pthread_t thread;
+    sstm_conf_t conf;
+    sstm_stat_t stat;
+    sstm_u64_t pos = 0;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    TEST_CHECK(sstm_new(&test_ctx, &conf) == SSTM_OK);
+    TEST_CHECK(sstm_evfd(test_ctx, 1, TEST_MAX_SIZE, &test_read_fd, &test_write_fd) == SSTM_OK);
+
+    TEST_CHECK(pthread_create(&thread, NULL, test_producer, NULL) == 0);
+    while (pos < TEST_TOTAL) {
+        TEST_CHECK(test_ready(test_read_fd, -1));
+        sstm_stat(test_ctx, &stat);
+        if (stat.fresh_size == 0) {
+            sched_yield();
+            continue;
+        }
+        TEST_CHECK(sstm_read(test_ctx, data, stat.fresh_size, 1) == SSTM_OK);
+        TEST_CHECK(test_match(data, pos, stat.fresh_size));
+        pos += stat.fresh_size;
+    }
+    pthread_join(thread, NULL);
+
+    sstm_del(test_ctx);
+}
+
+int main(void) {
+    test_marks();
+    test_poll();
+    printf("evfd ok\n");
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * sstm_open_mmap() test.
+ *
+ * writes the test data to a temporary file, checks the errors of
+ * sstm_open_mmap() and runs random reads, seeks, preads and cleans
+ * on a view of the file, which must never take a write.
+*/
+
+#include <string.h>
+#include <unistd.h>
+
+#include "test.h"
+
+#define TEST_FILE_SIZE          (9 * 1024 * 1024 + 123)
+#define TEST_ROUNDS             100000
+
+static sstm_u8_t test_data[1 << 16];
+
+/**
+ * @brief create a temporary file of size bytes of the test data.
+*/
+static void test_file_new(char *path, sstm_size_t size) {
+    sstm_size_t done;
+    sstm_size_t part;
+    int fd;
+
+    fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    for (done = 0; done < size; done += part) {
+        part = size - done < sizeof(test_data) ? size - done : (sstm_size_t)sizeof(test_data);
+        test_fill(test_data, done, part);
+        TEST_CHECK(write(fd, test_data, part) == (ssize_t)part);
+    }
+    close(fd);
+}
+
+static void test_errors(void) {
+    char path[] = "/tmp/sstm_test_XXXXXX";
+    sstm_ctx_t *ctx;
+    sstm_u8_t data;
+
+    TEST_CHECK(sstm_open_mmap(&ctx, "/nonexistent/sstm_test") == SSTM_ERR);
+    TEST_CHECK(sstm_open_mmap(&ctx, "/tmp") == SSTM_ERR);
+
+    /* an empty file is an empty stream. */
+    test_file_new(path, 0);
+    TEST_CHECK(sstm_open_mmap(&ctx, path) == SSTM_OK);
+    TEST_CHECK(sstm_read(ctx, &data, 1, 0) == SSTM_ERR_NO_DATA);
+    TEST_CHECK(sstm_write(ctx, "a", 1) == SSTM_ERR_NO_SPACE);
+    sstm_del(ctx);
+    unlink(path);
+}
+
+static void test_view(void) {
+    char path[] = "/tmp/sstm_test_XXXXXX";
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_u32_t state = 7;
+    sstm_u64_t head = 0;
+    sstm_u64_t cur = 0;
+    sstm_u64_t pos;
+    sstm_size_t size;
+    sstm_offs_t delta;
+    sstm_s64_t target;
+    sstm_bool_t cleanup;
+    sstm_res_t res;
+    int i;
+
+    test_file_new(path, TEST_FILE_SIZE);
+    TEST_CHECK(sstm_open_mmap(&ctx, path) == SSTM_OK);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.cap_size == TEST_FILE_SIZE && stat.fresh_size == TEST_FILE_SIZE);
+    TEST_CHECK(stat.free_size == 0 && stat.tail_pos == TEST_FILE_SIZE);
+
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        size = test_rand(&state) % 4096 + 1;
+        switch (test_rand(&state) % 10) {
+            case 0:
+            case 1:
+                size = test_rand(&state) % sizeof(test_data) + 1;
+                /* fall through */
+            case 2:
+            case 3:
+            case 4:
+            case 5:
+                cleanup = test_rand(&state) % 8 == 0;
+                res = sstm_read(ctx, test_data, size, cleanup);
+                if (cur + size > TEST_FILE_SIZE) {
+                    TEST_CHECK(res == SSTM_ERR_NO_DATA);
+                    break;
+                }
+                TEST_CHECK(res == SSTM_OK && test_match(test_data, cur, size));
+                cur += size;
+                if (cleanup) {
+                    head = cur;
+                }
+                break;
+            case 6:
+                pos = head + test_rand(&state) % (TEST_FILE_SIZE - head + 1);
+                TEST_CHECK(sstm_seek_pos(ctx, pos) == SSTM_OK);
+                cur = pos;
+                break;
+            case 7:
+                delta = (sstm_offs_t)(test_rand(&state) % 20000) - 10000;
+                target = (sstm_s64_t)(cur - head) + delta;
+                res = sstm_seek(ctx, delta, SSTM_SEEK_CUR);
+                if (target < 0 || (sstm_u64_t)target > TEST_FILE_SIZE - head) {
+                    TEST_CHECK(res == SSTM_ERR_BAD_OFFS);
+                } else {
+                    TEST_CHECK(res == SSTM_OK);
+                    cur = head + (sstm_u64_t)target;
+                }
+                break;
+            case 8:
+                pos = test_rand(&state) % TEST_FILE_SIZE;
+                res = sstm_pread(ctx, pos, test_data, size);
+                if (pos < head) {
+                    TEST_CHECK(res == SSTM_ERR_BAD_OFFS);
+                } else if (pos + size > TEST_FILE_SIZE) {
+                    TEST_CHECK(res == SSTM_ERR_NO_DATA);
+                } else {
+                    TEST_CHECK(res == SSTM_OK && test_match(test_data, pos, size));
+                }
+                break;
+            default:
+                TEST_CHECK(sstm_write(ctx, test_data, 1) == SSTM_ERR_NO_SPACE);
+                TEST_CHECK(sstm_clean(ctx) == SSTM_OK);
+                head = cur;
+                break;
+        }
+
+        /* a clean never frees space in a view. */
+        sstm_stat(ctx, &stat);
+        TEST_CHECK(stat.head_pos == head && stat.head_pos + stat.seek_offs == cur);
+        TEST_CHECK(stat.free_size == 0);
+
+        /* start over on a new view once most of the file is cleaned. */
+        if (head > TEST_FILE_SIZE - 1000000) {
+            sstm_del(ctx);
+            TEST_CHECK(sstm_open_mmap(&ctx, path) == SSTM_OK);
+            head = 0;
+            cur = 0;
+        }
+    }
+
+    sstm_del(ctx);
+    unlink(path);
+}
+
+int main(void) {
+    test_errors();
+    test_view();
+    printf("file ok\n");
+
+    return 0;
+}
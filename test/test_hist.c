@@ -0,0 +1,147 @@
+/**
+ * sstm_hist() test.
+ *
+ * checks that every call of the timed operations is recorded in the
+ * histogram of its operation and nowhere else, that a clear empties
+ * them, that a merge adds them up, and the percentiles of histograms
+ * of known buckets.
+*/
+
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_ROUNDS             10000
+
+/**
+ * @brief check that a histogram holds count values and agrees with
+ *        itself.
+*/
+static void test_check_hist(const sstm_hist_t *hist, sstm_u64_t count) {
+    sstm_u64_t total = 0;
+    size_t i;
+
+    for (i = 0; i < SSTM_HIST_BUCKETS; i++) {
+        total += hist->buckets[i];
+    }
+    TEST_CHECK(hist->count == count && total == count);
+    if (count != 0) {
+        TEST_CHECK(hist->min <= hist->max);
+        TEST_CHECK(hist->sum >= hist->min * count && hist->sum <= hist->max * count);
+    }
+}
+
+static void test_record(void) {
+    sstm_u64_t counts[SSTM_OP_NUM] = {0};
+    sstm_hist_t hists[SSTM_OP_NUM];
+    sstm_hist_t merged;
+    sstm_u8_t data[100];
+    sstm_ctx_t *ctx;
+    sstm_ctx_t *ctx2;
+    sstm_u32_t state = 21;
+    sstm_u64_t value;
+    int op;
+    int i;
+
+    TEST_CHECK(sstm_new(&ctx, NULL) == SSTM_OK);
+    for (op = 0; op < SSTM_OP_NUM; op++) {
+        TEST_CHECK(sstm_hist(ctx, (sstm_op_t)op, &hists[op]) == SSTM_OK);
+        test_check_hist(&hists[op], 0);
+        TEST_CHECK(sstm_hist_pct(&hists[op], 0.5, &value) == SSTM_ERR_NO_DATA);
+    }
+    TEST_CHECK(sstm_hist(ctx, SSTM_OP_NUM, &hists[0]) == SSTM_ERR);
+
+    /* failed calls are timed as well. */
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        op = (int)(test_rand(&state) % SSTM_OP_NUM);
+        switch (op) {
+            case SSTM_OP_READ:
+                sstm_read(ctx, data, test_rand(&state) % sizeof(data), test_rand(&state) % 2);
+                break;
+            case SSTM_OP_WRITE:
+                sstm_write(ctx, data, test_rand(&state) % sizeof(data));
+                break;
+            case SSTM_OP_SEEK:
+                sstm_seek(ctx, (sstm_offs_t)(test_rand(&state) % 200) - 100, SSTM_SEEK_CUR);
+                break;
+            default:
+                sstm_clean(ctx);
+                break;
+        }
+        counts[op]++;
+    }
+    for (op = 0; op < SSTM_OP_NUM; op++) {
+        TEST_CHECK(sstm_hist(ctx, (sstm_op_t)op, &hists[op]) == SSTM_OK);
+        test_check_hist(&hists[op], counts[op]);
+        TEST_CHECK(sstm_hist_pct(&hists[op], 0.0, &value) == SSTM_OK && value >= hists[op].min);
+        TEST_CHECK(sstm_hist_pct(&hists[op], 1.0, &value) == SSTM_OK && value == hists[op].max);
+    }
+
+    /* the histograms of two streams add up. */
+    TEST_CHECK(sstm_new(&ctx2, NULL) == SSTM_OK);
+    TEST_CHECK(sstm_write(ctx2, data, sizeof(data)) == SSTM_OK);
+    TEST_CHECK(sstm_hist(ctx2, SSTM_OP_WRITE, &merged) == SSTM_OK);
+    test_check_hist(&merged, 1);
+    TEST_CHECK(sstm_hist_merge(&merged, &hists[SSTM_OP_WRITE]) == SSTM_OK);
+    test_check_hist(&merged, counts[SSTM_OP_WRITE] + 1);
+    TEST_CHECK(merged.min <= hists[SSTM_OP_WRITE].min && merged.max >= hists[SSTM_OP_WRITE].max);
+    TEST_CHECK(merged.sum >= hists[SSTM_OP_WRITE].sum);
+    sstm_del(ctx2);
+
+    /* a zeroed histogram takes the other one as it is. */
+    memset(&merged, 0, sizeof(merged));
+    TEST_CHECK(sstm_hist_merge(&merged, &hists[SSTM_OP_READ]) == SSTM_OK);
+    TEST_CHECK(memcmp(&merged, &hists[SSTM_OP_READ], sizeof(merged)) == 0);
+
+    TEST_CHECK(sstm_hist_clear(ctx) == SSTM_OK);
+    for (op = 0; op < SSTM_OP_NUM; op++) {
+        TEST_CHECK(sstm_hist(ctx, (sstm_op_t)op, &hists[op]) == SSTM_OK);
+        test_check_hist(&hists[op], 0);
+    }
+    sstm_del(ctx);
+}
+
+static void test_pct(void) {
+    sstm_hist_t hist;
+    sstm_u64_t value;
+
+    /* values below 2^SSTM_HIST_SUB_BITS have a bucket each. */
+    memset(&hist, 0, sizeof(hist));
+    hist.buckets[1] = 50;
+    hist.buckets[5] = 49;
+    hist.buckets[10] = 1;
+    hist.count = 100;
+    hist.min = 1;
+    hist.max = 10;
+    TEST_CHECK(sstm_hist_pct(&hist, 0.0, &value) == SSTM_OK && value == 1);
+    TEST_CHECK(sstm_hist_pct(&hist, 0.5, &value) == SSTM_OK && value == 1);
+    TEST_CHECK(sstm_hist_pct(&hist, 0.51, &value) == SSTM_OK && value == 5);
+    TEST_CHECK(sstm_hist_pct(&hist, 0.99, &value) == SSTM_OK && value == 5);
+    TEST_CHECK(sstm_hist_pct(&hist, 1.0, &value) == SSTM_OK && value == 10);
+
+    /* 1000 is in the bucket of [992, 1023], a percentile in it is
+       the top of the bucket, capped by the maximum. */
+    memset(&hist, 0, sizeof(hist));
+    hist.buckets[((9 - SSTM_HIST_SUB_BITS + 1) << SSTM_HIST_SUB_BITS) + 15] = 10;
+    hist.count = 10;
+    hist.min = 1000;
+    hist.max = 5000;
+    TEST_CHECK(sstm_hist_pct(&hist, 0.5, &value) == SSTM_OK && value == 1023);
+    hist.max = 1000;
+    TEST_CHECK(sstm_hist_pct(&hist, 0.5, &value) == SSTM_OK && value == 1000);
+
+    /* the last bucket has no top, it is the maximum. */
+    memset(&hist, 0, sizeof(hist));
+    hist.buckets[SSTM_HIST_BUCKETS - 1] = 1;
+    hist.count = 1;
+    hist.min = hist.max = (sstm_u64_t)1 << 50;
+    TEST_CHECK(sstm_hist_pct(&hist, 0.5, &value) == SSTM_OK && value == (sstm_u64_t)1 << 50);
+}
+
+int main(void) {
+    test_record();
+    test_pct();
+    printf("hist ok\n");
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * hole test.
+ *
+ * runs random writes of data and zeros, reads, zeroed reads, seeks,
+ * preads, pipes and cleans on two streams, checking every read
+ * against a model of the streams. half of the runs have room for
+ * three holes only, so that the zeros written past that are copied.
+ * then checks that a lazily committed ring buffer is not committed
+ * under a hole, which would fault it in.
+*/
+
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_CAP_SIZE           100000
+#define TEST_ROUNDS             20000
+#define TEST_MIB                (1024 * 1024)
+
+static sstm_u8_t test_in[TEST_CAP_SIZE];
+static sstm_u8_t test_out[TEST_CAP_SIZE + 8];
+static test_model_t test_models[2];
+
+static void test_run(sstm_size_t hole_num) {
+    test_model_t *model;
+    test_model_t *dst;
+    sstm_conf_t conf;
+    sstm_stat_t stat;
+    sstm_u32_t state = 987;
+    sstm_size_t size;
+    sstm_size_t back;
+    sstm_u64_t pos;
+    sstm_size_t k;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    conf.hole_num = hole_num;
+    memset(test_models, 0, sizeof(test_models));
+    TEST_CHECK(sstm_new(&test_models[0].ctx, &conf) == SSTM_OK);
+    TEST_CHECK(sstm_new(&test_models[1].ctx, &conf) == SSTM_OK);
+
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        model = &test_models[test_rand(&state) % 3 != 0 ? 0 : 1];
+        switch (test_rand(&state) % 10) {
+            case 0:
+            case 1:
+                size = test_rand(&state) % 9000;
+                for (k = 0; k < size; k++) {
+                    test_in[k] = (sstm_u8_t)(test_rand(&state) | 1);
+                }
+                if (sstm_write(model->ctx, test_in, size) == SSTM_OK) {
+                    test_model_put(model, model->tail, test_in, size);
+                    model->tail += size;
+                }
+                break;
+            case 2:
+            case 3:
+                size = test_rand(&state) % 20000;
+                if (sstm_write(model->ctx, NULL, size) == SSTM_OK) {
+                    test_model_put(model, model->tail, NULL, size);
+                    model->tail += size;
+                }
+                break;
+            case 4:
+                size = test_rand(&state) % 12000;
+                memset(test_out, 0xcc, size + 8);
+                if (sstm_read(model->ctx, test_out, size, test_rand(&state) % 2) == SSTM_OK) {
+                    TEST_CHECK(test_model_match(model, model->seek, test_out, size));
+                    TEST_CHECK(test_out[size] == 0xcc);
+                    model->seek += size;
+                }
+                break;
+            case 5:
+
+                /* the zeros of the holes are left as they are. */
+                size = test_rand(&state) % 12000;
+                memset(test_out, 0, size);
+                if (sstm_read_zeroed(model->ctx, test_out, size, 0) == SSTM_OK) {
+                    TEST_CHECK(test_model_match(model, model->seek, test_out, size));
+                    model->seek += size;
+                }
+                break;
+            case 6:
+                back = (sstm_size_t)(test_rand(&state) % (model->seek - model->head + 1));
+                TEST_CHECK(sstm_seek(model->ctx, -(sstm_offs_t)back, SSTM_SEEK_CUR) == SSTM_OK);
+                model->seek -= back;
+                break;
+            case 7:
+                if (model->tail == model->head) {
+                    break;
+                }
+                pos = model->head + test_rand(&state) % (model->tail - model->head);
+                size = (sstm_size_t)(test_rand(&state) % (model->tail - pos + 1));
+                TEST_CHECK(sstm_pread(model->ctx, pos, test_out, size) == SSTM_OK);
+                TEST_CHECK(test_model_match(model, pos, test_out, size));
+                break;
+            case 8:
+                dst = model == &test_models[0] ? &test_models[1] : &test_models[0];
+                size = test_rand(&state) % 15000;
+                if (sstm_pipe(model->ctx, dst->ctx, size, test_rand(&state) % 2) == SSTM_OK) {
+                    for (k = 0; k < size; k++) {
+                        dst->data[(dst->tail + k) % TEST_MODEL_SIZE] =
+                            model->data[(model->seek + k) % TEST_MODEL_SIZE];
+                    }
+                    dst->tail += size;
+                    model->seek += size;
+                    test_model_sync(dst);
+                }
+                break;
+            default:
+                TEST_CHECK(sstm_clean(model->ctx) == SSTM_OK);
+                break;
+        }
+        test_model_sync(model);
+    }
+
+    sstm_stat(test_models[0].ctx, &stat);
+    TEST_CHECK(stat.hole_bytes != 0);
+    sstm_del(test_models[0].ctx);
+    sstm_del(test_models[1].ctx);
+}
+
+static void test_lazy(void) {
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_u64_t rss;
+    sstm_size_t k;
+    int i;
+
+    /* the reads below fault in nothing of their own. */
+    memset(test_out, 0xcc, sizeof(test_out));
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 256 * TEST_MIB;
+    conf.hole_num = 2;
+    conf.mem_flags = SSTM_MEM_LAZY | SSTM_MEM_PREFAULT;
+    rss = test_rss();
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+    TEST_CHECK(sstm_write(ctx, NULL, 200 * TEST_MIB) == SSTM_OK);
+    TEST_CHECK(test_rss() - rss < TEST_MIB);
+
+    /* the zeros come from the index, the ring buffer under
+       them is not accessible and is not read either. */
+    TEST_CHECK(sstm_pread(ctx, 100 * TEST_MIB, test_out, TEST_CAP_SIZE) == SSTM_OK);
+    for (i = 0; i < 200 * TEST_MIB / TEST_CAP_SIZE; i++) {
+        TEST_CHECK(sstm_read(ctx, test_out, TEST_CAP_SIZE, 1) == SSTM_OK);
+        for (k = 0; k < TEST_CAP_SIZE; k++) {
+            TEST_CHECK(test_out[k] == 0);
+        }
+    }
+    TEST_CHECK(sstm_read(ctx, NULL, 200 * TEST_MIB % TEST_CAP_SIZE, 1) == SSTM_OK);
+    TEST_CHECK(test_rss() - rss < TEST_MIB);
+
+    /* the data after a hole, and the zeros that no longer fit
+       in the index, are committed as always. */
+    test_fill(test_in, 0, TEST_CAP_SIZE);
+    TEST_CHECK(sstm_write(ctx, test_in, TEST_CAP_SIZE) == SSTM_OK);
+    TEST_CHECK(sstm_write(ctx, NULL, 40 * TEST_MIB) == SSTM_OK);
+    TEST_CHECK(sstm_write(ctx, NULL, 10 * TEST_MIB) == SSTM_OK);
+    TEST_CHECK(sstm_write(ctx, NULL, 5 * TEST_MIB) == SSTM_OK);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.hole_bytes == 250 * TEST_MIB);
+    TEST_CHECK(sstm_read(ctx, test_out, TEST_CAP_SIZE, 1) == SSTM_OK);
+    TEST_CHECK(test_match(test_out, 0, TEST_CAP_SIZE));
+    for (i = 0; i < 55 * TEST_MIB / TEST_CAP_SIZE; i++) {
+        TEST_CHECK(sstm_read(ctx, test_out, TEST_CAP_SIZE, 1) == SSTM_OK);
+        for (k = 0; k < TEST_CAP_SIZE; k++) {
+            TEST_CHECK(test_out[k] == 0);
+        }
+    }
+    sstm_del(ctx);
+}
+
+int main(void) {
+    test_run(0);
+    test_run(3);
+    test_lazy();
+    printf("hole ok\n");
+
+    return 0;
+}
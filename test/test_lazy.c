@@ -0,0 +1,137 @@
+/**
+ * SSTM_MEM_LAZY and SSTM_MEM_RELEASE test.
+ *
+ * follows the resident size of the process: a lazily committed ring
+ * buffer faulted in at commit only grows with the writes, and the
+ * free pages of a stream that stays nearly empty are given back,
+ * with the data that goes through it afterwards still intact.
+*/
+
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_MIB                (1024 * 1024)
+#define TEST_CHUNK_SIZE         (64 * 1024)
+
+static sstm_u8_t test_data[TEST_CHUNK_SIZE];
+
+/**
+ * @brief write size bytes of the test data to a stream.
+*/
+static void test_write(sstm_ctx_t *ctx, sstm_u64_t *pos, sstm_u64_t size) {
+    sstm_u64_t end = *pos + size;
+
+    while (*pos < end) {
+        test_fill(test_data, *pos, TEST_CHUNK_SIZE);
+        TEST_CHECK(sstm_write(ctx, test_data, TEST_CHUNK_SIZE) == SSTM_OK);
+        *pos += TEST_CHUNK_SIZE;
+    }
+}
+
+/**
+ * @brief read size bytes of the test data from a stream, cleaning
+ *        after every chunk.
+*/
+static void test_read(sstm_ctx_t *ctx, sstm_u64_t *pos, sstm_u64_t size) {
+    sstm_u64_t end = *pos + size;
+
+    while (*pos < end) {
+        TEST_CHECK(sstm_read(ctx, test_data, TEST_CHUNK_SIZE, 1) == SSTM_OK);
+        TEST_CHECK(test_match(test_data, *pos, TEST_CHUNK_SIZE));
+        *pos += TEST_CHUNK_SIZE;
+    }
+}
+
+static void test_commit(void) {
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_u64_t rss;
+    sstm_u64_t write_pos = 0;
+    sstm_u64_t read_pos = 0;
+
+    /* prefaulted at creation, the whole ring is resident. */
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 32 * TEST_MIB;
+    conf.mem_flags = SSTM_MEM_PREFAULT;
+    rss = test_rss();
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+    TEST_CHECK(test_rss() - rss >= 31 * TEST_MIB);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.mem_kind == SSTM_MEM_KIND_PAGE);
+    sstm_del(ctx);
+
+    /* prefaulted at commit, only what the writes reach is. */
+    conf.cap_size = 256 * TEST_MIB;
+    conf.mem_flags = SSTM_MEM_LAZY | SSTM_MEM_PREFAULT;
+    rss = test_rss();
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+    TEST_CHECK(test_rss() - rss < TEST_MIB);
+    test_write(ctx, &write_pos, 16 * TEST_MIB);
+    test_read(ctx, &read_pos, 16 * TEST_MIB);
+    TEST_CHECK(test_rss() - rss >= 16 * TEST_MIB && test_rss() - rss < 24 * TEST_MIB);
+
+    /* around the ring, the wrapping writes commit nothing more. */
+    test_write(ctx, &write_pos, 240 * TEST_MIB);
+    test_read(ctx, &read_pos, 240 * TEST_MIB);
+    TEST_CHECK(test_rss() - rss >= 255 * TEST_MIB);
+    test_write(ctx, &write_pos, 32 * TEST_MIB);
+    test_read(ctx, &read_pos, 32 * TEST_MIB);
+    sstm_del(ctx);
+}
+
+static void test_release(void) {
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_u64_t rss;
+    sstm_u64_t write_pos = 0;
+    sstm_u64_t read_pos = 0;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 64 * TEST_MIB;
+    conf.mem_flags = SSTM_MEM_LAZY | SSTM_MEM_RELEASE;
+    rss = test_rss();
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+
+    /* the writes fault in what they reach. */
+    test_write(ctx, &write_pos, 48 * TEST_MIB);
+    TEST_CHECK(test_rss() - rss >= 47 * TEST_MIB);
+
+    /* the cleans count once the stream is nearly empty, the free
+       pages are given back after SSTM_MEM_IDLE_CLEANS of them. */
+    test_read(ctx, &read_pos, 48 * TEST_MIB);
+    for (i = 0; i < SSTM_MEM_IDLE_CLEANS; i++) {
+        test_write(ctx, &write_pos, TEST_CHUNK_SIZE);
+        test_read(ctx, &read_pos, TEST_CHUNK_SIZE);
+    }
+    TEST_CHECK(test_rss() - rss < 8 * TEST_MIB);
+
+    /* the released pages take new data as before. */
+    test_write(ctx, &write_pos, 56 * TEST_MIB);
+    TEST_CHECK(test_rss() - rss >= 55 * TEST_MIB);
+    test_read(ctx, &read_pos, 56 * TEST_MIB);
+    sstm_del(ctx);
+
+    /* a stream that is never nearly empty keeps its pages. */
+    write_pos = 0;
+    read_pos = 0;
+    rss = test_rss();
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+    test_write(ctx, &write_pos, 16 * TEST_MIB);
+    for (i = 0; i < 4 * SSTM_MEM_IDLE_CLEANS; i++) {
+        test_write(ctx, &write_pos, TEST_CHUNK_SIZE);
+        test_read(ctx, &read_pos, TEST_CHUNK_SIZE);
+    }
+    TEST_CHECK(test_rss() - rss >= 31 * TEST_MIB);
+    sstm_del(ctx);
+}
+
+int main(void) {
+    test_commit();
+    test_release();
+    printf("lazy ok\n");
+
+    return 0;
+}
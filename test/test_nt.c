@@ -0,0 +1,101 @@
+/**
+ * SSTM_USE_NT test.
+ *
+ * writes and reads sizes on both sides of SSTM_NT_MIN_SIZE, from and
+ * into buffers at every alignment and across the end of a ring whose
+ * size is not a multiple of any vector, and checks the data, the
+ * bytes around the read buffer and the counts of the copies that
+ * took the non-temporal path. it is built with a small
+ * SSTM_NT_MIN_SIZE, which only sets the sizes the copies start at.
+*/
+
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_CAP_SIZE           (8 * SSTM_NT_MIN_SIZE + 77)
+#define TEST_MAX_SIZE           (3 * SSTM_NT_MIN_SIZE)
+#define TEST_ROUNDS             40000
+
+/* room for the largest copy at any offset in a cache line. */
+static sstm_u8_t test_src[TEST_MAX_SIZE + 64];
+static sstm_u8_t test_dst[TEST_MAX_SIZE + 128];
+
+/**
+ * @brief get a size near SSTM_NT_MIN_SIZE more often than not.
+*/
+static sstm_size_t test_size(sstm_u32_t *state) {
+    sstm_u32_t r = test_rand(state);
+
+    if (r % 2 == 0) {
+        return SSTM_NT_MIN_SIZE - 70 + test_rand(state) % 140;
+    }
+
+    return test_rand(state) % (TEST_MAX_SIZE + 1);
+}
+
+int main(void) {
+    sstm_u64_t nt_writes = 0;
+    sstm_u64_t nt_reads = 0;
+    sstm_u64_t write_pos = 0;
+    sstm_u64_t read_pos = 0;
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_u32_t state = 77;
+    sstm_size_t size;
+    sstm_size_t offs;
+    sstm_size_t i;
+    int round;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+
+    for (round = 0; round < TEST_ROUNDS; round++) {
+        size = test_size(&state);
+        offs = test_rand(&state) % 64;
+        test_fill(test_src + offs, write_pos, size);
+        if (sstm_write(ctx, test_src + offs, size) == SSTM_OK) {
+            write_pos += size;
+            nt_writes += size >= SSTM_NT_MIN_SIZE;
+        }
+
+        size = test_size(&state);
+        offs = test_rand(&state) % 64;
+        memset(test_dst, 0xa5, sizeof(test_dst));
+        if (sstm_read(ctx, test_dst + offs, size, 1) == SSTM_OK) {
+            TEST_CHECK(test_match(test_dst + offs, read_pos, size));
+            read_pos += size;
+            nt_reads += size >= SSTM_NT_MIN_SIZE;
+        }
+
+        /* the vector stores stay inside the buffer. */
+        for (i = 0; i < offs; i++) {
+            TEST_CHECK(test_dst[i] == 0xa5);
+        }
+        for (i = offs + size; i < sizeof(test_dst); i++) {
+            TEST_CHECK(test_dst[i] == 0xa5);
+        }
+    }
+
+    /* skips copy nothing. */
+    sstm_stat(ctx, &stat);
+    if (stat.fresh_size >= SSTM_NT_MIN_SIZE) {
+        TEST_CHECK(sstm_read(ctx, NULL, SSTM_NT_MIN_SIZE, 1) == SSTM_OK);
+    }
+
+    sstm_stat(ctx, &stat);
+#if SSTM_USE_NT
+    TEST_CHECK(stat.nt_writes == nt_writes && stat.nt_reads == nt_reads);
+#else
+    TEST_CHECK(stat.nt_writes == 0 && stat.nt_reads == 0);
+#endif
+    TEST_CHECK(nt_writes > TEST_ROUNDS / 8 && nt_reads > TEST_ROUNDS / 8);
+    TEST_CHECK(stat.write_splits != 0 && stat.read_splits != 0);
+
+    sstm_del(ctx);
+    printf("nt ok\n");
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * sstm_pipe() test.
+ *
+ * writes to a stream, pipes it to another and reads that one, for
+ * capacities that split the copies at every place. a pipe that
+ * fails must leave both streams as they were.
+*/
+
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_ROUNDS             3000
+#define TEST_MAX_SIZE           60
+
+static void test_run(sstm_size_t src_cap, sstm_size_t dst_cap, sstm_u32_t *state) {
+    sstm_u8_t data[TEST_MAX_SIZE];
+    sstm_stat_t src_before, dst_before;
+    sstm_stat_t src_after, dst_after;
+    sstm_conf_t conf;
+    sstm_ctx_t *src;
+    sstm_ctx_t *dst;
+    sstm_u64_t write_pos = 0;
+    sstm_u64_t read_pos = 0;
+    sstm_size_t size;
+    sstm_res_t res;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = src_cap;
+    TEST_CHECK(sstm_new(&src, &conf) == SSTM_OK);
+    conf.cap_size = dst_cap;
+    TEST_CHECK(sstm_new(&dst, &conf) == SSTM_OK);
+
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        size = test_rand(state) % TEST_MAX_SIZE;
+        test_fill(data, write_pos, size);
+        if (sstm_write(src, data, size) == SSTM_OK) {
+            write_pos += size;
+        }
+
+        size = test_rand(state) % TEST_MAX_SIZE;
+        sstm_stat(src, &src_before);
+        sstm_stat(dst, &dst_before);
+        res = sstm_pipe(src, dst, size, 1);
+        if (res != SSTM_OK) {
+            sstm_stat(src, &src_after);
+            sstm_stat(dst, &dst_after);
+            TEST_CHECK(src_after.used_size == src_before.used_size);
+            TEST_CHECK(src_after.seek_offs == src_before.seek_offs);
+            TEST_CHECK(dst_after.used_size == dst_before.used_size);
+            TEST_CHECK(dst_after.fresh_size == dst_before.fresh_size);
+            TEST_CHECK((res == SSTM_ERR_NO_DATA && size > src_before.fresh_size) ||
+                       (res == SSTM_ERR_NO_SPACE && size > dst_before.free_size));
+        }
+
+        size = test_rand(state) % TEST_MAX_SIZE;
+        if (sstm_read(dst, data, size, 1) == SSTM_OK) {
+            TEST_CHECK(test_match(data, read_pos, size));
+            read_pos += size;
+        }
+    }
+    TEST_CHECK(read_pos > 1000);
+
+    sstm_del(src);
+    sstm_del(dst);
+}
+
+int main(void) {
+    sstm_u32_t state = 5;
+    sstm_size_t src_cap;
+    sstm_size_t dst_cap;
+
+    for (src_cap = 50; src_cap < 300; src_cap += 41) {
+        for (dst_cap = 50; dst_cap < 300; dst_cap += 53) {
+            test_run(src_cap, dst_cap, &state);
+        }
+    }
+    printf("pipe ok\n");
+
+    return 0;
+}
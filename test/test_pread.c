@@ -0,0 +1,131 @@
+/**
+ * sstm_pread() test.
+ *
+ * checks the bounds of the readable range, then has three threads
+ * read at random positions while the stream is written, read and
+ * cleaned under them. a read that loses its data to a clean must
+ * fail, any data it returns must be the data written there.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_READERS            3
+#define TEST_ROUNDS             200000
+
+static sstm_ctx_t *test_ctx;
+static volatile int test_stop;
+
+static void test_bounds(void) {
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_u8_t data[256];
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 100;
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+
+    test_fill(data, 0, 80);
+    TEST_CHECK(sstm_write(ctx, data, 80) == SSTM_OK);
+    TEST_CHECK(sstm_pread(ctx, 10, data, 50) == SSTM_OK && test_match(data, 10, 50));
+    TEST_CHECK(sstm_pread(ctx, 79, data, 1) == SSTM_OK && test_match(data, 79, 1));
+    TEST_CHECK(sstm_pread(ctx, 80, data, 0) == SSTM_OK);
+    TEST_CHECK(sstm_pread(ctx, 40, data, 41) == SSTM_ERR_NO_DATA);
+    TEST_CHECK(sstm_pread(ctx, 80, data, 1) == SSTM_ERR_NO_DATA);
+
+    /* pos + size wraps, it must not pass the check. */
+    TEST_CHECK(sstm_pread(ctx, UINT64_MAX - 10, data, 50) == SSTM_ERR_NO_DATA);
+    TEST_CHECK(sstm_pread(ctx, UINT64_MAX, data, 1) == SSTM_ERR_NO_DATA);
+
+    /* neither the seeking offset nor the head move. */
+    TEST_CHECK(sstm_read(ctx, data, 30, 1) == SSTM_OK && test_match(data, 0, 30));
+    TEST_CHECK(sstm_pread(ctx, 29, data, 2) == SSTM_ERR_BAD_OFFS);
+    TEST_CHECK(sstm_pread(ctx, 30, data, 50) == SSTM_OK && test_match(data, 30, 50));
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.head_pos == 30 && stat.tail_pos == 80 && stat.seek_offs == 0);
+
+    /* across the end of the ring buffer. */
+    test_fill(data, 80, 45);
+    TEST_CHECK(sstm_write(ctx, data, 45) == SSTM_OK);
+    TEST_CHECK(sstm_pread(ctx, 60, data, 65) == SSTM_OK && test_match(data, 60, 65));
+
+    sstm_del(ctx);
+}
+
+static void *test_reader(void *arg) {
+    sstm_u32_t state = (sstm_u32_t)(uintptr_t)arg;
+    sstm_u8_t data[3000];
+    sstm_stat_t stat;
+    sstm_u64_t pos;
+    sstm_size_t size;
+    sstm_res_t res;
+
+    while (!test_stop) {
+        sstm_stat(test_ctx, &stat);
+        if (stat.tail_pos <= stat.head_pos) {
+            sched_yield();
+            continue;
+        }
+        pos = stat.head_pos + test_rand(&state) % (stat.tail_pos - stat.head_pos);
+        size = test_rand(&state) % sizeof(data) + 1;
+        res = sstm_pread(test_ctx, pos, data, size);
+        if (res == SSTM_OK) {
+            TEST_CHECK(test_match(data, pos, size));
+        } else {
+            TEST_CHECK(res == SSTM_ERR_BAD_OFFS || res == SSTM_ERR_NO_DATA);
+        }
+
+        /* leave the writer some of a single cpu, not so
+           often that no read is cut by a switch. */
+        if (test_rand(&state) % 128 == 0) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void test_stress(void) {
+    pthread_t threads[TEST_READERS];
+    sstm_u8_t data[4000];
+    sstm_conf_t conf;
+    sstm_u32_t state = 1;
+    sstm_u64_t pos = 0;
+    sstm_size_t size;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 20000;
+    TEST_CHECK(sstm_new(&test_ctx, &conf) == SSTM_OK);
+
+    for (i = 0; i < TEST_READERS; i++) {
+        TEST_CHECK(pthread_create(&threads[i], NULL, test_reader, (void *)(uintptr_t)(i + 1)) == 0);
+    }
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        size = test_rand(&state) % sizeof(data) + 1;
+        test_fill(data, pos, size);
+        if (sstm_write(test_ctx, data, size) == SSTM_OK) {
+            pos += size;
+        }
+        sstm_read(test_ctx, NULL, test_rand(&state) % sizeof(data) + 1, 1);
+    }
+    test_stop = 1;
+    for (i = 0; i < TEST_READERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    sstm_del(test_ctx);
+}
+
+int main(void) {
+    test_bounds();
+    test_stress();
+    printf("pread ok\n");
+
+    return 0;
+}
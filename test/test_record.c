@@ -0,0 +1,142 @@
+/**
+ * sstm_write_record() / sstm_read_record() / sstm_seek_record() test.
+ *
+ * checks the record index against a full index, seeks by record and
+ * cleans that cut a record, then passes records of every size from
+ * a producer thread to a consumer thread.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_RECORDS            20000
+#define TEST_MAX_SIZE           300
+
+static sstm_ctx_t *test_ctx;
+
+/* the size of the record with an index. */
+static sstm_size_t test_size(sstm_u32_t i) {
+    return (sstm_size_t)((i * 7919u) % TEST_MAX_SIZE);
+}
+
+static void test_single(void) {
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_u8_t data[64];
+    sstm_size_t size;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 256;
+    conf.rec_num = 8;
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+    TEST_CHECK(sstm_read_record(ctx, data, sizeof(data), &size, 0) == SSTM_ERR_NO_DATA);
+
+    /* record i is i bytes of i. */
+    for (i = 0; i < 8; i++) {
+        memset(data, i, (size_t)i);
+        TEST_CHECK(sstm_write_record(ctx, data, (sstm_size_t)i) == SSTM_OK);
+    }
+    TEST_CHECK(sstm_write_record(ctx, data, 1) == SSTM_ERR_NO_SPACE);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.rec_count == 8 && stat.rec_offs == 0);
+
+    TEST_CHECK(sstm_read_record(ctx, data, sizeof(data), &size, 0) == SSTM_OK && size == 0);
+    TEST_CHECK(sstm_read_record(ctx, data, 0, &size, 0) == SSTM_ERR_NO_SPACE && size == 1);
+    TEST_CHECK(sstm_read_record(ctx, data, sizeof(data), &size, 0) == SSTM_OK &&
+               size == 1 && data[0] == 1);
+    TEST_CHECK(sstm_seek_record(ctx, 5) == SSTM_OK);
+    TEST_CHECK(sstm_read_record(ctx, data, sizeof(data), &size, 0) == SSTM_OK &&
+               size == 5 && data[4] == 5);
+    TEST_CHECK(sstm_seek_record(ctx, 8) == SSTM_ERR_BAD_OFFS);
+
+    /* the seeking offset is not at a record. */
+    TEST_CHECK(sstm_seek(ctx, 1, SSTM_SEEK_CUR) == SSTM_OK);
+    TEST_CHECK(sstm_read_record(ctx, data, sizeof(data), &size, 0) == SSTM_ERR_BAD_OFFS);
+
+    /* skip a record and clean the four before it. */
+    TEST_CHECK(sstm_seek_record(ctx, 3) == SSTM_OK);
+    TEST_CHECK(sstm_read_record(ctx, NULL, 0, &size, 1) == SSTM_OK && size == 3);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.rec_count == 4 && stat.rec_offs == 0);
+    TEST_CHECK(sstm_read_record(ctx, data, sizeof(data), &size, 0) == SSTM_OK &&
+               size == 4 && data[3] == 4);
+
+    /* a clean in the middle of a record drops it. */
+    TEST_CHECK(sstm_seek(ctx, 2, SSTM_SEEK_CUR) == SSTM_OK);
+    TEST_CHECK(sstm_clean(ctx) == SSTM_OK);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.rec_count == 2);
+    TEST_CHECK(sstm_read_record(ctx, data, sizeof(data), &size, 0) == SSTM_ERR_BAD_OFFS);
+    TEST_CHECK(sstm_seek_record(ctx, 0) == SSTM_OK);
+    TEST_CHECK(sstm_read_record(ctx, data, sizeof(data), &size, 0) == SSTM_OK && size == 6);
+
+    /* around the ring buffer. */
+    for (i = 0; i < 1000; i++) {
+        TEST_CHECK(sstm_seek(ctx, 0, SSTM_SEEK_END) == SSTM_OK);
+        TEST_CHECK(sstm_clean(ctx) == SSTM_OK);
+        test_fill(data, (sstm_u64_t)i, 37);
+        TEST_CHECK(sstm_write_record(ctx, data, 37) == SSTM_OK);
+        TEST_CHECK(sstm_read_record(ctx, data, sizeof(data), &size, 1) == SSTM_OK &&
+                   size == 37 && test_match(data, (sstm_u64_t)i, 37));
+    }
+
+    sstm_del(ctx);
+}
+
+static void *test_producer(void *arg) {
+    sstm_u8_t data[TEST_MAX_SIZE];
+    sstm_u32_t i;
+
+    (void)arg;
+    for (i = 0; i < TEST_RECORDS; ) {
+        test_fill(data, i, test_size(i));
+        if (sstm_write_record(test_ctx, data, test_size(i)) == SSTM_OK) {
+            i++;
+        } else {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void test_threads(void) {
+    pthread_t producer;
+    sstm_u8_t data[TEST_MAX_SIZE];
+    sstm_conf_t conf;
+    sstm_size_t size;
+    sstm_res_t res;
+    sstm_u32_t i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 1024;
+    TEST_CHECK(sstm_new(&test_ctx, &conf) == SSTM_OK);
+    TEST_CHECK(pthread_create(&producer, NULL, test_producer, NULL) == 0);
+
+    for (i = 0; i < TEST_RECORDS; ) {
+        res = sstm_read_record(test_ctx, data, sizeof(data), &size, 1);
+        if (res == SSTM_ERR_NO_DATA) {
+            sched_yield();
+            continue;
+        }
+        TEST_CHECK(res == SSTM_OK);
+        TEST_CHECK(size == test_size(i) && test_match(data, i, size));
+        i++;
+    }
+
+    pthread_join(producer, NULL);
+    sstm_del(test_ctx);
+}
+
+int main(void) {
+    test_single();
+    test_threads();
+    printf("record ok\n");
+
+    return 0;
+}
@@ -0,0 +1,288 @@
+/**
+ * sstm_write_ref() test.
+ *
+ * runs random writes, ref writes, reads, seeks, preads and cleans,
+ * checking every read against a model of the stream and that every
+ * ref is released once, with its arg. in SPSC mode three threads
+ * also pread the refs while the consumer cleans them, the released
+ * buffers are scribbled over before they are freed. last, a lazily
+ * committed ring buffer must not be committed under the refs.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_CAP_SIZE           100000
+#define TEST_ROUNDS             20000
+#define TEST_MIB                (1024 * 1024)
+#define TEST_CHUNK_SIZE         (64 * 1024)
+
+static sstm_u8_t test_out[TEST_CAP_SIZE + 8];
+static test_model_t test_model;
+
+/* the number of refs written and released. */
+static unsigned long test_refs;
+static unsigned long test_releases;
+
+static void test_release(void *arg, const void *data, sstm_size_t size) {
+    memset((void *)data, 0xdd, size);
+    free((void *)data);
+    __atomic_add_fetch((unsigned long *)arg, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief write a ref of the test data at the tail of the stream.
+*/
+static sstm_res_t test_write_ref(sstm_ctx_t *ctx, sstm_u64_t pos, sstm_size_t size) {
+    sstm_u8_t *data;
+    sstm_res_t res;
+
+    data = (sstm_u8_t *)malloc(size);
+    TEST_CHECK(data != NULL);
+    test_fill(data, pos, size);
+    res = sstm_write_ref(ctx, data, size, test_release, &test_releases);
+    if (res == SSTM_OK) {
+        test_refs++;
+    } else {
+        free(data);
+    }
+
+    return res;
+}
+
+static void test_model_run(void) {
+    test_model_t *model = &test_model;
+    sstm_u8_t data[16];
+    sstm_conf_t conf;
+    sstm_u32_t state = 4242;
+    sstm_size_t size;
+    sstm_size_t back;
+    sstm_u64_t pos;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    TEST_CHECK(sstm_new(&model->ctx, &conf) == SSTM_OK);
+
+    /* a ref of size 0 writes nothing and is not released. */
+    TEST_CHECK(sstm_write_ref(model->ctx, data, 0, test_release, &test_releases) == SSTM_OK);
+    TEST_CHECK(test_releases == 0);
+
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        switch (test_rand(&state) % 9) {
+            case 0:
+            case 1:
+                size = test_rand(&state) % 9000;
+                test_fill(test_out, model->tail, size);
+                if (sstm_write(model->ctx, test_out, size) == SSTM_OK) {
+                    test_model_put(model, model->tail, test_out, size);
+                    model->tail += size;
+                }
+                break;
+            case 2:
+            case 3:
+                size = test_rand(&state) % 20000 + 1;
+                if (test_write_ref(model->ctx, model->tail, size) == SSTM_OK) {
+                    test_fill(test_out, model->tail, size);
+                    test_model_put(model, model->tail, test_out, size);
+                    model->tail += size;
+                }
+                break;
+            case 4:
+            case 5:
+                size = test_rand(&state) % 12000;
+                memset(test_out, 0xcc, size + 8);
+                if (sstm_read(model->ctx, test_out, size, test_rand(&state) % 2) == SSTM_OK) {
+                    TEST_CHECK(test_model_match(model, model->seek, test_out, size));
+                    TEST_CHECK(test_out[size] == 0xcc);
+                    model->seek += size;
+                }
+                break;
+            case 6:
+                back = (sstm_size_t)(test_rand(&state) % (model->seek - model->head + 1));
+                TEST_CHECK(sstm_seek(model->ctx, -(sstm_offs_t)back, SSTM_SEEK_CUR) == SSTM_OK);
+                model->seek -= back;
+                break;
+            case 7:
+                if (model->tail == model->head) {
+                    break;
+                }
+                pos = model->head + test_rand(&state) % (model->tail - model->head);
+                size = (sstm_size_t)(test_rand(&state) % (model->tail - pos + 1));
+                TEST_CHECK(sstm_pread(model->ctx, pos, test_out, size) == SSTM_OK);
+                TEST_CHECK(test_model_match(model, pos, test_out, size));
+                break;
+            default:
+                TEST_CHECK(sstm_clean(model->ctx) == SSTM_OK);
+                break;
+        }
+        test_model_sync(model);
+    }
+
+    /* the refs left are released with the stream. */
+    sstm_del(model->ctx);
+    TEST_CHECK(test_refs != 0 && test_releases == test_refs);
+}
+
+#if SSTM_USE_SPSC
+
+#define TEST_READERS            3
+#define TEST_WRITES             200000
+
+static sstm_ctx_t *test_ctx;
+static volatile int test_stop;
+
+static void *test_reader(void *arg) {
+    sstm_u32_t state = (sstm_u32_t)(uintptr_t)arg;
+    sstm_u8_t data[3000];
+    sstm_stat_t stat;
+    sstm_u64_t pos;
+    sstm_size_t size;
+    sstm_res_t res;
+
+    while (!test_stop) {
+        sstm_stat(test_ctx, &stat);
+        if (stat.tail_pos <= stat.head_pos) {
+            sched_yield();
+            continue;
+        }
+        pos = stat.head_pos + test_rand(&state) % (stat.tail_pos - stat.head_pos);
+        size = test_rand(&state) % sizeof(data) + 1;
+        res = sstm_pread(test_ctx, pos, data, size);
+        if (res == SSTM_OK) {
+            TEST_CHECK(test_match(data, pos, size));
+        } else {
+            TEST_CHECK(res == SSTM_ERR_BAD_OFFS || res == SSTM_ERR_NO_DATA);
+        }
+
+        /* leave the writer some of a single cpu, not so
+           often that no read is cut by a switch. */
+        if (test_rand(&state) % 128 == 0) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void *test_consumer(void *arg) {
+    sstm_u32_t state = 7;
+
+    (void)arg;
+    while (!test_stop) {
+        if (sstm_read(test_ctx, NULL, test_rand(&state) % 4000 + 1, 1) != SSTM_OK) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void test_threads(void) {
+    pthread_t threads[TEST_READERS + 1];
+    sstm_u8_t data[2000];
+    sstm_conf_t conf;
+    sstm_u32_t state = 1;
+    sstm_u64_t pos = 0;
+    sstm_size_t size;
+    sstm_res_t res;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 20000;
+    conf.ref_num = 16;
+    TEST_CHECK(sstm_new(&test_ctx, &conf) == SSTM_OK);
+    test_refs = 0;
+    test_releases = 0;
+
+    for (i = 0; i < TEST_READERS; i++) {
+        TEST_CHECK(pthread_create(&threads[i], NULL, test_reader, (void *)(uintptr_t)(i + 1)) == 0);
+    }
+    TEST_CHECK(pthread_create(&threads[TEST_READERS], NULL, test_consumer, NULL) == 0);
+
+    for (i = 0; i < TEST_WRITES; i++) {
+        size = test_rand(&state) % sizeof(data) + 1;
+        if (i % 2 != 0) {
+            res = test_write_ref(test_ctx, pos, size);
+        } else {
+            test_fill(data, pos, size);
+            res = sstm_write(test_ctx, data, size);
+        }
+        if (res == SSTM_OK) {
+            pos += size;
+        } else {
+            sched_yield();
+        }
+    }
+    test_stop = 1;
+    for (i = 0; i <= TEST_READERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    sstm_del(test_ctx);
+    TEST_CHECK(test_refs != 0 && __atomic_load_n(&test_releases, __ATOMIC_RELAXED) == test_refs);
+}
+
+#endif
+
+static void test_lazy(void) {
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_u8_t *data;
+    sstm_u64_t rss;
+    sstm_u64_t pos;
+    int i;
+
+    /* one buffer for all the refs, faulted in up front. */
+    data = (sstm_u8_t *)malloc(TEST_MIB);
+    TEST_CHECK(data != NULL);
+    test_fill(data, 0, TEST_MIB);
+    memset(test_out, 0xcc, sizeof(test_out));
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 256 * TEST_MIB;
+    conf.mem_flags = SSTM_MEM_LAZY | SSTM_MEM_PREFAULT;
+    rss = test_rss();
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+    for (i = 0; i < 200; i++) {
+        TEST_CHECK(sstm_write_ref(ctx, data, TEST_MIB, NULL, NULL) == SSTM_OK);
+    }
+    TEST_CHECK(test_rss() - rss < TEST_MIB);
+
+    /* the data comes from the refs, the ring buffer under them
+       is not accessible and is not read either. */
+    TEST_CHECK(sstm_pread(ctx, 100 * TEST_MIB, test_out, TEST_CHUNK_SIZE) == SSTM_OK);
+    TEST_CHECK(memcmp(test_out, data, TEST_CHUNK_SIZE) == 0);
+    for (pos = 0; pos < 200 * TEST_MIB; pos += TEST_CHUNK_SIZE) {
+        TEST_CHECK(sstm_read(ctx, test_out, TEST_CHUNK_SIZE, 1) == SSTM_OK);
+        TEST_CHECK(memcmp(test_out, data + pos % TEST_MIB, TEST_CHUNK_SIZE) == 0);
+    }
+    TEST_CHECK(test_rss() - rss < TEST_MIB);
+
+    /* the data written after them is committed as always. */
+    TEST_CHECK(sstm_write(ctx, data, TEST_CHUNK_SIZE) == SSTM_OK);
+    TEST_CHECK(sstm_write_ref(ctx, data, TEST_MIB, NULL, NULL) == SSTM_OK);
+    for (pos = 0; pos < TEST_CHUNK_SIZE + TEST_MIB; pos += TEST_CHUNK_SIZE) {
+        TEST_CHECK(sstm_read(ctx, test_out, TEST_CHUNK_SIZE, 1) == SSTM_OK);
+        TEST_CHECK(memcmp(test_out, data + (pos == 0 ? 0 : pos - TEST_CHUNK_SIZE),
+                          TEST_CHUNK_SIZE) == 0);
+    }
+
+    sstm_del(ctx);
+    free(data);
+}
+
+int main(void) {
+    test_model_run();
+#if SSTM_USE_SPSC
+    test_threads();
+#endif
+    test_lazy();
+    printf("ref ok\n");
+
+    return 0;
+}
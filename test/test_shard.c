@@ -0,0 +1,92 @@
+/**
+ * sstm_shardset_t test.
+ *
+ * checks that the merge keeps the write order across shards, then
+ * has four threads write to their shards while the main thread
+ * merges and reads, every writer's records in its order.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_WRITERS            4
+#define TEST_RECORDS            20000
+
+static sstm_shardset_t *test_set;
+
+static void *test_writer(void *arg) {
+    sstm_u32_t rec[2];
+    sstm_u32_t i;
+
+    rec[0] = (sstm_u32_t)(uintptr_t)arg;
+    for (i = 0; i < TEST_RECORDS; i++) {
+        rec[1] = i;
+        while (sstm_shardset_write(test_set, rec[0], rec, sizeof(rec)) != SSTM_OK) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int main(void) {
+    pthread_t threads[TEST_WRITERS];
+    sstm_u32_t next[TEST_WRITERS] = {0};
+    sstm_u32_t rec[2];
+    sstm_u32_t value;
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_size_t size;
+    sstm_res_t res;
+    size_t count = 0;
+    sstm_u32_t i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 4096;
+    TEST_CHECK(sstm_shardset_new(&test_set, &conf, TEST_WRITERS) == SSTM_OK);
+    TEST_CHECK(sstm_shardset_ctx(test_set, &ctx) == SSTM_OK);
+
+    /* every third write is empty, it merges to nothing. */
+    for (i = 0; i < 100; i++) {
+        TEST_CHECK(sstm_shardset_write(test_set, (i * 7) % TEST_WRITERS, &i,
+                                       i % 3 == 0 ? 0 : sizeof(i)) == SSTM_OK);
+    }
+    TEST_CHECK(sstm_shardset_merge(test_set, &size) == SSTM_OK);
+    for (i = 0; i < 100; i++) {
+        if (i % 3 != 0) {
+            TEST_CHECK(sstm_read(ctx, &value, sizeof(value), 1) == SSTM_OK && value == i);
+        }
+    }
+    TEST_CHECK(sstm_shardset_write(test_set, TEST_WRITERS, rec, sizeof(rec)) == SSTM_ERR);
+    TEST_CHECK(sstm_shardset_write(test_set, 0, NULL, 4096) == SSTM_ERR_NO_SPACE);
+
+    for (i = 0; i < TEST_WRITERS; i++) {
+        TEST_CHECK(pthread_create(&threads[i], NULL, test_writer, (void *)(uintptr_t)i) == 0);
+    }
+    while (count < (size_t)TEST_WRITERS * TEST_RECORDS) {
+
+        /* the merged stream is full until it is read. */
+        res = sstm_shardset_merge(test_set, &size);
+        TEST_CHECK(res == SSTM_OK || res == SSTM_ERR_NO_SPACE);
+        while (sstm_read(ctx, rec, sizeof(rec), 1) == SSTM_OK) {
+            TEST_CHECK(rec[0] < TEST_WRITERS && rec[1] == next[rec[0]]);
+            next[rec[0]]++;
+            count++;
+        }
+        if (size == 0) {
+            sched_yield();
+        }
+    }
+    for (i = 0; i < TEST_WRITERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    sstm_shardset_del(test_set);
+    printf("shard ok\n");
+
+    return 0;
+}
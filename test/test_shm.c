@@ -0,0 +1,162 @@
+/**
+ * sstm_shm_new() / sstm_shm_attach() test.
+ *
+ * passes data from a producer process to a consumer process it forks
+ * through a stream in a memfd, then has a consumer die halfway and
+ * the producer take its role over, with the data it left.
+*/
+
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test.h"
+
+#define TEST_CAP_SIZE           (64 * 1024)
+#define TEST_TOTAL_SIZE         (16 * 1024 * 1024)
+#define TEST_MAX_SIZE           3000
+
+/* where the second consumer stops. */
+#define TEST_HALF_POS           (TEST_TOTAL_SIZE + TEST_TOTAL_SIZE / 2)
+
+static sstm_u8_t test_data[TEST_MAX_SIZE];
+
+/**
+ * @brief write the test data from a position to a position, waiting
+ *        for the consumer to make room.
+*/
+static void test_produce(sstm_ctx_t *ctx, sstm_u64_t pos, sstm_u64_t end, sstm_u32_t *state) {
+    sstm_size_t size;
+    sstm_res_t res;
+
+    while (pos < end) {
+        size = test_rand(state) % TEST_MAX_SIZE + 1;
+        if (size > end - pos) {
+            size = (sstm_size_t)(end - pos);
+        }
+        test_fill(test_data, pos, size);
+        while ((res = sstm_write(ctx, test_data, size)) == SSTM_ERR_NO_SPACE) {
+            TEST_CHECK(sstm_shm_peer(ctx) == SSTM_OK);
+            sched_yield();
+        }
+        TEST_CHECK(res == SSTM_OK);
+        pos += size;
+    }
+}
+
+/**
+ * @brief read and check the test data from a position to a position,
+ *        waiting for the producer.
+*/
+static void test_consume(sstm_ctx_t *ctx, sstm_u64_t pos, sstm_u64_t end, sstm_u32_t *state) {
+    sstm_size_t size;
+    sstm_res_t res;
+
+    while (pos < end) {
+        size = test_rand(state) % TEST_MAX_SIZE + 1;
+        if (size > end - pos) {
+            size = (sstm_size_t)(end - pos);
+        }
+        while ((res = sstm_read(ctx, test_data, size, 1)) == SSTM_ERR_NO_DATA) {
+            sched_yield();
+        }
+        TEST_CHECK(res == SSTM_OK);
+        TEST_CHECK(test_match(test_data, pos, size));
+        pos += size;
+    }
+}
+
+/**
+ * @brief fork a consumer that reads the stream from a position to a
+ *        position, and detaches at the end if asked to. it returns
+ *        once the consumer is attached.
+*/
+static pid_t test_fork(sstm_ctx_t *producer, int fd, sstm_u64_t pos, sstm_u64_t end,
+                       sstm_bool_t detach) {
+    sstm_ctx_t *ctx;
+    sstm_ctx_t *other;
+    sstm_u32_t state = 7;
+    pid_t pid;
+
+    pid = fork();
+    TEST_CHECK(pid >= 0);
+    if (pid != 0) {
+        while (sstm_shm_peer(producer) != SSTM_OK) {
+            sched_yield();
+        }
+
+        return pid;
+    }
+
+    TEST_CHECK(sstm_shm_attach(&ctx, fd, SSTM_SHM_CONSUMER) == SSTM_OK);
+    TEST_CHECK(sstm_shm_attach(&other, fd, SSTM_SHM_PRODUCER) == SSTM_ERR_BUSY);
+    TEST_CHECK(sstm_shm_peer(ctx) == SSTM_OK);
+    test_consume(ctx, pos, end, &state);
+    if (detach) {
+        TEST_CHECK(sstm_shm_detach(ctx) == SSTM_OK);
+    }
+    _exit(0);
+}
+
+/**
+ * @brief wait for a child and check that it passed.
+*/
+static void test_join(pid_t pid) {
+    int status;
+
+    TEST_CHECK(waitpid(pid, &status, 0) == pid);
+    TEST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main(void) {
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_ctx_t *ctx2;
+    sstm_stat_t stat;
+    sstm_u32_t state = 3;
+    pid_t pid;
+    int fd;
+
+    fd = memfd_create("test_shm", 0);
+    TEST_CHECK(fd >= 0);
+    TEST_CHECK(sstm_shm_attach(&ctx, fd, SSTM_SHM_CONSUMER) == SSTM_ERR);
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    TEST_CHECK(sstm_shm_new(&ctx, &conf, fd, SSTM_SHM_PRODUCER) == SSTM_OK);
+    TEST_CHECK(sstm_shm_new(&ctx2, &conf, fd, SSTM_SHM_PRODUCER) == SSTM_ERR);
+    TEST_CHECK(sstm_shm_peer(ctx) == SSTM_ERR_NO_PEER);
+
+    /* the consumer reads everything, then leaves its role. */
+    pid = test_fork(ctx, fd, 0, TEST_TOTAL_SIZE, 1);
+    test_produce(ctx, 0, TEST_TOTAL_SIZE, &state);
+    test_join(pid);
+    TEST_CHECK(sstm_shm_peer(ctx) == SSTM_ERR_NO_PEER);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.tail_pos == TEST_TOTAL_SIZE && stat.used_size == 0);
+
+    /* the next one dies halfway without leaving it, and before
+       reading the last of the data. */
+    pid = test_fork(ctx, fd, TEST_TOTAL_SIZE, TEST_HALF_POS, 0);
+    test_produce(ctx, TEST_TOTAL_SIZE, TEST_HALF_POS + TEST_CAP_SIZE / 2, &state);
+    test_join(pid);
+    TEST_CHECK(sstm_shm_peer(ctx) == SSTM_ERR_NO_PEER);
+
+    /* its role is taken over where it stopped. */
+    TEST_CHECK(sstm_shm_attach(&ctx2, fd, SSTM_SHM_CONSUMER) == SSTM_OK);
+    TEST_CHECK(sstm_shm_peer(ctx) == SSTM_OK);
+    sstm_stat(ctx2, &stat);
+    TEST_CHECK(stat.head_pos + stat.seek_offs == TEST_HALF_POS);
+    test_consume(ctx2, TEST_HALF_POS, TEST_HALF_POS + TEST_CAP_SIZE / 2, &state);
+
+    TEST_CHECK(sstm_shm_detach(ctx2) == SSTM_OK);
+    TEST_CHECK(sstm_shm_detach(ctx) == SSTM_OK);
+    close(fd);
+    printf("shm ok\n");
+
+    return 0;
+}
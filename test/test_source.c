@@ -0,0 +1,201 @@
+/**
+ * sstm_source_new() test.
+ *
+ * runs random reads, seeks, preads and cleans on a stream of a
+ * source of the test data, then checks that a failed fetch surfaces
+ * on the read that needs it, that stale data blocks the fetches
+ * instead of a read, and that sstm_seek_pos() reaches anywhere in a
+ * source larger than sstm_seek() can with one refill.
+*/
+
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_SOURCE_SIZE        (8 * 1024 * 1024 + 777)
+#define TEST_ROUNDS             20000
+
+static sstm_u8_t test_data[1 << 19];
+
+/* the position of the byte whose fetch fails, -1 for none. */
+static sstm_s64_t test_fail_pos = -1;
+
+static sstm_res_t test_fetch(void *arg, sstm_u64_t pos, void *data, sstm_size_t size) {
+    sstm_s64_t fail_pos = __atomic_load_n(&test_fail_pos, __ATOMIC_ACQUIRE);
+    sstm_u64_t source_size = *(sstm_u64_t *)arg;
+
+    TEST_CHECK(size != 0 && pos + size <= source_size);
+    if (fail_pos >= 0 && pos <= (sstm_u64_t)fail_pos && (sstm_u64_t)fail_pos < pos + size) {
+        return SSTM_ERR;
+    }
+    test_fill(data, pos, size);
+
+    return SSTM_OK;
+}
+
+static void test_model_run(void) {
+    sstm_u64_t source_size = TEST_SOURCE_SIZE;
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_u32_t state = 3;
+    sstm_u64_t cur = 0;
+    sstm_u64_t pos;
+    sstm_size_t size;
+    sstm_offs_t delta;
+    sstm_s64_t target;
+    sstm_res_t res;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 1 << 20;
+    conf.src_block = 50000;
+    conf.src_ahead = 6;
+    TEST_CHECK(sstm_source_new(&ctx, &conf, TEST_SOURCE_SIZE, test_fetch, &source_size) == SSTM_OK);
+
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        sstm_stat(ctx, &stat);
+        TEST_CHECK(stat.head_pos + stat.seek_offs == cur);
+        size = test_rand(&state) % 5000 + 1;
+        switch (test_rand(&state) % 10) {
+            case 0:
+                size = test_rand(&state) % 300000 + 1;
+                /* fall through */
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+                res = sstm_read(ctx, test_data, size, test_rand(&state) % 3 != 0);
+                if (cur + size > TEST_SOURCE_SIZE) {
+                    TEST_CHECK(res == SSTM_ERR_NO_DATA);
+                } else if (res == SSTM_ERR_NO_DATA) {
+
+                    /* the stale data leaves no room for it. */
+                    TEST_CHECK(sstm_clean(ctx) == SSTM_OK);
+                } else {
+                    TEST_CHECK(res == SSTM_OK && test_match(test_data, cur, size));
+                    cur += size;
+                }
+                break;
+            case 5:
+                pos = test_rand(&state) % (TEST_SOURCE_SIZE + 1);
+                TEST_CHECK(sstm_seek_pos(ctx, pos) == SSTM_OK);
+                cur = pos;
+                break;
+            case 6:
+                delta = (sstm_offs_t)(test_rand(&state) % 400000) - 200000;
+                target = (sstm_s64_t)cur + delta;
+                res = sstm_seek(ctx, delta, SSTM_SEEK_CUR);
+                if (target < 0 || target > TEST_SOURCE_SIZE) {
+                    TEST_CHECK(res == SSTM_ERR_BAD_OFFS);
+                } else {
+                    TEST_CHECK(res == SSTM_OK);
+                    cur = (sstm_u64_t)target;
+                }
+                break;
+            case 7:
+                delta = -(sstm_offs_t)(test_rand(&state) % 100000);
+                TEST_CHECK(sstm_seek(ctx, delta, SSTM_SEEK_END) == SSTM_OK);
+                cur = (sstm_u64_t)((sstm_s64_t)TEST_SOURCE_SIZE + delta);
+                break;
+            case 8:
+                if (stat.tail_pos == stat.head_pos) {
+                    break;
+                }
+                pos = stat.head_pos + test_rand(&state) % (stat.tail_pos - stat.head_pos);
+                size = (sstm_size_t)(test_rand(&state) % (stat.tail_pos - pos)) + 1;
+                TEST_CHECK(sstm_pread(ctx, pos, test_data, size) == SSTM_OK);
+                TEST_CHECK(test_match(test_data, pos, size));
+                break;
+            default:
+                TEST_CHECK(sstm_clean(ctx) == SSTM_OK);
+                break;
+        }
+    }
+
+    /* a failed fetch fails the read that needs its data,
+       the refill of the next seek clears it. */
+    pos = TEST_SOURCE_SIZE / 2;
+    __atomic_store_n(&test_fail_pos, (sstm_s64_t)pos + 50, __ATOMIC_RELEASE);
+    TEST_CHECK(sstm_seek_pos(ctx, TEST_SOURCE_SIZE) == SSTM_OK);
+    TEST_CHECK(sstm_seek_pos(ctx, pos) == SSTM_OK);
+    TEST_CHECK(sstm_read(ctx, test_data, 100, 1) == SSTM_ERR);
+    __atomic_store_n(&test_fail_pos, -1, __ATOMIC_RELEASE);
+    TEST_CHECK(sstm_seek(ctx, -1000, SSTM_SEEK_END) == SSTM_OK);
+    TEST_CHECK(sstm_read(ctx, test_data, 1000, 1) == SSTM_OK);
+    TEST_CHECK(test_match(test_data, TEST_SOURCE_SIZE - 1000, 1000));
+
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.src_size == TEST_SOURCE_SIZE && stat.src_fetches != 0 && stat.src_refills != 0);
+    sstm_del(ctx);
+}
+
+static void test_stale(void) {
+    sstm_u64_t source_size = 100000;
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 4096;
+    conf.src_block = 1000;
+    TEST_CHECK(sstm_source_new(&ctx, &conf, source_size, test_fetch, &source_size) == SSTM_OK);
+
+    /* a read does not wait for fetches the stale data blocks. */
+    TEST_CHECK(sstm_read(ctx, test_data, 3000, 0) == SSTM_OK && test_match(test_data, 0, 3000));
+    TEST_CHECK(sstm_read(ctx, test_data, 2000, 0) == SSTM_ERR_NO_DATA);
+    TEST_CHECK(sstm_clean(ctx) == SSTM_OK);
+    TEST_CHECK(sstm_read(ctx, test_data, 2000, 0) == SSTM_OK && test_match(test_data, 3000, 2000));
+    TEST_CHECK(sstm_read(ctx, test_data, 5000, 0) == SSTM_ERR_NO_DATA);
+    sstm_del(ctx);
+
+    /* an empty source is an empty stream. */
+    source_size = 0;
+    TEST_CHECK(sstm_source_new(&ctx, NULL, 0, test_fetch, &source_size) == SSTM_OK);
+    TEST_CHECK(sstm_read(ctx, test_data, 1, 1) == SSTM_ERR_NO_DATA);
+    sstm_del(ctx);
+}
+
+static void test_seek_pos(void) {
+    sstm_u64_t source_size = 6ull << 30;
+    sstm_u64_t refills;
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_size_t size;
+    size_t i;
+
+    /* past what a 32-bit seek reaches, then back into the window. */
+    const sstm_u64_t positions[] = {
+        5ull << 30, (5ull << 30) + 100, 1ull << 32, 3, (6ull << 30) - 10, 6ull << 30,
+    };
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 1 << 20;
+    TEST_CHECK(sstm_source_new(&ctx, &conf, source_size, test_fetch, &source_size) == SSTM_OK);
+
+    for (i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+        sstm_stat(ctx, &stat);
+        refills = stat.src_refills;
+        TEST_CHECK(sstm_seek_pos(ctx, positions[i]) == SSTM_OK);
+        sstm_stat(ctx, &stat);
+        TEST_CHECK(stat.head_pos + stat.seek_offs == positions[i]);
+        TEST_CHECK(stat.src_refills - refills <= 1);
+        size = source_size - positions[i] < 64 ? (sstm_size_t)(source_size - positions[i]) : 64;
+        if (size != 0) {
+            TEST_CHECK(sstm_read(ctx, test_data, size, 0) == SSTM_OK);
+            TEST_CHECK(test_match(test_data, positions[i], size));
+        }
+    }
+    TEST_CHECK(sstm_seek_pos(ctx, source_size + 1) == SSTM_ERR_BAD_OFFS);
+
+    sstm_del(ctx);
+}
+
+int main(void) {
+    test_model_run();
+    test_stale();
+    test_seek_pos();
+    printf("source ok\n");
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * sstm::stream<Capacity> test.
+ *
+ * runs the same random writes, reads, skips, seeks and cleans on a
+ * stream and on a C context of the same capacity, and checks after
+ * every one that both return the same result, the same data and the
+ * same status, positions included. the class writes the ring logic
+ * again, this keeps the two in line.
+*/
+
+#include <cstring>
+
+#include "seekablestream.hpp"
+#include "test.h"
+
+#define TEST_ROUNDS             200000
+
+static std::byte test_data[2][2000];
+
+static void test_same(const sstm_stat_t &lhs, const sstm_stat_t &rhs) {
+    TEST_CHECK(lhs.cap_size == rhs.cap_size);
+    TEST_CHECK(lhs.used_size == rhs.used_size);
+    TEST_CHECK(lhs.stale_size == rhs.stale_size);
+    TEST_CHECK(lhs.fresh_size == rhs.fresh_size);
+    TEST_CHECK(lhs.free_size == rhs.free_size);
+    TEST_CHECK(lhs.seek_offs == rhs.seek_offs);
+    TEST_CHECK(lhs.head_pos == rhs.head_pos);
+    TEST_CHECK(lhs.tail_pos == rhs.tail_pos);
+}
+
+template <sstm_size_t Capacity>
+static void test_run(sstm_u32_t state) {
+    static sstm::stream<Capacity> strm;
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_u64_t write_pos = 0;
+    sstm_size_t size;
+    sstm_offs_t offset;
+    sstm_whence_t whence;
+    sstm_u32_t value;
+    sstm_u32_t c_value;
+    sstm::result res;
+    bool cleanup;
+    int i;
+
+    std::memset(&conf, 0, sizeof(conf));
+    conf.cap_size = Capacity;
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+    TEST_CHECK(strm.cap_size == Capacity);
+
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        size = test_rand(&state) % (Capacity / 2 + 2);
+        cleanup = test_rand(&state) % 4 == 0;
+        switch (test_rand(&state) % 9) {
+            case 0:
+            case 1:
+                test_fill(test_data[0], write_pos, size);
+                res = strm.write(std::span<const std::byte>(test_data[0], size));
+                TEST_CHECK(res.code == sstm_write(ctx, test_data[0], size));
+                if (res.ok()) {
+                    write_pos += size;
+                }
+                break;
+            case 2:
+                test_fill(&value, write_pos, sizeof(value));
+                res = strm.write_value(value);
+                TEST_CHECK(res.code == sstm_write(ctx, &value, sizeof(value)));
+                if (res.ok()) {
+                    write_pos += sizeof(value);
+                }
+                break;
+            case 3:
+            case 4:
+                stat = strm.stat();
+                res = strm.read(std::span<std::byte>(test_data[0], size), cleanup);
+                TEST_CHECK(res.code == sstm_read(ctx, test_data[1], size, cleanup));
+                if (res.ok()) {
+                    TEST_CHECK(std::memcmp(test_data[0], test_data[1], size) == 0);
+                    TEST_CHECK(test_match(test_data[0], stat.head_pos + stat.seek_offs, size));
+                }
+                break;
+            case 5:
+                stat = strm.stat();
+                if (strm.read_value(value, cleanup).ok()) {
+                    TEST_CHECK(sstm_read(ctx, &c_value, sizeof(c_value), cleanup) == SSTM_OK);
+                    TEST_CHECK(c_value == value && test_match(&value, stat.head_pos + stat.seek_offs,
+                                                              sizeof(value)));
+                } else {
+                    TEST_CHECK(sstm_read(ctx, &c_value, sizeof(c_value), cleanup) == SSTM_ERR_NO_DATA);
+                }
+                break;
+            case 6:
+                TEST_CHECK(strm.skip(size, cleanup).code == sstm_read(ctx, NULL, size, cleanup));
+                break;
+            case 7:
+                offset = (sstm_offs_t)(test_rand(&state) % (Capacity * 2 + 1)) - (sstm_offs_t)Capacity;
+                whence = (sstm_whence_t)(test_rand(&state) % 3);
+                TEST_CHECK(strm.seek(offset, whence).code == sstm_seek(ctx, offset, whence));
+                break;
+            default:
+                TEST_CHECK(strm.clean().code == sstm_clean(ctx));
+                break;
+        }
+
+        sstm_stat(ctx, &stat);
+        test_same(strm.stat(), stat);
+        TEST_CHECK(strm.fresh_size() == stat.fresh_size && strm.free_size() == stat.free_size);
+    }
+    TEST_CHECK(write_pos > Capacity * 100);
+
+    /* the stale data the stream still holds is the test data. */
+    stat = strm.stat();
+    TEST_CHECK(strm.seek(0, SSTM_SEEK_SET).ok());
+    TEST_CHECK(strm.read(std::span<std::byte>(test_data[0], stat.used_size)).ok());
+    TEST_CHECK(test_match(test_data[0], stat.head_pos, stat.used_size));
+
+    sstm_del(ctx);
+}
+
+int main() {
+    test_run<128>(1);
+    test_run<1000>(2);
+    test_run<1023>(3);
+    std::printf("stream ok\n");
+
+    return 0;
+}
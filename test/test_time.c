@@ -0,0 +1,106 @@
+/**
+ * sstm_seek_time() test.
+ *
+ * takes a clock reading between writes a few microseconds apart and
+ * checks that seeking to it lands on the write that followed, before
+ * and after a clean, and with a minimum gap between timestamps.
+*/
+
+#include <string.h>
+#include <time.h>
+
+#include "test.h"
+
+#define TEST_WRITES             10
+
+static sstm_u64_t test_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (sstm_u64_t)ts.tv_sec * 1000000000 + (sstm_u64_t)ts.tv_nsec;
+}
+
+/* keep the clock readings and the write timestamps apart. */
+static void test_spin(void) {
+    sstm_u64_t begin = test_now();
+
+    while (test_now() - begin < 2000) {
+    }
+}
+
+/**
+ * @brief write TEST_WRITES blocks of size bytes of their index, with
+ *        a clock reading taken before each.
+*/
+static void test_write(sstm_ctx_t *ctx, sstm_u64_t *stamps, sstm_size_t size) {
+    sstm_u8_t data[64];
+    int i;
+
+    for (i = 0; i < TEST_WRITES; i++) {
+        test_spin();
+        stamps[i] = test_now();
+        test_spin();
+        memset(data, i, size);
+        TEST_CHECK(sstm_write(ctx, data, size) == SSTM_OK);
+    }
+}
+
+int main(void) {
+    sstm_u64_t stamps[TEST_WRITES];
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_stat_t stat;
+    sstm_u8_t data;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = 1024;
+    conf.time_num = 16;
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+    TEST_CHECK(sstm_seek_time(ctx, 0) == SSTM_ERR_NO_DATA);
+
+    test_write(ctx, stamps, 10);
+    for (i = 0; i < TEST_WRITES; i++) {
+        TEST_CHECK(sstm_seek_time(ctx, stamps[i]) == SSTM_OK);
+        sstm_stat(ctx, &stat);
+        TEST_CHECK(stat.seek_offs == (sstm_size_t)i * 10);
+        TEST_CHECK(sstm_read(ctx, &data, 1, 0) == SSTM_OK && data == i);
+    }
+    TEST_CHECK(sstm_seek_time(ctx, 0) == SSTM_OK);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.seek_offs == 0);
+    TEST_CHECK(sstm_seek_time(ctx, test_now()) == SSTM_ERR_NO_DATA);
+
+    /* the clean drops the timestamps of the first four writes,
+       a seek before them lands on the head. */
+    TEST_CHECK(sstm_seek(ctx, 35, SSTM_SEEK_SET) == SSTM_OK);
+    TEST_CHECK(sstm_clean(ctx) == SSTM_OK);
+    TEST_CHECK(sstm_seek_time(ctx, stamps[1]) == SSTM_OK);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.seek_offs == 5);
+    TEST_CHECK(sstm_read(ctx, &data, 1, 0) == SSTM_OK && data == 4);
+
+    /* a full index does not fail the writes. */
+    for (i = 0; i < 20; i++) {
+        TEST_CHECK(sstm_write(ctx, "x", 1) == SSTM_OK);
+    }
+    sstm_del(ctx);
+
+    /* with 100 bytes between timestamps, every fourth 30 byte
+       write is stamped. */
+    conf.time_gap = 100;
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+    test_write(ctx, stamps, 30);
+    TEST_CHECK(sstm_seek_time(ctx, stamps[1]) == SSTM_OK);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.seek_offs == 120);
+    TEST_CHECK(sstm_seek_time(ctx, stamps[0]) == SSTM_OK);
+    sstm_stat(ctx, &stat);
+    TEST_CHECK(stat.seek_offs == 0);
+    sstm_del(ctx);
+
+    printf("time ok\n");
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * sstm_read_wait() and sstm_write_wait() test.
+ *
+ * checks the timeouts and the sizes that can never be reached, then
+ * has a producer and a consumer thread that only ever wait for each
+ * other without a timeout, so that a lost wake up hangs the test.
+*/
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test.h"
+
+#define TEST_CAP_SIZE           1000
+#define TEST_MAX_SIZE           300
+#define TEST_TRANSFERS          100000
+
+static sstm_ctx_t *test_ctx;
+
+/**
+ * @brief get the monotonic time in milliseconds.
+*/
+static sstm_s64_t test_ms(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (sstm_s64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void *test_late_writer(void *arg) {
+    (void)arg;
+
+    usleep(20000);
+    TEST_CHECK(sstm_write(test_ctx, "abcd", 4) == SSTM_OK);
+
+    return NULL;
+}
+
+static void test_timeout(void) {
+    sstm_u8_t data[TEST_CAP_SIZE];
+    pthread_t thread;
+    sstm_conf_t conf;
+    sstm_s64_t start;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    TEST_CHECK(sstm_new(&test_ctx, &conf) == SSTM_OK);
+
+    /* nothing to wait for. */
+    TEST_CHECK(sstm_read_wait(test_ctx, 0, 0) == SSTM_OK);
+    TEST_CHECK(sstm_write_wait(test_ctx, TEST_CAP_SIZE, 0) == SSTM_OK);
+
+    /* the timeout passes, and no less of it. */
+    start = test_ms();
+    TEST_CHECK(sstm_read_wait(test_ctx, 1, 50) == SSTM_ERR_TIMEOUT);
+    TEST_CHECK(test_ms() - start >= 49);
+    TEST_CHECK(sstm_read_wait(test_ctx, 1, 0) == SSTM_ERR_TIMEOUT);
+
+    /* more than the capacity is never reached. */
+    TEST_CHECK(sstm_read_wait(test_ctx, TEST_CAP_SIZE + 1, -1) == SSTM_ERR_NO_DATA);
+    TEST_CHECK(sstm_write_wait(test_ctx, TEST_CAP_SIZE + 1, -1) == SSTM_ERR_NO_SPACE);
+
+    test_fill(data, 0, sizeof(data));
+    TEST_CHECK(sstm_write(test_ctx, data, sizeof(data)) == SSTM_OK);
+    TEST_CHECK(sstm_write_wait(test_ctx, 1, 20) == SSTM_ERR_TIMEOUT);
+    TEST_CHECK(sstm_read_wait(test_ctx, TEST_CAP_SIZE, 0) == SSTM_OK);
+    TEST_CHECK(sstm_read(test_ctx, data, sizeof(data), 1) == SSTM_OK);
+
+    /* a write wakes a reader waiting for more than was there. */
+    TEST_CHECK(pthread_create(&thread, NULL, test_late_writer, NULL) == 0);
+    start = test_ms();
+    TEST_CHECK(sstm_read_wait(test_ctx, 4, 5000) == SSTM_OK);
+    TEST_CHECK(test_ms() - start < 5000);
+    pthread_join(thread, NULL);
+
+    sstm_del(test_ctx);
+}
+
+static void *test_producer(void *arg) {
+    sstm_u8_t data[TEST_MAX_SIZE];
+    sstm_u32_t state = 11;
+    sstm_u64_t pos = 0;
+    sstm_size_t size;
+    int i;
+
+    (void)arg;
+    for (i = 0; i < TEST_TRANSFERS; i++) {
+        size = test_rand(&state) % TEST_MAX_SIZE + 1;
+        test_fill(data, pos, size);
+        TEST_CHECK(sstm_write_wait(test_ctx, size, -1) == SSTM_OK);
+        TEST_CHECK(sstm_write(test_ctx, data, size) == SSTM_OK);
+        pos += size;
+    }
+
+    return NULL;
+}
+
+static void test_ping_pong(void) {
+    sstm_u8_t data[TEST_MAX_SIZE];
+    pthread_t thread;
+    sstm_conf_t conf;
+    sstm_u32_t state = 11;
+    sstm_u32_t read_state = 17;
+    sstm_u64_t total = 0;
+    sstm_u64_t pos = 0;
+    sstm_size_t size;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    TEST_CHECK(sstm_new(&test_ctx, &conf) == SSTM_OK);
+
+    /* the total the producer writes, from the same sequence. */
+    for (i = 0; i < TEST_TRANSFERS; i++) {
+        total += test_rand(&state) % TEST_MAX_SIZE + 1;
+    }
+
+    TEST_CHECK(pthread_create(&thread, NULL, test_producer, NULL) == 0);
+    while (pos < total) {
+        size = test_rand(&read_state) % TEST_MAX_SIZE + 1;
+        if (size > total - pos) {
+            size = (sstm_size_t)(total - pos);
+        }
+        TEST_CHECK(sstm_read_wait(test_ctx, size, -1) == SSTM_OK);
+        TEST_CHECK(sstm_read(test_ctx, data, size, 1) == SSTM_OK);
+        TEST_CHECK(test_match(data, pos, size));
+        pos += size;
+    }
+    pthread_join(thread, NULL);
+
+    sstm_del(test_ctx);
+}
+
+int main(void) {
+    test_timeout();
+    test_ping_pong();
+    printf("wait ok\n");
+
+    return 0;
+}
@@ -0,0 +1,223 @@
+/**
+ * sstm_write_xform() / sstm_read_xform() test.
+ *
+ * checks the built-in transforms against known vectors (the masked
+ * frame of RFC 6455 and the CRC-32C check values), then passes data
+ * around a ring whose size is a multiple of no unit, through a
+ * transform on the way in and its inverse on the way out.
+*/
+
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_CAP_SIZE           1000
+#define TEST_ROUNDS             20000
+
+static sstm_u8_t test_data[TEST_CAP_SIZE];
+
+/**
+ * @brief the CRC-32C of a buffer, one bit at a time.
+*/
+static sstm_u32_t test_crc32c(sstm_u32_t crc, const sstm_u8_t *data, sstm_size_t size) {
+    sstm_size_t i;
+    int bit;
+
+    crc = ~crc;
+    for (i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief reverse every 3 byte unit, which must never be split.
+*/
+static void test_rev3_func(sstm_xform_t *xform, void *dst, const void *src, sstm_size_t size) {
+    const sstm_u8_t *s = (const sstm_u8_t *)src;
+    sstm_u8_t *d = (sstm_u8_t *)dst;
+    sstm_size_t i;
+
+    TEST_CHECK(xform->pos % 3 == 0 && size % 3 == 0);
+    for (i = 0; i < size; i += 3) {
+        d[i] = s[i + 2];
+        d[i + 1] = s[i + 1];
+        d[i + 2] = s[i];
+    }
+}
+
+/**
+ * @brief pass data through a fresh stream and a transform on the way
+ *        in, and get it back as it is in the ring.
+*/
+static void test_in(sstm_xform_t *xform, const void *data, sstm_size_t size, void *out) {
+    sstm_ctx_t *ctx;
+
+    TEST_CHECK(sstm_new(&ctx, NULL) == SSTM_OK);
+    TEST_CHECK(sstm_write_xform(ctx, data, size, xform) == SSTM_OK);
+    TEST_CHECK(sstm_read(ctx, out, size, 1) == SSTM_OK);
+    sstm_del(ctx);
+}
+
+static void test_vectors(void) {
+    static const sstm_u8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+    static const sstm_u8_t masked[5] = {0x7f, 0x9f, 0x4d, 0x51, 0x58};
+    static const sstm_u8_t words[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    static const sstm_u8_t swapped2[8] = {2, 1, 4, 3, 6, 5, 8, 7};
+    static const sstm_u8_t swapped4[8] = {4, 3, 2, 1, 8, 7, 6, 5};
+    static const sstm_u8_t swapped8[8] = {8, 7, 6, 5, 4, 3, 2, 1};
+    sstm_u8_t data[64];
+    sstm_u8_t out[64];
+    sstm_xform_t xform;
+    sstm_ctx_t *ctx;
+    sstm_u32_t key_word;
+    sstm_size_t i;
+
+    /* the masked "Hello" of RFC 6455, section 5.7. */
+    memcpy(&key_word, key, sizeof(key_word));
+    TEST_CHECK(sstm_xform_xor(&xform, key_word) == SSTM_OK);
+    test_in(&xform, "Hello", 5, out);
+    TEST_CHECK(memcmp(out, masked, 5) == 0 && xform.pos == 5);
+
+    /* the mask keeps its phase from one transfer to the next. */
+    TEST_CHECK(sstm_new(&ctx, NULL) == SSTM_OK);
+    TEST_CHECK(sstm_xform_xor(&xform, key_word) == SSTM_OK);
+    test_fill(data, 0, sizeof(data));
+    for (i = 0; i < 10; i++) {
+        TEST_CHECK(sstm_write_xform(ctx, data + i * (i + 1) / 2, i + 1, &xform) == SSTM_OK);
+    }
+    TEST_CHECK(sstm_read(ctx, out, 55, 1) == SSTM_OK);
+    for (i = 0; i < 55; i++) {
+        TEST_CHECK(out[i] == (data[i] ^ key[i % 4]));
+    }
+    sstm_del(ctx);
+
+    TEST_CHECK(sstm_xform_bswap(&xform, 2) == SSTM_OK && xform.unit == 2);
+    test_in(&xform, words, 8, out);
+    TEST_CHECK(memcmp(out, swapped2, 8) == 0);
+    TEST_CHECK(sstm_xform_bswap(&xform, 4) == SSTM_OK && xform.unit == 4);
+    test_in(&xform, words, 8, out);
+    TEST_CHECK(memcmp(out, swapped4, 8) == 0);
+    TEST_CHECK(sstm_xform_bswap(&xform, 8) == SSTM_OK && xform.unit == 8);
+    test_in(&xform, words, 8, out);
+    TEST_CHECK(memcmp(out, swapped8, 8) == 0);
+    TEST_CHECK(sstm_xform_bswap(&xform, 3) == SSTM_ERR);
+
+    /* the check values of CRC-32C, RFC 3720 appendix B.4 among them. */
+    TEST_CHECK(sstm_xform_hash(&xform) == SSTM_OK);
+    test_in(&xform, "123456789", 9, out);
+    TEST_CHECK(memcmp(out, "123456789", 9) == 0 && xform.state == 0xe3069283);
+    memset(data, 0, 32);
+    TEST_CHECK(sstm_xform_hash(&xform) == SSTM_OK);
+    test_in(&xform, data, 32, out);
+    TEST_CHECK(xform.state == 0x8a9136aa);
+    memset(data, 0xff, 32);
+    TEST_CHECK(sstm_xform_hash(&xform) == SSTM_OK);
+    test_in(&xform, data, 32, out);
+    TEST_CHECK(xform.state == 0x62a8ab43);
+
+    /* the running hash of the pieces is the hash of the whole, for
+       every length and alignment the word loop can meet. */
+    TEST_CHECK(sstm_new(&ctx, NULL) == SSTM_OK);
+    TEST_CHECK(sstm_xform_hash(&xform) == SSTM_OK);
+    test_fill(data, 0, sizeof(data));
+    for (i = 0; i < 10; i++) {
+        TEST_CHECK(sstm_write_xform(ctx, data + i * (i + 1) / 2, i + 1, &xform) == SSTM_OK);
+        TEST_CHECK(xform.state == test_crc32c(0, data, (i + 1) * (i + 2) / 2));
+    }
+    sstm_del(ctx);
+
+    /* transfers that are not whole units fail and leave it as it is. */
+    TEST_CHECK(sstm_new(&ctx, NULL) == SSTM_OK);
+    TEST_CHECK(sstm_xform_bswap(&xform, 4) == SSTM_OK);
+    TEST_CHECK(sstm_write_xform(ctx, words, 6, &xform) == SSTM_ERR);
+    TEST_CHECK(sstm_write_xform(ctx, words, 8, &xform) == SSTM_OK);
+    TEST_CHECK(sstm_read_xform(ctx, out, 6, 1, &xform) == SSTM_ERR);
+    TEST_CHECK(xform.pos == 8);
+    memset(&xform, 0, sizeof(xform));
+    TEST_CHECK(sstm_read_xform(ctx, out, 8, 1, &xform) == SSTM_ERR);
+    sstm_del(ctx);
+}
+
+/**
+ * @brief write and read random multiples of the unit through a pair
+ *        of inverse transforms, around the ring buffer.
+*/
+static void test_round_trip(sstm_xform_t *in, sstm_xform_t *out) {
+    sstm_u64_t write_pos = 0;
+    sstm_u64_t read_pos = 0;
+    sstm_conf_t conf;
+    sstm_ctx_t *ctx;
+    sstm_u64_t pos;
+    sstm_u32_t state = 5;
+    sstm_size_t size;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.cap_size = TEST_CAP_SIZE;
+    TEST_CHECK(sstm_new(&ctx, &conf) == SSTM_OK);
+
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        size = test_rand(&state) % (TEST_CAP_SIZE / 4) / in->unit * in->unit;
+        test_fill(test_data, write_pos, size);
+        pos = in->pos;
+        if (sstm_write_xform(ctx, test_data, size, in) == SSTM_OK) {
+            write_pos += size;
+        } else {
+            TEST_CHECK(in->pos == pos);
+        }
+
+        size = test_rand(&state) % (TEST_CAP_SIZE / 4) / in->unit * in->unit;
+        if (sstm_read_xform(ctx, test_data, size, 1, out) == SSTM_OK) {
+            TEST_CHECK(test_match(test_data, read_pos, size));
+            read_pos += size;
+        }
+    }
+    TEST_CHECK(read_pos > TEST_ROUNDS * (sstm_u64_t)TEST_CAP_SIZE / 16);
+
+    /* the rest, so that both have seen the same bytes. */
+    size = (sstm_size_t)(write_pos - read_pos);
+    TEST_CHECK(sstm_read_xform(ctx, test_data, size, 1, out) == SSTM_OK);
+    TEST_CHECK(test_match(test_data, read_pos, size));
+    TEST_CHECK(in->pos == write_pos && out->pos == write_pos);
+
+    sstm_del(ctx);
+}
+
+int main(void) {
+    sstm_xform_t in;
+    sstm_xform_t out;
+    sstm_size_t width;
+
+    test_vectors();
+
+    TEST_CHECK(sstm_xform_xor(&in, 0xdeadbeef) == SSTM_OK);
+    TEST_CHECK(sstm_xform_xor(&out, 0xdeadbeef) == SSTM_OK);
+    test_round_trip(&in, &out);
+
+    for (width = 2; width <= 8; width *= 2) {
+        TEST_CHECK(sstm_xform_bswap(&in, width) == SSTM_OK);
+        TEST_CHECK(sstm_xform_bswap(&out, width) == SSTM_OK);
+        test_round_trip(&in, &out);
+    }
+
+    TEST_CHECK(sstm_xform_hash(&in) == SSTM_OK);
+    TEST_CHECK(sstm_xform_hash(&out) == SSTM_OK);
+    test_round_trip(&in, &out);
+    TEST_CHECK(in.state == out.state);
+
+    /* a unit of a size no part of the ring is a multiple of. */
+    memset(&in, 0, sizeof(in));
+    in.func = test_rev3_func;
+    in.unit = 3;
+    out = in;
+    test_round_trip(&in, &out);
+
+    printf("xform ok\n");
+
+    return 0;
+}